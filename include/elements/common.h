@@ -48,6 +48,7 @@ typedef struct
 
 static filter_option_overrides filter_options[] = {
   GPAC_TF_FILTER_OPTIONS("mp4mx", GPAC_PROP_SEGDUR),
+  GPAC_TF_FILTER_OPTIONS("dasher", GPAC_PROP_IFRAME_PLAYLIST),
 };
 
 /**
@@ -158,6 +159,17 @@ static subelement_info subelements[] = {
       GPAC_TF_FILTER_OPTION("dmode", "dynamic", FALSE)),
     "master.m3u8",
     "dasher_all"),
+  GPAC_TF_SUBELEMENT_CUSTOM(
+    "dash",
+    "dasher",
+    NULL, // No caps, this is a sink only element
+    GPAC_SE_SINK_ONLY | GPAC_SE_REQUIRES_MEMOUT,
+    GPAC_TF_FILTER_OPTION_ARRAY(
+      GPAC_TF_FILTER_OPTION("mname", "manifest.mpd", TRUE),
+      GPAC_TF_FILTER_OPTION("cmaf", "cmf2", TRUE),
+      GPAC_TF_FILTER_OPTION("dmode", "dynamic", FALSE)),
+    "manifest.mpd",
+    "dasher_all"),
   GPAC_TF_SUBELEMENT_AS("tsmx", "m2tsmx", MPEG_TS_CAPS, NULL),
 };
 
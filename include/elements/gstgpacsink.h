@@ -48,7 +48,6 @@ struct _GstGpacSink
 
   /* Internal elements */
   GstElement* tf;
-  GstElement* sink;
 };
 
 GST_ELEMENT_REGISTER_DECLARE(gpac_sink);
@@ -28,6 +28,7 @@
 #include "elements/common.h"
 #include "gpacmessages.h"
 
+#include "lib/allocator.h"
 #include "lib/caps.h"
 #include "lib/main.h"
 #include "lib/memio.h"
@@ -35,7 +36,10 @@
 #include "lib/pid.h"
 #include "lib/properties.h"
 #include "lib/session.h"
+#include "lib/shm.h"
 #include "lib/signals.h"
+#include "lib/stats.h"
+#include "lib/trace.h"
 
 #include <gst/base/gstaggregator.h>
 #include <gst/gst.h>
@@ -56,9 +60,32 @@ struct _GstGpacTransform
   /* GPAC Context */
   GPAC_Context gpac_ctx;
 
+  /* Session reuse */
+  gchar* session_graph;
+  gchar* session_key;
+  gboolean session_running; // guarded by the object lock, for live updates
+  GThread* prepare_thread;  // builds the next session, joined before start
+
+  /* Graph hot-swap, the pending graph is switched to at the next key frame */
+  gchar* pending_graph;
+  gboolean pending_key_unit;
+  gboolean pending_discont; // the next output is the first of a new graph
+
   /* Element specific options */
   guint64 global_idr_period;
   guint64 gpac_idr_period;
+  gboolean iframe_playlist;
+
+  /* Statistics */
+  GPAC_Stats stats;
+  guint64 stats_interval;
+  gboolean tracing;
+
+  /* Quality of service */
+  gboolean qos;
+  gboolean qos_drop;
+  gdouble qos_proportion;     // smoothed processing time over media time
+  GstClockTime qos_last_time; // newest input running time at the last check
 
   /* General Pad Information */
   guint32 video_pad_count;
@@ -68,8 +95,26 @@ struct _GstGpacTransform
   /* Input Queue */
   GQueue* queue;
 
+  /* Backpressure, signalled when the session releases input */
+  GCond level_cond;
+  gboolean level_flushing;
+
   /* Sacrificial Buffer (for syncing) */
   GstBuffer* sync_buffer;
+
+  /* Native sink, when the element is the sink of a gpac sink bin */
+  gboolean is_sink;
+  gboolean sink_prerolled;
+  gboolean sink_async;
+  gboolean sink_playing;
+  gboolean sink_flushing;
+  GMutex sink_preroll_lock; // orders the preroll with the async state change
+  GCond sink_cond;
+  GstClockID sink_clock_id;
+  GstClockTime sink_latency;
+  GstClockTime sink_running_time;
+  GstClockTime sink_position;
+  guint32 eos_seqnum;
 };
 
 /**
@@ -0,0 +1,74 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+
+/*
+  Memory allocator proposed to upstream elements through the ALLOCATION
+  query. Each memory block reserves room right before its data for the
+  buffer that owns it, so that a GPAC packet can share the data and find the
+  buffer to release from the data pointer alone, without a packet property
+  or a buffer map.
+
+  Released blocks are kept in a small cache, so that steady streams do not
+  allocate on the hot path. The cache is bounded in bytes, forgets the
+  blocks that stay unused for a while, and is emptied when the last element
+  using the allocator stops.
+*/
+
+/*! gets the allocator
+    \return a new reference to the allocator
+*/
+GstAllocator*
+gpac_allocator_get(void);
+
+/*! marks an element as using the allocator, so released blocks are cached
+*/
+void
+gpac_allocator_acquire(void);
+
+/*! marks an element as no longer using the allocator, the cached blocks are
+    freed once no element uses it
+*/
+void
+gpac_allocator_release(void);
+
+/*! attaches a buffer to its memory, so that a packet can share it
+    \param[in] buffer the buffer to attach
+    \param[out] data the data to share
+    \param[out] size the size of the data
+    \return TRUE if the buffer is a single, unshared memory of this allocator,
+    in which case a reference on the buffer is held until gpac_memory_release
+*/
+gboolean
+gpac_memory_attach(GstBuffer* buffer, const guint8** data, gsize* size);
+
+/*! releases the buffer attached to the memory
+    \param[in] data the data returned by gpac_memory_attach
+*/
+void
+gpac_memory_release(const guint8* data);
@@ -0,0 +1,75 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#pragma once
+
+#include <gpac/filters.h>
+#include <gst/gst.h>
+
+/*
+ * Snapshot of the GPAC filter registers.
+ *
+ * Introspecting the filter registers requires a filter session, which is
+ * expensive to create. The snapshot is taken once per process and reused by
+ * every element class. It can optionally be persisted on disk by setting the
+ * GST_GPAC_REGISTRY_CACHE environment variable to a directory.
+ */
+
+typedef struct
+{
+  gchar* name;
+  gchar* description;
+  GF_PropType type;
+  gchar* default_value;
+  gchar* min_max_enum;
+  guint32 flags;
+} GPAC_FilterArg;
+
+typedef struct
+{
+  gchar* name;
+  // Arguments, in the order declared by the filter register
+  GPAC_FilterArg* args;
+  guint num_args;
+} GPAC_FilterInfo;
+
+/*! builds the filter register snapshot, if not already built
+    \return TRUE if the snapshot is available, FALSE otherwise
+*/
+gboolean
+gpac_filter_registry_init(void);
+
+/*! looks up a filter in the register snapshot
+    \param[in] filter_name the name of the filter to look up
+    \return the filter information, or NULL if the filter is unknown
+*/
+const GPAC_FilterInfo*
+gpac_filter_registry_lookup(const gchar* filter_name);
+
+/*! gets the list separator used by the filter arguments
+    \return the list separator
+*/
+gchar
+gpac_filter_registry_get_list_sep(void);
@@ -0,0 +1,64 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#pragma once
+
+#include <gpac/filters.h>
+#include <gst/gst.h>
+
+#include "lib/pid.h"
+
+/*
+  When the "framed-input" property is set, streams that GStreamer already
+  aligned to access units are handed to GPAC as framed packets, so that GPAC
+  does not insert its NAL reframer.
+
+  Annex B H.264/H.265 access units still need their start codes replaced by
+  length prefixes. Their parameter sets are moved out of the samples and into
+  the decoder configuration of the PID, which is rebuilt whenever they change.
+  AV1 streams always go through the GPAC reframer.
+*/
+
+/*! checks whether a stream can bypass the GPAC reframers
+    \param[in] info the parsed caps of the pad
+    \return TRUE if the access units in the stream are already aligned
+*/
+gboolean
+gpac_framing_is_aligned(const GpacCapsInfo* info);
+
+/*! creates a framed packet from an Annex B access unit
+    \param[in] priv the private data of the pad
+    \param[in] pid the pid to create the packet for
+    \param[in] data the access unit
+    \param[in] size the size of the access unit
+    \return the new packet, or NULL on failure
+    \note the decoder configuration of the pid is updated from the parameter
+    sets found in the access unit
+*/
+GF_FilterPacket*
+gpac_framing_new_packet(GpacPadPrivate* priv,
+                        GF_FilterPid* pid,
+                        const guint8* data,
+                        gsize size);
@@ -34,6 +34,26 @@ typedef struct
   GPAC_SessionContext sess;
 } GPAC_Context;
 
+/*! acquires a reference on the process-wide gpac runtime, initializing it on
+    first use
+    \return TRUE if the runtime is available, FALSE otherwise
+*/
+gboolean
+gpac_runtime_acquire(void);
+
+/*! releases a reference on the process-wide gpac runtime, tearing it down
+    when the last reference is dropped
+*/
+void
+gpac_runtime_release(void);
+
+/*! routes the gpac logs emitted from the calling thread to an element
+    \param[in] element the element to attribute the logs to, can be NULL
+    \return the previous log target of the calling thread
+*/
+GstElement*
+gpac_log_set_target(GstElement* element);
+
 /*! initializes a gpac context
     \param[in] ctx the gpac context to initialize
     \param[in] element the GstElement that will use this context
@@ -42,11 +42,26 @@ typedef struct
   GPAC_MemIoDirection dir;
   GPAC_SessionContext* sess;
 
+  /*< memin-specific >*/
+  gsize in_flight_bytes; // atomic, bytes of input packets not released yet
+  gint64 popped_at;      // when the oldest queued input left its pad
+
   /*< memout-specific >*/
   guint64 global_offset;
   gboolean is_continuous;
+  GHashTable* iframe_playlists; // dasher I-frame playlist uri -> bandwidth
 } GPAC_MemIoContext;
 
+typedef struct
+{
+  // Bytes held by gpac and the post-processors
+  guint64 bytes;
+  // Longest duration buffered on any filter input
+  GstClockTime time;
+  // Packets sent by the memory input but not taken by the next filter
+  guint32 pending_packets;
+} GPAC_MemIoLevel;
+
 typedef enum
 {
   GPAC_FILTER_PP_RET_INVALID = 0,
@@ -146,3 +161,34 @@ gpac_memio_consume(GPAC_SessionContext* sess, void** outptr);
 void
 gpac_memio_set_global_offset(GPAC_SessionContext* sess,
                              const GstSegment* segment);
+
+/*! accounts for a packet created for the memory input filter
+    \param[in] sess the session context
+    \param[in] packet the packet that will be sent through the memory input
+    \note the packet must release its bytes with gpac_memio_untrack_packet
+    from its destructor
+*/
+void
+gpac_memio_track_packet(GPAC_SessionContext* sess, GF_FilterPacket* packet);
+
+/*! releases the bytes of a packet accounted with gpac_memio_track_packet
+    \param[in] filter the memory input filter the packet was created on
+    \param[in] packet the packet being destroyed
+*/
+void
+gpac_memio_untrack_packet(GF_Filter* filter, GF_FilterPacket* packet);
+
+/*! records when the input just queued for the memory input was popped
+    \param[in] sess the session context
+    \param[in] popped_at the monotonic time the first buffer was popped
+    \note the input latency is recorded once the memory input sends it
+*/
+void
+gpac_memio_mark_queued(GPAC_SessionContext* sess, gint64 popped_at);
+
+/*! gets the amount of data buffered between the memory input and output
+    \param[in] sess the session context
+    \param[out] level the current level
+*/
+void
+gpac_memio_get_level(GPAC_SessionContext* sess, GPAC_MemIoLevel* level);
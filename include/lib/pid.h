@@ -29,6 +29,7 @@
 #include <gst/gst.h>
 
 #include "lib/session.h"
+#include "lib/stats.h"
 #include "lib/time.h"
 
 /**
@@ -41,6 +42,44 @@ typedef enum
   GPAC_PAD_SEGMENT_SET = 1 << 2
 } GpacPadFlags;
 
+/**
+ * GpacMediaKind: Media kind of the pad, derived from the caps media type.
+ */
+typedef enum
+{
+  GPAC_MEDIA_KIND_UNKNOWN = 0,
+  GPAC_MEDIA_KIND_VIDEO,
+  GPAC_MEDIA_KIND_AUDIO,
+  GPAC_MEDIA_KIND_TEXT,
+} GpacMediaKind;
+
+/**
+ * GpacCapsInfo: Caps of the pad, parsed once per caps event.
+ */
+typedef struct
+{
+  GstStructure* structure; // Copy of the pad caps structure
+  gchar* media;            // e.g. "video"
+  gchar* codec;            // e.g. "x-h264"
+  GpacMediaKind kind;
+
+  const gchar* stream_format;
+  const gchar* alignment;
+  gboolean framed;
+
+  // Video
+  gint width;
+  gint height;
+  gint fps_num;
+  gint fps_den;
+
+  // Audio
+  gint rate;
+  gint channels;
+
+  GstBuffer* codec_data; // Reference taken from the pad caps
+} GpacCapsInfo;
+
 /**
  * GpacPadPrivate: Holds the latest information about the pad.
  */
@@ -55,6 +94,9 @@ typedef struct
   GstTagList* tags;
   GstSegment* segment;
 
+  // Parsed caps, valid while the caps are set
+  GpacCapsInfo caps_info;
+
   // Flags that indicate which properties are set
   GpacPadFlags flags;
 
@@ -62,6 +104,14 @@ typedef struct
   gint64 dts_offset;
   gboolean dts_offset_set;
   gboolean last_frame_was_keyframe;
+  gboolean wait_key_frame; // drop delta units until a key frame, on flush
+  gboolean key_units_only; // drop delta units, in key unit trick modes
+
+  // Quality of service
+  GstClockTime qos_running_time; // newest input given to gpac
+  GstClockTimeDiff qos_jitter;   // lateness at the last check, late if > 0
+  gboolean qos_late;
+  guint64 qos_dropped;
 
   // State for the encoder
   guint64 idr_period;
@@ -71,6 +121,13 @@ typedef struct
   // Capabilities required for the PID
   GList* gpac_caps;
   gboolean caps_changed;
+
+  // Framed input fast path, see lib/framing.h
+  gboolean framed_input;
+  gboolean annexb_to_length;
+
+  // Statistics
+  GPAC_PadStats stats;
 } GpacPadPrivate;
 
 #define GPAC_PID_PROP_IMPL_ARGS_NO_ELEMENT \
@@ -78,6 +135,29 @@ typedef struct
 #define GPAC_PID_PROP_IMPL_ARGS                           \
   GstElement *element, GPAC_PID_PROP_IMPL_ARGS_NO_ELEMENT
 
+/*! parses the pad caps into the typed caps descriptor
+    \param[in] priv the private data of the pad
+*/
+void
+gpac_pid_parse_caps(GpacPadPrivate* priv);
+
+/*! clears the typed caps descriptor of a pad
+    \param[in] priv the private data of the pad
+*/
+void
+gpac_pid_clear_caps(GpacPadPrivate* priv);
+
+/*! sets a property on a pid, unless it already holds an equal value
+    \param[in] pid the pid to set the property on
+    \param[in] prop_4cc the property to set
+    \param[in] value the new value of the property
+    \return GF_OK on success, error code otherwise
+*/
+GF_Err
+gpac_pid_set_property(GF_FilterPid* pid,
+                      u32 prop_4cc,
+                      const GF_PropertyValue* value);
+
 /*! reconfigures a pid based on the given element and pad private data
     \param[in] element the element that the pad belongs to
     \param[in] priv the private data of the pad
@@ -34,11 +34,22 @@ typedef struct
   gboolean print_stats;
   gboolean sync;
   gchar* destination;
+  gboolean reuse_session;
+  gboolean framed_input;
+  guint64 max_size_bytes;
+  guint64 max_size_time;
+  gchar* trace_file;
+  gchar* shm_socket;
+  guint64 shm_size;
+  gchar* shared_session;
+  guint64 signal_queue_size;
   GList* properties;
   GList* blacklist;
 
   /*< private >*/
   gchar** props_as_argv;
+  guint64 level_bytes;
+  guint64 level_time;
 } GPAC_PropertyContext;
 
 // Property Registry
@@ -51,10 +62,26 @@ typedef enum
   GPAC_PROP_PRINT_STATS,
   GPAC_PROP_SYNC,
   GPAC_PROP_DESTINATION,
+  GPAC_PROP_REUSE_SESSION,
+  GPAC_PROP_FRAMED_INPUT,
+  GPAC_PROP_MAX_SIZE_BYTES,
+  GPAC_PROP_MAX_SIZE_TIME,
+  GPAC_PROP_CURRENT_LEVEL_BYTES,
+  GPAC_PROP_CURRENT_LEVEL_TIME,
+  GPAC_PROP_TRACE_FILE,
+  GPAC_PROP_SHM_SOCKET,
+  GPAC_PROP_SHM_SIZE,
+  GPAC_PROP_SHARED_SESSION,
+  GPAC_PROP_SIGNAL_QUEUE_SIZE,
 
   // Element-specific properties
   GPAC_PROP_ELEMENT_OFFSET,
   GPAC_PROP_SEGDUR,
+  GPAC_PROP_STATS,
+  GPAC_PROP_STATS_INTERVAL,
+  GPAC_PROP_IFRAME_PLAYLIST,
+  GPAC_PROP_QOS,
+  GPAC_PROP_QOS_DROP,
 
   // Offset for the filter and global properties
   GPAC_PROP_FILTER_OFFSET,
@@ -97,6 +124,19 @@ gpac_install_filter_properties(GObjectClass* gobject_class,
 void
 gpac_install_global_properties(GObjectClass* gobject_class);
 
+/*! converts a filter property to a filter option
+    \param[in] pspec the property specification
+    \param[in] value the value of the property
+    \param[out] name the name of the filter option, to free
+    \param[out] value_str the value of the filter option, to free
+    \return TRUE if the property has a value, FALSE otherwise
+*/
+gboolean
+gpac_property_to_option(GParamSpec* pspec,
+                        const GValue* value,
+                        gchar** name,
+                        gchar** value_str);
+
 /*! sets a property of a GObject based on the property id
     \param[in] object the GObject to set the property of
     \param[in] property_id the id of the property to set
@@ -123,6 +163,14 @@ gpac_get_property(GPAC_PropertyContext* ctx,
                   GValue* value,
                   GParamSpec* pspec);
 
+/*! looks up a filter option set through the element properties
+    \param[in] ctx the property context to look up
+    \param[in] name the name of the filter option
+    \return the last value set for the option, NULL if it is not set
+*/
+const gchar*
+gpac_property_get_option(GPAC_PropertyContext* ctx, const gchar* name);
+
 /*! applies the properties to the gpac context
     \param[in] ctx the gpac context to apply the properties to
     \return TRUE if the properties were applied successfully, FALSE otherwise
@@ -29,6 +29,11 @@
 #include <gst/gst.h>
 
 #include "elements/common.h"
+#include "lib/shm.h"
+#include "lib/signals.h"
+#include "lib/stats.h"
+
+typedef struct _GPAC_SharedSession GPAC_SharedSession;
 
 typedef struct
 {
@@ -39,14 +44,36 @@ typedef struct
 
   // overrides
   const gchar* destination;
+  const gchar* shared_name; // attach to this named shared session
+  const gchar* state_file;  // dasher live state, published when it changes
+  gboolean iframe_playlist; // the dasher also writes HLS I-frame playlists
 
   /*< internal >*/
   gboolean had_data_flow;
+  gboolean run_exhausted; // the last run stopped with tasks left
   GstGpacParams* params;
+  GPAC_Stats* stats;
+  GCond* released;        // signalled under the element lock on input free
+  guint64 released_count; // input packets freed, under the element lock
+  GArray* trace_tasks;         // tasks done per filter, only used when tracing
+  GPtrArray* filters;          // loaded filter names, under the element lock
+  GPAC_ShmRing* shm;           // shared memory output, if enabled
+  GPAC_SignalEmitter* signals; // signals resolved once for the session
+  gchar* state_checksum;       // checksum of the last published state
+  gint64 state_mtime;          // modification time of the hashed state, in us
+  goffset state_size;          // size of the hashed state
+  GList* updates; // option updates waiting for the session thread
+  GList* applied; // option updates sent, notified at the next boundary
+
+  /*< shared session >*/
+  GPAC_SharedSession* shared;
+  GF_Filter* last_filter; // end of the chain loaded by this element
+  gboolean reuses_output; // the chain ends in a filter of another element
 } GPAC_SessionContext;
 
 /*! initializes a gpac filter session
-    \param[in] ctx the session context to initialize
+    \param[in] ctx the session context to initialize, attached to the named
+                   shared session instead if ctx->shared_name is set
     \param[in] element the element to initialize the session with
     \param[in] params single element parameters, can be NULL if the element
                       is not a single filter element
@@ -58,7 +85,8 @@ gpac_session_init(GPAC_SessionContext* ctx,
                   GstGpacParams* params);
 
 /*! closes a gpac filter session
-    \param[in] ctx the session context to close
+    \param[in] ctx the session context to close, a shared session is only
+                   closed when its last element leaves
     \param[in] print_stats whether to print the session stats
     \return TRUE if the session was closed successfully, FALSE otherwise
 */
@@ -71,6 +99,19 @@ gpac_session_close(GPAC_SessionContext* ctx, gboolean print_stats);
 void
 gpac_session_abort(GPAC_SessionContext* ctx);
 
+/*! locks a shared session against the other elements attached to it
+    \param[in] ctx the session context to lock
+    \note no-op for a session that is not shared, the lock is recursive
+*/
+void
+gpac_session_lock(GPAC_SessionContext* ctx);
+
+/*! unlocks a session locked with gpac_session_lock
+    \param[in] ctx the session context to unlock
+*/
+void
+gpac_session_unlock(GPAC_SessionContext* ctx);
+
 /*! runs a gpac filter session
     \param[in] ctx the session context to run
     \param[in] flush whether to flush the session
@@ -79,6 +120,36 @@ gpac_session_abort(GPAC_SessionContext* ctx);
 GF_Err
 gpac_session_run(GPAC_SessionContext* ctx, gboolean flush);
 
+/*! queues a runtime update of a filter option
+    \param[in] ctx the session context to update
+    \param[in] filter_name the name of the filter to update
+    \param[in] name the name of the option
+    \param[in] value the new value of the option
+    \note thread-safe. The update is sent to the filter on the next session
+   run, and an element message is posted once the output reaches the next
+   fragment or segment boundary
+*/
+void
+gpac_session_queue_update(GPAC_SessionContext* ctx,
+                          const gchar* filter_name,
+                          const gchar* name,
+                          const gchar* value);
+
+/*! sends the queued option updates to the filters
+    \param[in] ctx the session context to update
+    \note must be called from the thread running the session
+*/
+void
+gpac_session_send_updates(GPAC_SessionContext* ctx);
+
+/*! notifies the sent option updates if a packet starts a new fragment or
+    segment
+    \param[in] ctx the session context
+    \param[in] pck the output packet
+*/
+void
+gpac_session_check_updates(GPAC_SessionContext* ctx, GF_FilterPacket* pck);
+
 /*! opens a gpac filter session
     \param[in] ctx the session context to open
     \param[in] graph the graph to open
@@ -101,3 +172,31 @@ gpac_session_load_filter(GPAC_SessionContext* ctx, const gchar* filter_name);
 */
 gboolean
 gpac_session_has_output(GPAC_SessionContext* ctx);
+
+/*! builds the key identifying interchangeable prepared sessions
+    \param[in] ctx the session context the session is prepared for
+    \param[in] graph the graph the session is opened with
+    \param[in] args the gpac arguments the session is created with
+    \return the pool key, to be freed with g_free
+*/
+gchar*
+gpac_session_pool_key(GPAC_SessionContext* ctx,
+                      const gchar* graph,
+                      gchar** args);
+
+/*! adopts a prepared session from the process-wide pool
+    \param[in] ctx the session context to adopt the session into
+    \param[in] key the pool key of the session
+    \return TRUE if a prepared session was adopted, FALSE otherwise
+*/
+gboolean
+gpac_session_pool_take(GPAC_SessionContext* ctx, const gchar* key);
+
+/*! parks an opened session, that never had data flow, in the process-wide pool
+    \param[in] ctx the session context to take the session from
+    \param[in] key the pool key of the session
+    \note the oldest prepared session is closed if the pool is full, and the
+    session itself is closed if it cannot be parked
+*/
+void
+gpac_session_pool_put(GPAC_SessionContext* ctx, const gchar* key);
@@ -0,0 +1,130 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+
+/*
+  Shared memory output transport.
+
+  Output data is written once into a ring backed by a memfd owned by the
+  element. Consumers connect to a SOCK_SEQPACKET Unix socket and first
+  receive a GPAC_SHM_MSG_HELLO descriptor with the memfd attached, which they
+  map read-only. Every write is then announced with a GPAC_SHM_MSG_DATA
+  descriptor. On connect, the last descriptors whose data is still in the
+  ring are replayed, so that late consumers can start from the stream header.
+
+  The ring does not wait for consumers. A descriptor is valid as long as
+  write_position - position <= data_size, read from the ring header at the
+  start of the mapping, after the data has been used.
+*/
+
+#define GPAC_SHM_MAGIC 0x47534d31 // "GSM1"
+#define GPAC_SHM_HEADER_SIZE 4096 // The data starts after the header page
+#define GPAC_SHM_NAME_SIZE 256
+#define GPAC_SHM_DEFAULT_SIZE (64 * 1024 * 1024)
+
+typedef enum
+{
+  GPAC_SHM_MSG_HELLO = 1,
+  GPAC_SHM_MSG_DATA,
+} GPAC_ShmMessageType;
+
+typedef enum
+{
+  GPAC_SHM_FLAG_HEADER = 1 << 0,      // Stream header, i.e. an init segment
+  GPAC_SHM_FLAG_DELTA_UNIT = 1 << 1,  // Does not start with a random access
+  GPAC_SHM_FLAG_FILE_START = 1 << 2,  // First write of the named file
+  GPAC_SHM_FLAG_FILE_END = 1 << 3,    // The named file is complete
+  GPAC_SHM_FLAG_MANIFEST = 1 << 4,    // The named file is a manifest
+} GPAC_ShmFlags;
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint64 data_size;      // Size of the data area after the header
+  guint64 write_position; // End of the latest write, set before the data
+} GPAC_ShmRingHeader;
+
+typedef struct
+{
+  guint32 magic;
+  guint32 type; // GPAC_ShmMessageType
+
+  // For HELLO, the number of replayed descriptors that follow
+  guint64 sequence;
+  guint64 position; // Position of the data in the stream of written bytes
+  guint64 offset;   // Offset of the data in the memfd
+  guint64 size;     // For HELLO, the size of the memfd
+
+  // In nanoseconds, GST_CLOCK_TIME_NONE if unknown
+  guint64 pts;
+  guint64 dts;
+  guint64 duration;
+
+  guint32 flags; // GPAC_ShmFlags
+  guint32 reserved;
+  gchar name[GPAC_SHM_NAME_SIZE]; // Name of the file, empty for buffers
+} GPAC_ShmDescriptor;
+
+typedef struct _GPAC_ShmRing GPAC_ShmRing;
+
+/*! creates a shared memory ring and starts listening for consumers
+    \param[in] element the element owning the ring, used for logging
+    \param[in] socket_path the path of the Unix socket to listen on
+    \param[in] size the size of the data area
+    \return the ring, or NULL on failure
+*/
+GPAC_ShmRing*
+gpac_shm_ring_new(GstElement* element, const gchar* socket_path, gsize size);
+
+/*! stops listening, disconnects the consumers and frees the ring
+    \param[in] ring the ring to free
+*/
+void
+gpac_shm_ring_free(GPAC_ShmRing* ring);
+
+/*! writes data into the ring and announces it to the consumers
+    \param[in] ring the ring to write to
+    \param[in] data the data to write, can be NULL if size is 0
+    \param[in] size the size of the data
+    \param[in] desc the descriptor template, with timestamps, flags and name
+    \return TRUE on success, FALSE if the data does not fit in the ring
+*/
+gboolean
+gpac_shm_ring_write(GPAC_ShmRing* ring,
+                    const guint8* data,
+                    gsize size,
+                    const GPAC_ShmDescriptor* desc);
+
+/*! writes a buffer into the ring, with its timestamps and flags
+    \param[in] ring the ring to write to
+    \param[in] buffer the buffer to write
+    \return TRUE on success, FALSE otherwise
+*/
+gboolean
+gpac_shm_ring_write_buffer(GPAC_ShmRing* ring, GstBuffer* buffer);
@@ -43,17 +43,28 @@ typedef enum
   GPAC_SIGNAL_DASHER_SEGMENT,
   GPAC_SIGNAL_DASHER_DELETE_SEGMENT,
 
+  // Dasher notifications, emitted from the dispatcher thread
+  GPAC_SIGNAL_DASHER_SEGMENT_READY,
+  GPAC_SIGNAL_DASHER_PART_READY,
+  GPAC_SIGNAL_DASHER_MANIFEST_UPDATED,
+
+  // Dasher live state
+  GPAC_SIGNAL_DASHER_LOAD_STATE,
+  GPAC_SIGNAL_DASHER_STATE_UPDATED,
+
   // Accessors
   GPAC_SIGNAL_START = GPAC_SIGNAL_DASHER_MANIFEST,
-  GPAC_SIGNAL_END = GPAC_SIGNAL_DASHER_DELETE_SEGMENT,
+  GPAC_SIGNAL_END = GPAC_SIGNAL_DASHER_STATE_UPDATED,
   GPAC_SIGNAL_LAST = GPAC_SIGNAL_END + 1,
 } GPAC_SignalId;
 
 // Signal Names
 // Starts from GPAC_SIGNAL_START and ends at GPAC_SIGNAL_END
 static const gchar* gpac_signal_names[] = {
-  "get-manifest", "get-manifest-variant", "get-segment-init",
-  "get-segment",  "delete-segment",
+  "get-manifest",  "get-manifest-variant", "get-segment-init",
+  "get-segment",   "delete-segment",       "segment-ready",
+  "part-ready",    "manifest-updated",     "load-state",
+  "state-updated",
 };
 
 /*! installs the signals to the GObject class
@@ -71,17 +82,78 @@ gpac_install_signals_by_presets(GObjectClass* gobject_class,
 void
 gpac_install_all_signals(GObjectClass* gobject_class);
 
-/*! tries to emit a signal
-    \param[in] element the GstElement to emit the signal on
+typedef struct _GPAC_SignalEmitter GPAC_SignalEmitter;
+
+/*! creates a signal emitter for a session
+    \param[in] element the GstElement running the session
+    \param[in] queue_size the number of output bytes that may wait for the
+   dispatcher thread, 0 to emit the output signals synchronously
+    \return the emitter, to free with gpac_signal_emitter_free
+    \note The object and signal ID of each signal are resolved once here,
+   instead of walking the parents on every emission. Notifications are always
+   emitted from the dispatcher thread.
+*/
+GPAC_SignalEmitter*
+gpac_signal_emitter_new(GstElement* element, guint64 queue_size);
+
+/*! frees a signal emitter, after the queued signals are dispatched
+    \param[in] emitter the emitter to free
+    \note When called from a signal handler, on the dispatcher thread, it
+   returns right away and the dispatcher frees the emitter once the queued
+   signals are dispatched.
+*/
+void
+gpac_signal_emitter_free(GPAC_SignalEmitter* emitter);
+
+/*! gets the output stream of a file from the application
+    \param[in] emitter the emitter to use
     \param[in] id the signal ID to emit
-    \param[in] location the location string to pass to the signal
-    \param[out] output_stream if not NULL, will be set to the output stream
-    \return TRUE if the signal was emitted successfully, FALSE otherwise
-    \note The output_stream is set only if the signal is registered and has an
-   output stream parameter.
+    \param[in] location the location of the file
+    \param[out] output_stream set to the output stream of the file
+    \return TRUE if output_stream was set, FALSE if the file must be written
+   by the caller
+    \note In asynchronous mode, the returned stream queues the writes for the
+   dispatcher thread, which emits the signal and falls back to a file at
+   location if no handler provides a stream.
 */
 gboolean
-gpac_signal_try_emit(GstElement* element,
-                     GPAC_SignalId id,
-                     const gchar* location,
-                     GOutputStream** output_stream);
+gpac_signal_emitter_get_output(GPAC_SignalEmitter* emitter,
+                               GPAC_SignalId id,
+                               const gchar* location,
+                               GOutputStream** output_stream);
+
+/*! loads data from the application
+    \param[in] emitter the emitter to use
+    \param[in] id the signal ID to emit
+    \param[in] location the location of the data
+    \return the data, NULL if no handler provided it
+    \note Always emitted synchronously, from the calling thread.
+*/
+GBytes*
+gpac_signal_emitter_load(GPAC_SignalEmitter* emitter,
+                         GPAC_SignalId id,
+                         const gchar* location);
+
+/*! asks the application to delete a file
+    \param[in] emitter the emitter to use
+    \param[in] location the location of the file
+    \return TRUE if the file was taken care of, FALSE if the caller must
+   delete it
+    \note In asynchronous mode, the deletion is queued after the pending
+   writes and the dispatcher thread deletes the file if no handler does.
+*/
+gboolean
+gpac_signal_emitter_delete(GPAC_SignalEmitter* emitter, const gchar* location);
+
+/*! emits a notification signal from the dispatcher thread
+    \param[in] emitter the emitter to use
+    \param[in] id the notification signal ID to emit
+    \param[in] info the details of the notification, ownership is taken
+    \note Notifications are emitted in order with the queued output, from a
+   thread that is never a GPAC or streaming thread, so handlers may block
+   briefly without stalling the session.
+*/
+void
+gpac_signal_emitter_notify(GPAC_SignalEmitter* emitter,
+                           GPAC_SignalId id,
+                           GstStructure* info);
@@ -0,0 +1,103 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+
+// Histogram buckets are powers of two of microseconds, up to ~8 seconds
+#define GPAC_STATS_BUCKETS 24
+
+typedef struct
+{
+  guint64 count;
+  guint64 sum; // in microseconds
+  guint64 max; // in microseconds
+  guint64 buckets[GPAC_STATS_BUCKETS];
+} GPAC_StatsHistogram;
+
+/*
+  Counters are only written from the streaming thread and read without
+  locking, so a snapshot may mix values from consecutive updates.
+*/
+typedef struct
+{
+  // Throughput
+  guint64 packets_in;
+  guint64 bytes_in;
+  guint64 packets_out;
+  guint64 bytes_out;
+
+  // Input queue depth, in packets
+  guint queue_depth;
+  guint queue_depth_max;
+
+  // Latency of each stage
+  GPAC_StatsHistogram input;        // pop from the pad to memin send
+  GPAC_StatsHistogram session_run;  // gpac_session_run
+  GPAC_StatsHistogram post_process; // memout post-processors
+  GPAC_StatsHistogram downstream;   // consume to finish_buffer returning
+
+  // The session was taken from the pool of prepared sessions
+  gboolean session_reused;
+
+  // Monotonic time of the last posted message
+  gint64 last_post;
+} GPAC_Stats;
+
+typedef struct
+{
+  guint64 packets_in;
+  guint64 bytes_in;
+  GPAC_StatsHistogram idr_lateness;
+} GPAC_PadStats;
+
+/*! records a sample in a histogram
+    \param[in] hist the histogram to update
+    \param[in] usec the sample, in microseconds
+*/
+void
+gpac_stats_histogram_add(GPAC_StatsHistogram* hist, gint64 usec);
+
+/*! converts a histogram to a structure
+    \param[in] hist the histogram to convert
+    \return a new structure with count, mean-us, max-us and buckets fields
+*/
+GstStructure*
+gpac_stats_histogram_to_structure(const GPAC_StatsHistogram* hist);
+
+/*! converts the element statistics to a structure
+    \param[in] stats the statistics to convert
+    \return a new "gpac-stats" structure
+*/
+GstStructure*
+gpac_stats_to_structure(const GPAC_Stats* stats);
+
+/*! converts the statistics of a pad to a structure
+    \param[in] stats the statistics to convert
+    \return a new "gpac-pad-stats" structure
+*/
+GstStructure*
+gpac_stats_pad_to_structure(const GPAC_PadStats* stats);
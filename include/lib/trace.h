@@ -0,0 +1,98 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+
+/*
+  Opt-in writer for the Trace Event JSON format, as loaded by chrome://tracing
+  and the Perfetto UI. Tracing is process-wide: it is enabled by the
+  "trace-file" property or the GST_GPAC_TRACE environment variable, and the
+  file is finalized when the last element using it stops.
+
+  Spans are recorded into per-thread buffers and written out in batches, so
+  that a disabled tracer costs a single atomic read and an enabled one two
+  clock reads per span.
+*/
+
+#define GPAC_TRACE_ENV "GST_GPAC_TRACE"
+
+/*! starts tracing to a file, or takes a reference on the running tracer
+    \param[in] path the file to write, NULL to use the environment variable
+    \return TRUE if tracing is enabled after the call
+*/
+gboolean
+gpac_trace_ref(const gchar* path);
+
+/*! releases a reference taken by gpac_trace_ref, and finalizes the file when
+    it was the last one
+*/
+void
+gpac_trace_unref(void);
+
+/*! checks whether tracing is enabled
+    \return TRUE if spans are being recorded
+*/
+gboolean
+gpac_trace_enabled(void);
+
+/*! starts a span
+    \return the start timestamp to pass to gpac_trace_end, 0 if disabled
+*/
+gint64
+gpac_trace_begin(void);
+
+/*! records a span that started at gpac_trace_begin
+    \param[in] start the value returned by gpac_trace_begin
+    \param[in] name the name of the span, must be a static string
+    \param[in] arg an optional annotation, such as a PID name
+*/
+void
+gpac_trace_end(gint64 start, const gchar* name, const gchar* arg);
+
+/*! records a span like gpac_trace_end, without copying the annotation
+    \param[in] start the value returned by gpac_trace_begin
+    \param[in] name the name of the span, must be a static string
+    \param[in] arg an optional annotation, must be static or interned
+*/
+void
+gpac_trace_end_static(gint64 start, const gchar* name, const gchar* arg);
+
+#define GPAC_TRACE_BEGIN(var) gint64 var = gpac_trace_begin()
+#define GPAC_TRACE_END(var, name, arg) \
+  G_STMT_START                         \
+  {                                    \
+    if (var)                           \
+      gpac_trace_end(var, name, arg);  \
+  }                                    \
+  G_STMT_END
+#define GPAC_TRACE_END_STATIC(var, name, arg) \
+  G_STMT_START                                \
+  {                                           \
+    if (var)                                  \
+      gpac_trace_end_static(var, name, arg);  \
+  }                                           \
+  G_STMT_END
@@ -42,16 +42,6 @@ gst_gpac_sink_set_property(GObject* object,
   GstGpacSink* gpac_sink = GST_GPAC_SINK(object);
   g_return_if_fail(GST_IS_GPAC_SINK(object));
 
-  if (IS_TOP_LEVEL_PROPERTY(prop_id)) {
-    switch (prop_id) {
-      case GPAC_PROP_SYNC:
-        g_object_set_property(G_OBJECT(gpac_sink->sink), pspec->name, value);
-        return;
-      default:
-        break;
-    }
-  }
-
   // Relay the property to the internal transform element
   g_object_set_property(G_OBJECT(gpac_sink->tf), pspec->name, value);
 }
@@ -65,16 +55,6 @@ gst_gpac_sink_get_property(GObject* object,
   GstGpacSink* gpac_sink = GST_GPAC_SINK(object);
   g_return_if_fail(GST_IS_GPAC_SINK(object));
 
-  if (IS_TOP_LEVEL_PROPERTY(prop_id)) {
-    switch (prop_id) {
-      case GPAC_PROP_SYNC:
-        g_object_get_property(G_OBJECT(gpac_sink->sink), pspec->name, value);
-        return;
-      default:
-        break;
-    }
-  }
-
   // Relay the property to the internal transform element
   g_object_get_property(G_OBJECT(gpac_sink->tf), pspec->name, value);
 }
@@ -88,11 +68,6 @@ gst_gpac_sink_reset(GstGpacSink* sink)
     gst_bin_remove(GST_BIN(sink), sink->tf);
     sink->tf = NULL;
   }
-
-  if (sink->sink) {
-    gst_bin_remove(GST_BIN(sink), sink->sink);
-    sink->sink = NULL;
-  }
 }
 
 // #MARK: Pad Management
@@ -163,15 +138,10 @@ gst_gpac_sink_instance_init(GstGpacSink* sink)
   // Treat the bin as a sink
   GST_OBJECT_FLAG_SET(sink, GST_ELEMENT_FLAG_SINK);
 
-  // Create the transform element for the subelement
+  // Create the transform element for the subelement, it acts as the sink
+  // itself and handles preroll, sync, latency and position natively
   sink->tf = g_object_new(params->private_type, NULL);
-
-  // Create a fake sink element
-  sink->sink = gst_element_factory_make("fakesink", NULL);
-
-  // Add and link the elements
-  gst_bin_add_many(GST_BIN(sink), sink->tf, sink->sink, NULL);
-  gst_element_link(sink->tf, sink->sink);
+  gst_bin_add(GST_BIN(sink), sink->tf);
 }
 
 static void
@@ -206,8 +176,25 @@ gst_gpac_sink_subclass_init(GstGpacSinkClass* klass)
 
   // Set the property handlers
   gpac_install_global_properties(gobject_class);
-  gpac_install_local_properties(
-    gobject_class, GPAC_PROP_PRINT_STATS, GPAC_PROP_SYNC, GPAC_PROP_0);
+  gpac_install_local_properties(gobject_class,
+                                GPAC_PROP_PRINT_STATS,
+                                GPAC_PROP_SYNC,
+                                GPAC_PROP_REUSE_SESSION,
+                                GPAC_PROP_FRAMED_INPUT,
+                                GPAC_PROP_MAX_SIZE_BYTES,
+                                GPAC_PROP_MAX_SIZE_TIME,
+                                GPAC_PROP_CURRENT_LEVEL_BYTES,
+                                GPAC_PROP_CURRENT_LEVEL_TIME,
+                                GPAC_PROP_TRACE_FILE,
+                                GPAC_PROP_SHM_SOCKET,
+                                GPAC_PROP_SHM_SIZE,
+                                GPAC_PROP_SHARED_SESSION,
+                                GPAC_PROP_SIGNAL_QUEUE_SIZE,
+                                GPAC_PROP_STATS,
+                                GPAC_PROP_STATS_INTERVAL,
+                                GPAC_PROP_QOS,
+                                GPAC_PROP_QOS_DROP,
+                                GPAC_PROP_0);
 
   // Add the subclass-specific properties and pad templates
   if (params->is_single) {
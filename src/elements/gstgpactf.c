@@ -29,6 +29,18 @@
 GST_DEBUG_CATEGORY_STATIC(gst_gpac_tf_debug);
 #define GST_CAT_DEFAULT gst_gpac_tf_debug
 
+// Lateness tolerated before telling upstream, as basesink's max-lateness
+#define GPAC_QOS_MAX_LATENESS (20 * GST_MSECOND)
+
+// Longest wait for released input while the filters after the memory input
+// are stalled, some of them free data without notifying
+#define GPAC_BACKPRESSURE_WAIT_US (100 * G_TIME_SPAN_MILLISECOND)
+
+static gboolean
+gst_gpac_tf_open_session(GstGpacTransform* gpac_tf,
+                         GPAC_SessionContext* sess,
+                         gchar* graph);
+
 // #MARK: Pad Class
 G_DEFINE_TYPE(GstGpacTransformPad, gst_gpac_tf_pad, GST_TYPE_AGGREGATOR_PAD);
 
@@ -88,6 +100,7 @@ gst_gpac_tf_pad_init(GstGpacTransformPad* pad)
   priv->idr_period = GST_CLOCK_TIME_NONE;
   priv->idr_last = GST_CLOCK_TIME_NONE;
   priv->idr_next = GST_CLOCK_TIME_NONE;
+  priv->qos_running_time = GST_CLOCK_TIME_NONE;
   gst_pad_set_element_private(GST_PAD(pad), priv);
 
   pad->pid = NULL;
@@ -100,6 +113,7 @@ gst_gpac_tf_pad_finalize(GObject* object)
   GpacPadPrivate* priv = gst_pad_get_element_private(GST_PAD(pad));
 
   if (priv) {
+    gpac_pid_clear_caps(priv);
     if (priv->caps)
       gst_caps_unref(priv->caps);
     if (priv->segment)
@@ -138,6 +152,106 @@ gst_gpac_tf_pad_class_init(GstGpacTransformPadClass* klass)
 G_DEFINE_TYPE(GstGpacTransform, gst_gpac_tf, GST_TYPE_AGGREGATOR);
 
 // #MARK: Properties
+static GstStructure*
+gst_gpac_tf_get_stats(GstGpacTransform* gpac_tf)
+{
+  GstStructure* stats = gpac_stats_to_structure(&gpac_tf->stats);
+  GPAC_PropertyContext* prop_ctx = GPAC_PROP_CTX(GPAC_CTX);
+
+  GST_OBJECT_LOCK(gpac_tf);
+
+  // Internal queue levels
+  gst_structure_set(stats,
+                    "level-bytes",
+                    G_TYPE_UINT64,
+                    prop_ctx->level_bytes,
+                    "level-time",
+                    G_TYPE_UINT64,
+                    prop_ctx->level_time,
+                    NULL);
+
+  // Filters loaded in the session, by registry name
+  GPtrArray* filters = GPAC_SESS_CTX(GPAC_CTX)->filters;
+  GValue list = G_VALUE_INIT;
+  gst_value_array_init(&list, filters ? filters->len : 0);
+  for (guint i = 0; filters && i < filters->len; i++) {
+    GValue name = G_VALUE_INIT;
+    g_value_init(&name, G_TYPE_STRING);
+    g_value_set_static_string(&name, g_ptr_array_index(filters, i));
+    gst_value_array_append_and_take_value(&list, &name);
+  }
+  gst_structure_take_value(stats, "filters", &list);
+
+  // One field per sink pad
+  for (GList* l = GST_ELEMENT(gpac_tf)->sinkpads; l; l = l->next) {
+    GstPad* pad = GST_PAD(l->data);
+    GpacPadPrivate* priv = gst_pad_get_element_private(pad);
+    GstStructure* pad_stats = gpac_stats_pad_to_structure(&priv->stats);
+    gst_structure_set(
+      stats, GST_PAD_NAME(pad), GST_TYPE_STRUCTURE, pad_stats, NULL);
+    gst_structure_free(pad_stats);
+  }
+
+  GST_OBJECT_UNLOCK(gpac_tf);
+  return stats;
+}
+
+static void
+gst_gpac_tf_update_option(GstGpacTransform* gpac_tf,
+                          const GValue* value,
+                          GParamSpec* pspec)
+{
+  GObjectClass* klass = G_OBJECT_GET_CLASS(gpac_tf);
+  GstGpacParams* params = GST_GPAC_GET_PARAMS(klass);
+  if (!params || !params->info)
+    return;
+
+  GST_OBJECT_LOCK(gpac_tf);
+  gboolean running = gpac_tf->session_running;
+  GST_OBJECT_UNLOCK(gpac_tf);
+  if (!running)
+    return; // Used as is when the session starts
+
+  gchar *name, *value_str;
+  if (!gpac_property_to_option(pspec, value, &name, &value_str))
+    return;
+
+  gpac_session_queue_update(
+    GPAC_SESS_CTX(GPAC_CTX), params->info->filter_name, name, value_str);
+  g_free(name);
+  g_free(value_str);
+}
+
+static void
+gst_gpac_tf_queue_graph(GstGpacTransform* gpac_tf, const GValue* value)
+{
+  const gchar* graph = g_value_get_string(value);
+  if (!graph)
+    return;
+
+  GST_OBJECT_LOCK(gpac_tf);
+  if (!gpac_tf->session_running) {
+    GST_OBJECT_UNLOCK(gpac_tf);
+    return; // Used as is when the session starts
+  }
+
+  // Other elements depend on the graph of a shared session
+  if (GPAC_SESS_CTX(GPAC_CTX)->shared) {
+    GST_OBJECT_UNLOCK(gpac_tf);
+    GST_WARNING_OBJECT(gpac_tf,
+                       "Cannot replace the graph of a shared session, the "
+                       "new graph is used on the next start");
+    return;
+  }
+
+  g_free(gpac_tf->pending_graph);
+  gpac_tf->pending_graph = g_strdup(graph);
+  gpac_tf->pending_key_unit = TRUE;
+  GST_OBJECT_UNLOCK(gpac_tf);
+  GST_INFO_OBJECT(
+    gpac_tf, "Switching to graph %s at the next key frame", graph);
+}
+
 static void
 gst_gpac_tf_set_property(GObject* object,
                          guint prop_id,
@@ -146,8 +260,15 @@ gst_gpac_tf_set_property(GObject* object,
 {
   GstGpacTransform* gpac_tf = GST_GPAC_TF(object);
   g_return_if_fail(GST_IS_GPAC_TF(object));
-  if (gpac_set_property(GPAC_PROP_CTX(GPAC_CTX), prop_id, value, pspec))
+  if (gpac_set_property(GPAC_PROP_CTX(GPAC_CTX), prop_id, value, pspec)) {
+    // Options mutable while playing also reach the running filter
+    if (IS_FILTER_PROPERTY(prop_id) &&
+        (pspec->flags & GST_PARAM_MUTABLE_PLAYING))
+      gst_gpac_tf_update_option(gpac_tf, value, pspec);
+    else if (prop_id == GPAC_PROP_GRAPH)
+      gst_gpac_tf_queue_graph(gpac_tf, value);
     return;
+  }
 
   // Handle the element properties
   if (IS_ELEMENT_PROPERTY(prop_id)) {
@@ -160,6 +281,22 @@ gst_gpac_tf_set_property(GObject* object,
                          GST_TIME_ARGS(gpac_tf->global_idr_period));
         break;
 
+      case GPAC_PROP_STATS_INTERVAL:
+        gpac_tf->stats_interval = g_value_get_uint64(value);
+        break;
+
+      case GPAC_PROP_IFRAME_PLAYLIST:
+        gpac_tf->iframe_playlist = g_value_get_boolean(value);
+        break;
+
+      case GPAC_PROP_QOS:
+        gpac_tf->qos = g_value_get_boolean(value);
+        break;
+
+      case GPAC_PROP_QOS_DROP:
+        gpac_tf->qos_drop = g_value_get_boolean(value);
+        break;
+
       default:
         break;
     }
@@ -177,6 +314,16 @@ gst_gpac_tf_get_property(GObject* object,
 {
   GstGpacTransform* gpac_tf = GST_GPAC_TF(object);
   g_return_if_fail(GST_IS_GPAC_TF(object));
+
+  // The levels are written by the streaming thread
+  if (prop_id == GPAC_PROP_CURRENT_LEVEL_BYTES ||
+      prop_id == GPAC_PROP_CURRENT_LEVEL_TIME) {
+    GST_OBJECT_LOCK(gpac_tf);
+    gpac_get_property(GPAC_PROP_CTX(GPAC_CTX), prop_id, value, pspec);
+    GST_OBJECT_UNLOCK(gpac_tf);
+    return;
+  }
+
   if (gpac_get_property(GPAC_PROP_CTX(GPAC_CTX), prop_id, value, pspec))
     return;
 
@@ -188,6 +335,26 @@ gst_gpac_tf_get_property(GObject* object,
                           ((float)gpac_tf->global_idr_period) / GST_SECOND);
         break;
 
+      case GPAC_PROP_STATS:
+        g_value_take_boxed(value, gst_gpac_tf_get_stats(gpac_tf));
+        break;
+
+      case GPAC_PROP_STATS_INTERVAL:
+        g_value_set_uint64(value, gpac_tf->stats_interval);
+        break;
+
+      case GPAC_PROP_IFRAME_PLAYLIST:
+        g_value_set_boolean(value, gpac_tf->iframe_playlist);
+        break;
+
+      case GPAC_PROP_QOS:
+        g_value_set_boolean(value, gpac_tf->qos);
+        break;
+
+      case GPAC_PROP_QOS_DROP:
+        g_value_set_boolean(value, gpac_tf->qos_drop);
+        break;
+
       default:
         break;
     }
@@ -198,6 +365,41 @@ gst_gpac_tf_get_property(GObject* object,
 }
 
 // #MARK: Helper Functions
+static void
+gpac_restore_state(GstElement* element)
+{
+  GstGpacTransform* gpac_tf = GST_GPAC_TF(element);
+  const gchar* state_file =
+    gpac_property_get_option(GPAC_PROP_CTX(GPAC_CTX), "state");
+  GPAC_SESS_CTX(GPAC_CTX)->state_file = state_file;
+  if (!state_file)
+    return;
+
+  // Without a handler, the dasher reloads the file as it is
+  GBytes* state = gpac_signal_emitter_load(GPAC_SESS_CTX(GPAC_CTX)->signals,
+                                           GPAC_SIGNAL_DASHER_LOAD_STATE,
+                                           state_file);
+  if (!state)
+    return;
+
+  gsize size;
+  const gchar* data = g_bytes_get_data(state, &size);
+  GError* error = NULL;
+  if (g_file_set_contents(state_file, data, size, &error)) {
+    GST_INFO_OBJECT(element, "Restored the dasher state to %s", state_file);
+  } else {
+    GST_ELEMENT_WARNING(element,
+                        RESOURCE,
+                        WRITE,
+                        (NULL),
+                        ("Failed to restore the dasher state to %s: %s",
+                         state_file,
+                         error->message));
+    g_error_free(error);
+  }
+  g_bytes_unref(state);
+}
+
 static gboolean
 gpac_prepare_pids(GstElement* element)
 {
@@ -241,6 +443,7 @@ gpac_prepare_pids(GstElement* element)
         }
 
         if (priv->flags) {
+          priv->framed_input = GPAC_PROP_CTX(GPAC_CTX)->framed_input;
           if (G_UNLIKELY(!gpac_pid_reconfigure(element, priv, pid))) {
             GST_ELEMENT_ERROR(
               element, STREAM, FAILED, (NULL), ("Failed to reconfigure PID"));
@@ -342,7 +545,391 @@ fail:
   return ret;
 }
 
+static void
+gst_gpac_tf_publish_shm(GstGpacTransform* gpac_tf,
+                        GPAC_FilterPPRet ret,
+                        gpointer output)
+{
+  GPAC_ShmRing* shm = GPAC_SESS_CTX(GPAC_CTX)->shm;
+
+  if (HAS_FLAG(ret, GPAC_FILTER_PP_RET_BUFFER)) {
+    gpac_shm_ring_write_buffer(shm, GST_BUFFER(output));
+  } else if (HAS_FLAG(ret, GPAC_FILTER_PP_RET_BUFFER_LIST)) {
+    GstBufferList* buffer_list = GST_BUFFER_LIST(output);
+    for (guint i = 0; i < gst_buffer_list_length(buffer_list); i++)
+      gpac_shm_ring_write_buffer(shm, gst_buffer_list_get(buffer_list, i));
+  }
+}
+
+// #MARK: Native Sink
+static void
+gst_gpac_tf_sink_unblock(GstGpacTransform* gpac_tf)
+{
+  // Called with the object lock held
+  if (gpac_tf->sink_clock_id)
+    gst_clock_id_unschedule(gpac_tf->sink_clock_id);
+  g_cond_broadcast(&gpac_tf->sink_cond);
+}
+
+static void
+gst_gpac_tf_sink_update_position(GstGpacTransform* gpac_tf,
+                                 GstAggregatorPad* pad,
+                                 GstBuffer* buffer)
+{
+  GstClockTime ts = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer)
+                                                    : GST_BUFFER_DTS(buffer);
+  if (!GST_CLOCK_TIME_IS_VALID(ts))
+    return;
+
+  GstClockTime running_time =
+    gst_segment_to_running_time(&pad->segment, GST_FORMAT_TIME, ts);
+  if (!GST_CLOCK_TIME_IS_VALID(running_time))
+    return;
+
+  // Sync on the newest buffer taken in
+  GST_OBJECT_LOCK(gpac_tf);
+  if (!GST_CLOCK_TIME_IS_VALID(gpac_tf->sink_running_time) ||
+      running_time > gpac_tf->sink_running_time) {
+    gpac_tf->sink_running_time = running_time;
+    gpac_tf->sink_position =
+      gst_segment_to_stream_time(&pad->segment, GST_FORMAT_TIME, ts);
+  }
+  GST_OBJECT_UNLOCK(gpac_tf);
+}
+
+static gboolean
+gst_gpac_tf_sink_commit_state(GstGpacTransform* gpac_tf)
+{
+  GstElement* element = GST_ELEMENT(gpac_tf);
+  gboolean post_paused = FALSE;
+  gboolean post_playing = FALSE;
+
+  GST_OBJECT_LOCK(gpac_tf);
+  if (gpac_tf->sink_prerolled) {
+    GST_OBJECT_UNLOCK(gpac_tf);
+    return TRUE;
+  }
+
+  // Data arrived before the state change went async, it will not go async
+  gpac_tf->sink_prerolled = TRUE;
+  if (!gpac_tf->sink_async) {
+    GST_OBJECT_UNLOCK(gpac_tf);
+    return TRUE;
+  }
+
+  GstState current = GST_STATE(element);
+  GstState next = GST_STATE_NEXT(element);
+  GstState pending = GST_STATE_PENDING(element);
+  GstState post_pending = pending;
+  switch (pending) {
+    case GST_STATE_PLAYING:
+      post_paused = current == GST_STATE_READY;
+      post_playing = TRUE;
+      gpac_tf->sink_playing = TRUE;
+      break;
+    case GST_STATE_PAUSED:
+      post_paused = TRUE;
+      post_pending = GST_STATE_VOID_PENDING;
+      break;
+    case GST_STATE_VOID_PENDING:
+      gpac_tf->sink_async = FALSE;
+      GST_OBJECT_UNLOCK(gpac_tf);
+      return TRUE;
+    default:
+      // Going down, do not commit
+      GST_OBJECT_UNLOCK(gpac_tf);
+      return FALSE;
+  }
+
+  gpac_tf->sink_async = FALSE;
+  GST_STATE(element) = pending;
+  GST_STATE_NEXT(element) = GST_STATE_VOID_PENDING;
+  GST_STATE_PENDING(element) = GST_STATE_VOID_PENDING;
+  GST_STATE_RETURN(element) = GST_STATE_CHANGE_SUCCESS;
+  GST_OBJECT_UNLOCK(gpac_tf);
+
+  GST_DEBUG_OBJECT(gpac_tf, "Prerolled, committing state");
+  if (post_paused)
+    gst_element_post_message(
+      element,
+      gst_message_new_state_changed(
+        GST_OBJECT(element), current, next, post_pending));
+  gst_element_post_message(
+    element,
+    gst_message_new_async_done(GST_OBJECT(element), GST_CLOCK_TIME_NONE));
+  if (post_playing)
+    gst_element_post_message(element,
+                             gst_message_new_state_changed(
+                               GST_OBJECT(element),
+                               next,
+                               pending,
+                               GST_STATE_VOID_PENDING));
+  GST_STATE_BROADCAST(element);
+  return TRUE;
+}
+
+static gboolean
+gst_gpac_tf_sink_commit(GstGpacTransform* gpac_tf)
+{
+  // The async-done message must follow the async-start of the state change
+  g_mutex_lock(&gpac_tf->sink_preroll_lock);
+  gboolean ret = gst_gpac_tf_sink_commit_state(gpac_tf);
+  g_mutex_unlock(&gpac_tf->sink_preroll_lock);
+  return ret;
+}
+
+static GstFlowReturn
+gst_gpac_tf_sink_wait(GstGpacTransform* gpac_tf)
+{
+  GstElement* element = GST_ELEMENT(gpac_tf);
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  // The first data completes the asynchronous state change
+  if (!gst_gpac_tf_sink_commit(gpac_tf))
+    return GST_FLOW_FLUSHING;
+
+  GST_OBJECT_LOCK(gpac_tf);
+  while (!gpac_tf->sink_flushing) {
+    // Hold the data while paused, like a prerolled sink
+    if (!gpac_tf->sink_playing) {
+      g_cond_wait(&gpac_tf->sink_cond, GST_OBJECT_GET_LOCK(gpac_tf));
+      continue;
+    }
+
+    GstClock* clock = GST_ELEMENT_CLOCK(element);
+    if (!GPAC_PROP_CTX(GPAC_CTX)->sync || !clock ||
+        !GST_CLOCK_TIME_IS_VALID(gpac_tf->sink_running_time))
+      break;
+
+    // Wait until the newest input is due
+    GstClockTime time = element->base_time + gpac_tf->sink_running_time;
+    if (GST_CLOCK_TIME_IS_VALID(gpac_tf->sink_latency))
+      time += gpac_tf->sink_latency;
+    GstClockID id = gst_clock_new_single_shot_id(clock, time);
+    gpac_tf->sink_clock_id = id;
+    GST_OBJECT_UNLOCK(gpac_tf);
+
+    GstClockReturn clock_ret = gst_clock_id_wait(id, NULL);
+
+    GST_OBJECT_LOCK(gpac_tf);
+    gpac_tf->sink_clock_id = NULL;
+    gst_clock_id_unref(id);
+
+    // Unscheduled by a pause, wait for playing again
+    if (clock_ret != GST_CLOCK_UNSCHEDULED)
+      break;
+  }
+  if (gpac_tf->sink_flushing)
+    ret = GST_FLOW_FLUSHING;
+  GST_OBJECT_UNLOCK(gpac_tf);
+  return ret;
+}
+
+static void
+gst_gpac_tf_sink_post_eos(GstGpacTransform* gpac_tf)
+{
+  // An EOS without data still completes the preroll
+  if (!gst_gpac_tf_sink_commit(gpac_tf))
+    return;
+
+  GstMessage* message = gst_message_new_eos(GST_OBJECT(gpac_tf));
+  if (gpac_tf->eos_seqnum != GST_SEQNUM_INVALID)
+    gst_message_set_seqnum(message, gpac_tf->eos_seqnum);
+  gst_element_post_message(GST_ELEMENT(gpac_tf), message);
+}
+
+// #MARK: Quality of Service
+static GstClockTime
+gst_gpac_tf_buffer_running_time(GstPad* pad, GstBuffer* buffer)
+{
+  GstClockTime ts = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer)
+                                                    : GST_BUFFER_DTS(buffer);
+  if (!GST_CLOCK_TIME_IS_VALID(ts))
+    return GST_CLOCK_TIME_NONE;
+  return gst_segment_to_running_time(
+    &GST_AGGREGATOR_PAD(pad)->segment, GST_FORMAT_TIME, ts);
+}
+
+static void
+gst_gpac_tf_post_qos(GstGpacTransform* gpac_tf,
+                     GstPad* pad,
+                     GstClockTime running_time)
+{
+  GpacPadPrivate* priv = gst_pad_get_element_private(pad);
+  GstSegment* segment = &GST_AGGREGATOR_PAD(pad)->segment;
+  GstClockTime timestamp = gst_segment_position_from_running_time(
+    segment, GST_FORMAT_TIME, running_time);
+  GstClockTime stream_time =
+    gst_segment_to_stream_time(segment, GST_FORMAT_TIME, timestamp);
+  gboolean live = GST_CLOCK_TIME_IS_VALID(
+    gst_aggregator_get_latency(GST_AGGREGATOR(gpac_tf)));
+
+  GstMessage* message = gst_message_new_qos(GST_OBJECT(gpac_tf),
+                                            live,
+                                            running_time,
+                                            stream_time,
+                                            timestamp,
+                                            GST_CLOCK_TIME_NONE);
+  gst_message_set_qos_values(
+    message, priv->qos_jitter, gpac_tf->qos_proportion, 1000000);
+  gst_message_set_qos_stats(
+    message, GST_FORMAT_BUFFERS, priv->stats.packets_in, priv->qos_dropped);
+  gst_element_post_message(GST_ELEMENT(gpac_tf), message);
+}
+
+typedef struct
+{
+  GstClockTime now; // running time of the clock
+  GstClockTime latency;
+  gboolean backlog; // the session could not take all of the input
+} GpacQosCheck;
+
+static gboolean
+gst_gpac_tf_pad_check_qos(GstElement* element, GstPad* pad, gpointer user_data)
+{
+  GstGpacTransform* gpac_tf = GST_GPAC_TF(element);
+  GpacQosCheck* check = (GpacQosCheck*)user_data;
+  GpacPadPrivate* priv = gst_pad_get_element_private(pad);
+  GstClockTime running_time = priv->qos_running_time;
+  if (!GST_CLOCK_TIME_IS_VALID(running_time))
+    return TRUE;
+
+  // The newest input was due at its running time plus the latency
+  GstClockTimeDiff jitter =
+    GST_CLOCK_DIFF(running_time + check->latency, check->now);
+  priv->qos_jitter = MAX(jitter, -(GstClockTimeDiff)running_time);
+  gboolean late = jitter > (GstClockTimeDiff)GPAC_QOS_MAX_LATENESS ||
+                  check->backlog || gpac_tf->qos_proportion > 1.0;
+
+  // Tell upstream while late, and once more when back in time
+  if (gpac_tf->qos && (late || priv->qos_late)) {
+    GST_DEBUG_OBJECT(pad,
+                     "Session is %s, jitter: %" G_GINT64_FORMAT
+                     ", proportion: %f, backlog: %d",
+                     late ? "late" : "back in time",
+                     priv->qos_jitter,
+                     gpac_tf->qos_proportion,
+                     check->backlog);
+    gst_pad_push_event(pad,
+                       gst_event_new_qos(GST_QOS_TYPE_OVERFLOW,
+                                         gpac_tf->qos_proportion,
+                                         priv->qos_jitter,
+                                         running_time));
+    gst_gpac_tf_post_qos(gpac_tf, pad, running_time);
+  }
+  priv->qos_late = late;
+  return TRUE;
+}
+
+static void
+gst_gpac_tf_check_qos(GstGpacTransform* gpac_tf,
+                      GstClockTime newest,
+                      gint64 processing_us,
+                      const GPAC_MemIoLevel* level)
+{
+  GstElement* element = GST_ELEMENT(gpac_tf);
+  if (!gpac_tf->qos && !gpac_tf->qos_drop)
+    return;
+
+  // Compare the processing time to the media time it covered
+  if (GST_CLOCK_TIME_IS_VALID(newest)) {
+    if (GST_CLOCK_TIME_IS_VALID(gpac_tf->qos_last_time) &&
+        newest > gpac_tf->qos_last_time) {
+      gdouble proportion = (gdouble)(processing_us * GST_USECOND) /
+                           (newest - gpac_tf->qos_last_time);
+      gpac_tf->qos_proportion = (gpac_tf->qos_proportion * 7 + proportion) / 8;
+    }
+    if (!GST_CLOCK_TIME_IS_VALID(gpac_tf->qos_last_time) ||
+        newest > gpac_tf->qos_last_time)
+      gpac_tf->qos_last_time = newest;
+  }
+
+  // Live input is due at the clock, otherwise only a synchronized sink is
+  GpacQosCheck check = { 0 };
+  check.latency = gst_aggregator_get_latency(GST_AGGREGATOR(gpac_tf));
+  if (!GST_CLOCK_TIME_IS_VALID(check.latency)) {
+    if (!gpac_tf->is_sink || !GPAC_PROP_CTX(GPAC_CTX)->sync)
+      return;
+    GST_OBJECT_LOCK(gpac_tf);
+    check.latency = GST_CLOCK_TIME_IS_VALID(gpac_tf->sink_latency)
+                      ? gpac_tf->sink_latency
+                      : 0;
+    GST_OBJECT_UNLOCK(gpac_tf);
+  }
+
+  GstClock* clock = gst_element_get_clock(element);
+  if (!clock)
+    return;
+  GstClockTime now = gst_clock_get_time(clock);
+  GstClockTime base_time = gst_element_get_base_time(element);
+  gst_object_unref(clock);
+  if (now < base_time)
+    return;
+  check.now = now - base_time;
+
+  // The run ran out of steps, with input still waiting to be taken
+  check.backlog =
+    GPAC_SESS_CTX(GPAC_CTX)->run_exhausted && level->pending_packets > 0;
+
+  gst_element_foreach_sink_pad(element, gst_gpac_tf_pad_check_qos, &check);
+}
+
+static void
+gst_gpac_tf_reset_qos(GstGpacTransform* gpac_tf)
+{
+  gpac_tf->qos_proportion = 1.0;
+  gpac_tf->qos_last_time = GST_CLOCK_TIME_NONE;
+
+  for (GList* l = GST_ELEMENT(gpac_tf)->sinkpads; l; l = l->next) {
+    GpacPadPrivate* priv = gst_pad_get_element_private(GST_PAD(l->data));
+    priv->qos_running_time = GST_CLOCK_TIME_NONE;
+    priv->qos_jitter = 0;
+    priv->qos_late = FALSE;
+  }
+}
+
 // #MARK: Aggregator
+static GF_Err
+gst_gpac_tf_run_session(GstGpacTransform* gpac_tf, gboolean flush)
+{
+  gpac_session_send_updates(GPAC_SESS_CTX(GPAC_CTX));
+
+  gint64 start = g_get_monotonic_time();
+  GF_Err e = gpac_session_run(GPAC_SESS_CTX(GPAC_CTX), flush);
+  gpac_stats_histogram_add(&gpac_tf->stats.session_run,
+                           g_get_monotonic_time() - start);
+  return e;
+}
+
+static void
+gst_gpac_tf_post_stats(GstGpacTransform* gpac_tf)
+{
+  if (!gpac_tf->stats_interval)
+    return;
+
+  gint64 now = g_get_monotonic_time();
+  if (gpac_tf->stats.last_post &&
+      (guint64)(now - gpac_tf->stats.last_post) * GST_USECOND <
+        gpac_tf->stats_interval)
+    return;
+  gpac_tf->stats.last_post = now;
+
+  gst_element_post_message(
+    GST_ELEMENT(gpac_tf),
+    gst_message_new_element(GST_OBJECT(gpac_tf),
+                            gst_gpac_tf_get_stats(gpac_tf)));
+}
+
+static GPAC_FilterPPRet
+gst_gpac_tf_consume_next(GstGpacTransform* gpac_tf, void** output)
+{
+  // Only memout is locked, the output is pushed without the session lock
+  gpac_session_lock(GPAC_SESS_CTX(GPAC_CTX));
+  GPAC_FilterPPRet ret = gpac_memio_consume(GPAC_SESS_CTX(GPAC_CTX), output);
+  gpac_session_unlock(GPAC_SESS_CTX(GPAC_CTX));
+  return ret;
+}
+
 GstFlowReturn
 gst_gpac_tf_consume(GstAggregator* agg, Bool is_eos)
 {
@@ -354,7 +941,7 @@ gst_gpac_tf_consume(GstAggregator* agg, Bool is_eos)
 
   void* output;
   GPAC_FilterPPRet ret;
-  while ((ret = gpac_memio_consume(GPAC_SESS_CTX(GPAC_CTX), &output))) {
+  while ((ret = gst_gpac_tf_consume_next(gpac_tf, &output))) {
     if (ret & GPAC_FILTER_PP_RET_ERROR) {
       // An error occurred, stop processing
       goto error;
@@ -367,7 +954,19 @@ gst_gpac_tf_consume(GstAggregator* agg, Bool is_eos)
     }
 
     gboolean had_signal = (ret & GPAC_FILTER_PP_RET_SIGNAL) != 0;
+    if (output && GPAC_SESS_CTX(GPAC_CTX)->shm)
+      gst_gpac_tf_publish_shm(gpac_tf, ret, output);
+    if (ret > GPAC_MAY_HAVE_BUFFER && gpac_tf->is_sink) {
+      // A native sink has no downstream, the output is only drained
+      if (output)
+        gst_mini_object_unref(GST_MINI_OBJECT(output));
+      if (HAS_FLAG(ret, GPAC_FILTER_PP_RET_NULL) && !had_signal)
+        return is_eos ? GST_FLOW_EOS : GST_FLOW_OK;
+      continue;
+    }
+
     if (ret > GPAC_MAY_HAVE_BUFFER) {
+      gint64 consumed_at = g_get_monotonic_time();
       if (output) {
         // Notify the selected sample
         gst_aggregator_selected_samples(agg,
@@ -377,10 +976,30 @@ gst_gpac_tf_consume(GstAggregator* agg, Bool is_eos)
                                         NULL);
       }
 
+      // The first output of a new graph does not follow the previous one
+      if (gpac_tf->pending_discont &&
+          HAS_FLAG(ret, GPAC_FILTER_PP_RET_BUFFER)) {
+        output = gst_buffer_make_writable(GST_BUFFER(output));
+        GST_BUFFER_FLAG_SET(GST_BUFFER(output), GST_BUFFER_FLAG_DISCONT);
+        gpac_tf->pending_discont = FALSE;
+      } else if (gpac_tf->pending_discont &&
+                 HAS_FLAG(ret, GPAC_FILTER_PP_RET_BUFFER_LIST) &&
+                 gst_buffer_list_length(GST_BUFFER_LIST(output))) {
+        output = gst_buffer_list_make_writable(GST_BUFFER_LIST(output));
+        GstBuffer* first =
+          gst_buffer_list_get_writable(GST_BUFFER_LIST(output), 0);
+        GST_BUFFER_FLAG_SET(first, GST_BUFFER_FLAG_DISCONT);
+        gpac_tf->pending_discont = FALSE;
+      }
+
       if (HAS_FLAG(ret, GPAC_FILTER_PP_RET_BUFFER)) {
         // Send the buffer
         GST_DEBUG_OBJECT(agg, "Sending buffer");
+        gpac_tf->stats.packets_out++;
+        gpac_tf->stats.bytes_out += gst_buffer_get_size(GST_BUFFER(output));
         flow_ret = gst_aggregator_finish_buffer(agg, GST_BUFFER(output));
+        gpac_stats_histogram_add(&gpac_tf->stats.downstream,
+                                 g_get_monotonic_time() - consumed_at);
         GST_DEBUG_OBJECT(agg, "Buffer sent!");
       } else if (HAS_FLAG(ret, GPAC_FILTER_PP_RET_BUFFER_LIST)) {
         // Send the buffer list
@@ -409,7 +1028,11 @@ gst_gpac_tf_consume(GstAggregator* agg, Bool is_eos)
                                                                    : "No");
         }
 
+        gpac_tf->stats.packets_out += gst_buffer_list_length(buffer_list);
+        gpac_tf->stats.bytes_out += gst_buffer_list_calculate_size(buffer_list);
         flow_ret = gst_aggregator_finish_buffer_list(agg, buffer_list);
+        gpac_stats_histogram_add(&gpac_tf->stats.downstream,
+                                 g_get_monotonic_time() - consumed_at);
         GST_DEBUG_OBJECT(agg, "Buffer list sent!");
       } else if (HAS_FLAG(ret, GPAC_FILTER_PP_RET_NULL)) {
         // If we had signals, consume all of them first
@@ -419,8 +1042,7 @@ gst_gpac_tf_consume(GstAggregator* agg, Bool is_eos)
         if (is_eos)
           return GST_FLOW_EOS;
 
-        GST_DEBUG_OBJECT(agg,
-                         "Sending sync buffer, possibly connected to fakesink");
+        GST_DEBUG_OBJECT(agg, "Sending sync buffer");
 
         // We send only one buffer regardless of potential pending buffers
         GstBuffer* buffer = gpac_tf->sync_buffer;
@@ -465,13 +1087,19 @@ gst_gpac_tf_sink_event(GstAggregator* agg,
   GstGpacTransform* gpac_tf = GST_GPAC_TF(GST_ELEMENT(agg));
   GpacPadPrivate* priv = gst_pad_get_element_private(GST_PAD(pad));
 
+  // The shared session lock is only taken around the GPAC calls, a flush
+  // must never wait for another element running the session
   switch (GST_EVENT_TYPE(event)) {
     case GST_EVENT_CAPS: {
-      if (priv->caps)
-        gst_caps_unref(priv->caps);
-
       GstCaps* caps;
       gst_event_parse_caps(event, &caps);
+
+      // Identical caps would only cause a spurious reconfiguration
+      if (priv->caps && gst_caps_is_equal(priv->caps, caps))
+        break;
+
+      if (priv->caps)
+        gst_caps_unref(priv->caps);
       priv->caps = gst_caps_ref(caps);
       priv->flags |= GPAC_PAD_CAPS_SET;
       break;
@@ -494,35 +1122,62 @@ gst_gpac_tf_sink_event(GstAggregator* agg,
       // Update the segment and global offset only if video pad or the only pad
       if (is_video_pad || is_only_pad) {
         gst_aggregator_update_segment(agg, gst_segment_copy(segment));
+        gpac_session_lock(GPAC_SESS_CTX(GPAC_CTX));
         gpac_memio_set_global_offset(GPAC_SESS_CTX(GPAC_CTX), segment);
+        gpac_session_unlock(GPAC_SESS_CTX(GPAC_CTX));
+      }
+
+      // GPAC needs increasing timestamps, reverse playback cannot be muxed
+      if (segment->rate < 0.0) {
+        GST_ELEMENT_ERROR(agg,
+                          STREAM,
+                          NOT_IMPLEMENTED,
+                          ("Reverse playback is not supported"),
+                          ("Segment rate %f on pad %s",
+                           segment->rate,
+                           GST_PAD_NAME(pad)));
+        break;
       }
 
-      // Check if playback rate is equal to 1.0
-      if (segment->rate != 1.0)
-        GST_FIXME_OBJECT(agg,
-                         "Handling of non-1.0 playback rate is not "
-                         "implemented yet");
+      // Trick modes keep the media timeline, only key frames go through when
+      // upstream asked for key units
+      priv->key_units_only =
+        !!(segment->flags & GST_SEGMENT_FLAG_TRICKMODE_KEY_UNITS);
+      if (segment->rate != 1.0 || priv->key_units_only)
+        GST_INFO_OBJECT(agg,
+                        "Trick mode segment on pad %s, rate: %f, key units "
+                        "only: %d",
+                        GST_PAD_NAME(pad),
+                        segment->rate,
+                        priv->key_units_only);
 
       break;
     }
 
     case GST_EVENT_TAG: {
-      if (priv->tags)
-        gst_tag_list_unref(priv->tags);
-
       GstTagList* tags;
       gst_event_parse_tag(event, &tags);
+
+      if (priv->tags && gst_tag_list_is_equal(priv->tags, tags))
+        break;
+
+      if (priv->tags)
+        gst_tag_list_unref(priv->tags);
       priv->tags = gst_tag_list_ref(tags);
       priv->flags |= GPAC_PAD_TAGS_SET;
       break;
     }
 
     case GST_EVENT_EOS: {
+      gpac_tf->eos_seqnum = gst_event_get_seqnum(event);
+
       // Set this pad as EOS
       GF_FilterPid* pid = NULL;
       g_object_get(GST_AGGREGATOR_PAD(pad), "pid", &pid, NULL);
       g_assert(pid != NULL);
+      gpac_session_lock(GPAC_SESS_CTX(GPAC_CTX));
       gpac_memio_set_eos(GPAC_SESS_CTX(GPAC_CTX), pid);
+      gpac_session_unlock(GPAC_SESS_CTX(GPAC_CTX));
       priv->eos = TRUE;
 
       // Are all pads EOS?
@@ -544,14 +1199,43 @@ gst_gpac_tf_sink_event(GstAggregator* agg,
 
       // If all pads are EOS, send EOS to the source
       GST_DEBUG_OBJECT(agg, "All pads are EOS, sending EOS to GPAC");
-      gpac_session_run(GPAC_SESS_CTX(GPAC_CTX), TRUE);
+      gst_gpac_tf_run_session(gpac_tf, TRUE);
       gst_gpac_tf_consume(agg, GST_EVENT_TYPE(event) == GST_EVENT_EOS);
       break;
     }
 
     case GST_EVENT_FLUSH_START:
-      gpac_session_run(GPAC_SESS_CTX(GPAC_CTX), TRUE);
-      gst_gpac_tf_consume(agg, GST_EVENT_TYPE(event) == GST_EVENT_EOS);
+      // Stop waiting for the session to release input
+      GST_OBJECT_LOCK(gpac_tf);
+      gpac_tf->level_flushing = TRUE;
+      g_cond_broadcast(&gpac_tf->level_cond);
+      GST_OBJECT_UNLOCK(gpac_tf);
+
+      if (gpac_tf->is_sink) {
+        // Unblock the streaming thread, a flush loses the preroll
+        GST_OBJECT_LOCK(gpac_tf);
+        gpac_tf->sink_flushing = TRUE;
+        gpac_tf->sink_playing = FALSE;
+        gpac_tf->sink_prerolled = FALSE;
+        gpac_tf->sink_async = TRUE;
+        gst_gpac_tf_sink_unblock(gpac_tf);
+        GST_OBJECT_UNLOCK(gpac_tf);
+        gst_element_lost_state(GST_ELEMENT(agg));
+      }
+      break;
+
+    case GST_EVENT_FLUSH_STOP:
+      GST_OBJECT_LOCK(gpac_tf);
+      gpac_tf->level_flushing = FALSE;
+      GST_OBJECT_UNLOCK(gpac_tf);
+
+      if (gpac_tf->is_sink) {
+        GST_OBJECT_LOCK(gpac_tf);
+        gpac_tf->sink_flushing = FALSE;
+        gpac_tf->sink_running_time = GST_CLOCK_TIME_NONE;
+        gpac_tf->sink_position = GST_CLOCK_TIME_NONE;
+        GST_OBJECT_UNLOCK(gpac_tf);
+      }
       break;
 
     default:
@@ -640,6 +1324,7 @@ gst_gpac_request_idr(GstAggregator* agg, GstPad* pad, GstBuffer* buffer)
 
   // Check if this IDR was on time
   guint64 diff = priv->idr_last - priv->idr_next;
+  gpac_stats_histogram_add(&priv->stats.idr_lateness, diff / GST_USECOND);
   if (diff)
     GST_ELEMENT_WARNING(agg,
                         STREAM,
@@ -665,21 +1350,344 @@ request:
       agg, STREAM, FAILED, (NULL), ("Failed to push the force key unit event"));
 }
 
+static gboolean
+gst_gpac_tf_update_level(GstGpacTransform* gpac_tf, GPAC_MemIoLevel* level)
+{
+  GPAC_PropertyContext* prop_ctx = GPAC_PROP_CTX(GPAC_CTX);
+  gpac_session_lock(GPAC_SESS_CTX(GPAC_CTX));
+  gpac_memio_get_level(GPAC_SESS_CTX(GPAC_CTX), level);
+  gpac_session_unlock(GPAC_SESS_CTX(GPAC_CTX));
+
+  GST_OBJECT_LOCK(gpac_tf);
+  prop_ctx->level_bytes = level->bytes;
+  prop_ctx->level_time = level->time;
+  GST_OBJECT_UNLOCK(gpac_tf);
+
+  // Check the limits
+  if (prop_ctx->max_size_bytes && level->bytes >= prop_ctx->max_size_bytes)
+    return TRUE;
+  if (prop_ctx->max_size_time && level->time >= prop_ctx->max_size_time)
+    return TRUE;
+  return FALSE;
+}
+
 static GstFlowReturn
-gst_gpac_tf_aggregate(GstAggregator* agg, gboolean timeout)
+gst_gpac_tf_wait_for_space(GstAggregator* agg)
+{
+  GstGpacTransform* gpac_tf = GST_GPAC_TF(GST_ELEMENT(agg));
+  GPAC_MemIoLevel level;
+
+  while (gst_gpac_tf_update_level(gpac_tf, &level)) {
+    GST_DEBUG_OBJECT(agg,
+                     "Internal queues are full (%" G_GUINT64_FORMAT
+                     " bytes, %" GST_TIME_FORMAT "), draining",
+                     level.bytes,
+                     GST_TIME_ARGS(level.time));
+
+    // Let the session and downstream make progress
+    if (gst_gpac_tf_run_session(gpac_tf, FALSE) != GF_OK)
+      return GST_FLOW_ERROR;
+    GstFlowReturn ret = gst_gpac_tf_consume(agg, FALSE);
+    if (ret != GST_FLOW_OK)
+      return ret;
+
+    // Once gpac took all of our packets, the data is held by filters that
+    // need more input to complete, so holding input back would dead-lock
+    GST_OBJECT_LOCK(gpac_tf);
+    guint64 released = GPAC_SESS_CTX(GPAC_CTX)->released_count;
+    GST_OBJECT_UNLOCK(gpac_tf);
+    GPAC_MemIoLevel drained;
+    if (!gst_gpac_tf_update_level(gpac_tf, &drained))
+      break;
+    if (drained.pending_packets == 0) {
+      GST_DEBUG_OBJECT(agg, "Session needs more input, not holding it back");
+      break;
+    }
+
+    // Downstream of the memory input is stalled, wait for it to release
+    // some input, unless flushing or shutting down
+    gint64 end_time = g_get_monotonic_time() + GPAC_BACKPRESSURE_WAIT_US;
+    gboolean stalled =
+      drained.bytes >= level.bytes && drained.time >= level.time;
+    GST_OBJECT_LOCK(gpac_tf);
+    while (stalled && !gpac_tf->level_flushing &&
+           released == GPAC_SESS_CTX(GPAC_CTX)->released_count) {
+      if (!g_cond_wait_until(
+            &gpac_tf->level_cond, GST_OBJECT_GET_LOCK(gpac_tf), end_time))
+        break;
+    }
+    gboolean flushing = gpac_tf->level_flushing;
+    GST_OBJECT_UNLOCK(gpac_tf);
+    if (flushing || GST_PAD_IS_FLUSHING(GST_AGGREGATOR_SRC_PAD(agg)))
+      return GST_FLOW_FLUSHING;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_gpac_tf_pad_at_key_frame(GstElement* element,
+                             GstPad* pad,
+                             gpointer user_data)
+{
+  GstGpacTransform* gpac_tf = GST_GPAC_TF(element);
+  gboolean* at_key_frame = user_data;
+
+  // Only video pads carry delta units worth waiting for
+  if (GST_PAD_PAD_TEMPLATE(pad) !=
+        gst_gpac_get_sink_template(GPAC_TEMPLATE_VIDEO) ||
+      gst_aggregator_pad_is_eos(GST_AGGREGATOR_PAD(pad)))
+    return TRUE;
+
+  // The next buffer must be a key frame
+  GstBuffer* buffer = gst_aggregator_pad_peek_buffer(GST_AGGREGATOR_PAD(pad));
+  if (!buffer || GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    *at_key_frame = FALSE;
+
+    // Ask upstream for one, instead of waiting for the next scheduled one
+    if (gpac_tf->pending_key_unit)
+      gst_pad_push_event(
+        pad,
+        gst_video_event_new_upstream_force_key_unit(
+          GST_CLOCK_TIME_NONE, TRUE, 0));
+  }
+
+  if (buffer)
+    gst_buffer_unref(buffer);
+  return TRUE;
+}
+
+static void
+gst_gpac_tf_reattach_pids(GstGpacTransform* gpac_tf)
+{
+  for (GList* l = GST_ELEMENT(gpac_tf)->sinkpads; l; l = l->next) {
+    GstPad* pad = GST_PAD(l->data);
+    GpacPadPrivate* priv = gst_pad_get_element_private(pad);
+
+    // The PIDs were destroyed with the previous session
+    g_object_set(GST_AGGREGATOR_PAD(pad), "pid", NULL, NULL);
+
+    // Configure the new PID from everything the pad has received
+    if (priv->caps)
+      priv->flags |= GPAC_PAD_CAPS_SET;
+    if (priv->tags)
+      priv->flags |= GPAC_PAD_TAGS_SET;
+    if (priv->segment)
+      priv->flags |= GPAC_PAD_SEGMENT_SET;
+    priv->caps_changed = TRUE;
+  }
+}
+
+static gboolean
+gst_gpac_tf_replace_session(GstGpacTransform* gpac_tf,
+                            gchar* graph,
+                            gboolean drain)
+{
+  GstAggregator* agg = GST_AGGREGATOR(gpac_tf);
+  GPAC_SessionContext* sess = GPAC_SESS_CTX(GPAC_CTX);
+
+  // Build the new graph next to the running one
+  GPAC_SessionContext next = { 0 };
+  next.destination = sess->destination;
+  next.state_file = sess->state_file;
+  next.iframe_playlist = sess->iframe_playlist;
+  next.stats = sess->stats;
+  next.released = sess->released;
+  if (!gst_gpac_tf_open_session(gpac_tf, &next, graph)) {
+    gpac_session_close(&next, FALSE);
+    return FALSE;
+  }
+
+  if (drain) {
+    // Drain the running graph, without ending the stream downstream
+    gpac_memio_set_eos(sess, NULL);
+    if (gst_gpac_tf_run_session(gpac_tf, TRUE) != GF_OK ||
+        gst_gpac_tf_consume(agg, TRUE) == GST_FLOW_ERROR) {
+      gpac_session_close(&next, FALSE);
+      return FALSE;
+    }
+
+    // Keep the output timeline continuous across the graphs
+    if (sess->memout && next.memout) {
+      GPAC_MemIoContext* from = gf_filter_get_rt_udta(sess->memout);
+      GPAC_MemIoContext* to = gf_filter_get_rt_udta(next.memout);
+      to->global_offset = from->global_offset;
+      to->is_continuous = from->is_continuous;
+    }
+  } else {
+    // Whatever the running graph holds is dropped with it
+    sess->had_data_flow = FALSE;
+  }
+
+  // The outputs and the pending updates belong to the element
+  next.shm = g_steal_pointer(&sess->shm);
+  next.signals = g_steal_pointer(&sess->signals);
+  next.state_checksum = g_steal_pointer(&sess->state_checksum);
+  next.state_mtime = sess->state_mtime;
+  next.state_size = sess->state_size;
+  GST_OBJECT_LOCK(gpac_tf);
+  next.updates = g_steal_pointer(&sess->updates);
+  GST_OBJECT_UNLOCK(gpac_tf);
+
+  // Close the previous graph and take its place
+  gpac_session_close(sess, GPAC_PROP_CTX(GPAC_CTX)->print_stats);
+  *sess = next;
+
+  // The memory io filters were set up with the local context
+  GF_Filter* memio[] = { sess->memin, sess->memout };
+  for (guint i = 0; i < G_N_ELEMENTS(memio); i++) {
+    GPAC_MemIoContext* rt_udta =
+      memio[i] ? gf_filter_get_rt_udta(memio[i]) : NULL;
+    if (rt_udta)
+      rt_udta->sess = sess;
+  }
+  gpac_memio_assign_queue(sess, GPAC_MEMIO_DIR_IN, gpac_tf->queue);
+  gst_gpac_tf_reattach_pids(gpac_tf);
+  return TRUE;
+}
+
+static gboolean
+gst_gpac_tf_swap_graph(GstGpacTransform* gpac_tf, gchar* graph)
+{
+  GstElement* element = GST_ELEMENT(gpac_tf);
+  if (!gst_gpac_tf_replace_session(gpac_tf, graph, TRUE))
+    return FALSE;
+
+  // The old graph was finalized, the new one restarts the output with its
+  // own header, so downstream is told about the new caps and discontinuity
+  gpac_tf->pending_discont = TRUE;
+  if (!gst_aggregator_negotiate(GST_AGGREGATOR(gpac_tf)))
+    GST_WARNING_OBJECT(element, "Failed to negotiate the new graph output");
+
+  // The prepared session for the next start follows the graph
+  g_free(gpac_tf->session_graph);
+  gpac_tf->session_graph = g_strdup(graph);
+  if (gpac_tf->session_key) {
+    g_free(gpac_tf->session_key);
+    gpac_tf->session_key =
+      gpac_session_pool_key(GPAC_SESS_CTX(GPAC_CTX),
+                            graph,
+                            GPAC_PROP_CTX(GPAC_CTX)->props_as_argv);
+  }
+
+  GST_INFO_OBJECT(element, "Switched to graph %s", graph);
+  gst_element_post_message(
+    element,
+    gst_message_new_element(
+      GST_OBJECT(element),
+      gst_structure_new(
+        "gpac-graph-swapped", "graph", G_TYPE_STRING, graph, NULL)));
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_gpac_tf_flush(GstAggregator* agg)
+{
+  GstGpacTransform* gpac_tf = GST_GPAC_TF(GST_ELEMENT(agg));
+  GST_DEBUG_OBJECT(agg, "Flushing the GPAC session");
+
+  // Drop the packets memin did not send yet
+  gpac_session_lock(GPAC_SESS_CTX(GPAC_CTX));
+  gboolean queued = !g_queue_is_empty(gpac_tf->queue) ||
+                    GPAC_SESS_CTX(GPAC_CTX)->had_data_flow;
+  g_queue_clear_full(gpac_tf->queue, (GDestroyNotify)gf_filter_pck_unref);
+  gpac_session_unlock(GPAC_SESS_CTX(GPAC_CTX));
+  gst_clear_buffer(&gpac_tf->sync_buffer);
+
+  // Restart every pad from its next key frame
+  for (GList* l = GST_ELEMENT(agg)->sinkpads; l; l = l->next) {
+    GpacPadPrivate* priv = gst_pad_get_element_private(GST_PAD(l->data));
+    priv->eos = FALSE;
+    priv->wait_key_frame = TRUE;
+    priv->idr_next = GST_CLOCK_TIME_NONE;
+  }
+  gst_gpac_tf_reset_qos(gpac_tf);
+
+  // Other elements still have data in a shared session
+  if (GPAC_SESS_CTX(GPAC_CTX)->shared)
+    return GST_FLOW_OK;
+
+  // The graph holds nothing since the last flush, as on back to back seeks
+  if (!queued)
+    return GST_FLOW_OK;
+
+  // Replacing the graph is cheaper than processing what it holds
+  gpac_session_lock(GPAC_SESS_CTX(GPAC_CTX));
+  gboolean ret =
+    gst_gpac_tf_replace_session(gpac_tf, gpac_tf->session_graph, FALSE);
+  gpac_session_unlock(GPAC_SESS_CTX(GPAC_CTX));
+  if (!ret) {
+    GST_ELEMENT_ERROR(
+      agg, STREAM, FAILED, (NULL), ("Failed to flush the GPAC session"));
+    return GST_FLOW_ERROR;
+  }
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_gpac_tf_check_graph(GstGpacTransform* gpac_tf)
+{
+  GST_OBJECT_LOCK(gpac_tf);
+  gboolean pending = gpac_tf->pending_graph != NULL;
+  GST_OBJECT_UNLOCK(gpac_tf);
+  if (!pending)
+    return TRUE;
+
+  // Switch only where the new graph can start cleanly
+  gboolean at_key_frame = TRUE;
+  gst_element_foreach_sink_pad(
+    GST_ELEMENT(gpac_tf), gst_gpac_tf_pad_at_key_frame, &at_key_frame);
+
+  GST_OBJECT_LOCK(gpac_tf);
+  gpac_tf->pending_key_unit = FALSE;
+  if (!at_key_frame) {
+    GST_OBJECT_UNLOCK(gpac_tf);
+    return TRUE;
+  }
+  gchar* graph = g_steal_pointer(&gpac_tf->pending_graph);
+  GST_OBJECT_UNLOCK(gpac_tf);
+
+  gboolean ret = gst_gpac_tf_swap_graph(gpac_tf, graph);
+  g_free(graph);
+  return ret;
+}
+
+static GstFlowReturn
+gst_gpac_tf_aggregate_buffers(GstAggregator* agg)
 {
   GstGpacTransform* gpac_tf = GST_GPAC_TF(GST_ELEMENT(agg));
   GstIterator* pad_iter;
   GValue item = G_VALUE_INIT;
   gboolean done = FALSE;
   gboolean has_buffers = TRUE;
+  gint64 batch_start = 0;
+  GstClockTime qos_newest = GST_CLOCK_TIME_NONE;
+  GPAC_MemIoLevel level;
+
+  // Switch to a graph set while running
+  if (!gst_gpac_tf_check_graph(gpac_tf)) {
+    GST_ELEMENT_ERROR(
+      agg, STREAM, FAILED, (NULL), ("Failed to switch to the new graph"));
+    return GST_FLOW_ERROR;
+  }
 
   // Check and create PIDs if necessary
-  if (!gpac_prepare_pids(GST_ELEMENT(agg))) {
+  gpac_session_lock(GPAC_SESS_CTX(GPAC_CTX));
+  gboolean pids_ready = gpac_prepare_pids(GST_ELEMENT(agg));
+  gpac_session_unlock(GPAC_SESS_CTX(GPAC_CTX));
+  if (!pids_ready) {
     GST_ELEMENT_ERROR(agg, STREAM, FAILED, (NULL), ("Failed to prepare PIDs"));
     return GST_FLOW_ERROR;
   }
 
+  // Apply backpressure before taking more input
+  GstFlowReturn flow_ret = gst_gpac_tf_wait_for_space(agg);
+  if (flow_ret != GST_FLOW_OK)
+    return flow_ret;
+
+  // Waiting for space is not part of the processing time
+  gint64 qos_start = g_get_monotonic_time();
+
   GST_DEBUG_OBJECT(agg, "Aggregating buffers");
 
   // Create the temporary queue
@@ -710,6 +1718,8 @@ gst_gpac_tf_aggregate(GstAggregator* agg, gboolean timeout)
 
           // We found at least one buffer, continue the outer loop
           has_buffers = TRUE;
+          if (!batch_start)
+            batch_start = g_get_monotonic_time();
 
           // Skip droppable/gap buffers
           if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_GAP)) {
@@ -718,6 +1728,30 @@ gst_gpac_tf_aggregate(GstAggregator* agg, gboolean timeout)
             goto next;
           }
 
+          // Shed the non-reference frames while the session is late
+          if (gpac_tf->qos_drop && priv->qos_late &&
+              GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DROPPABLE)) {
+            GST_DEBUG_OBJECT(
+              agg, "Dropping droppable buffer on pad %s", GST_PAD_NAME(pad));
+            priv->qos_dropped++;
+            GstClockTime running_time =
+              gst_gpac_tf_buffer_running_time(pad, buffer);
+            if (gpac_tf->qos && GST_CLOCK_TIME_IS_VALID(running_time))
+              gst_gpac_tf_post_qos(gpac_tf, pad, running_time);
+            goto next;
+          }
+
+          // Restart from a key frame after a flush, and keep only the key
+          // frames in key unit trick modes
+          if (priv->wait_key_frame || priv->key_units_only) {
+            if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+              GST_DEBUG_OBJECT(
+                agg, "Dropping delta unit on pad %s", GST_PAD_NAME(pad));
+              goto next;
+            }
+            priv->wait_key_frame = FALSE;
+          }
+
           // Send the key frame request
           // Only send IDR request for video pads
           if (gst_pad_get_pad_template(pad) ==
@@ -730,7 +1764,14 @@ gst_gpac_tf_aggregate(GstAggregator* agg, gboolean timeout)
           g_assert(pid);
 
           // Create the packet
+          GPAC_TRACE_BEGIN(span);
+          gpac_session_lock(GPAC_SESS_CTX(GPAC_CTX));
           GF_FilterPacket* packet = gpac_pck_new_from_buffer(buffer, priv, pid);
+          if (packet)
+            gpac_memio_track_packet(GPAC_SESS_CTX(GPAC_CTX), packet);
+          gpac_session_unlock(GPAC_SESS_CTX(GPAC_CTX));
+          GPAC_TRACE_END(
+            span, "gpac_pck_new_from_buffer", gf_filter_pid_get_name(pid));
           if (!packet) {
             GST_ELEMENT_ERROR(agg,
                               STREAM,
@@ -742,13 +1783,32 @@ gst_gpac_tf_aggregate(GstAggregator* agg, gboolean timeout)
 
           // Enqueue the packet
           g_queue_push_tail(queue, packet);
+          priv->stats.packets_in++;
+          priv->stats.bytes_in += gst_buffer_get_size(buffer);
+          gpac_tf->stats.packets_in++;
+          gpac_tf->stats.bytes_in += gst_buffer_get_size(buffer);
+
+          // Remember how far the input went, for the QoS
+          GstClockTime running_time =
+            gst_gpac_tf_buffer_running_time(pad, buffer);
+          if (GST_CLOCK_TIME_IS_VALID(running_time)) {
+            if (!GST_CLOCK_TIME_IS_VALID(priv->qos_running_time) ||
+                running_time > priv->qos_running_time)
+              priv->qos_running_time = running_time;
+            if (!GST_CLOCK_TIME_IS_VALID(qos_newest) ||
+                running_time > qos_newest)
+              qos_newest = running_time;
+          }
 
           // Select the highest PTS for sync buffer
           gboolean is_video_pad =
             gst_pad_get_pad_template(GST_PAD(pad)) ==
             gst_gpac_get_sink_template(GPAC_TEMPLATE_VIDEO);
           gboolean is_only_pad = g_list_length(GST_ELEMENT(agg)->sinkpads) == 1;
-          if (is_video_pad || is_only_pad) {
+          if (gpac_tf->is_sink && (is_video_pad || is_only_pad)) {
+            gst_gpac_tf_sink_update_position(
+              gpac_tf, GST_AGGREGATOR_PAD(pad), buffer);
+          } else if (is_video_pad || is_only_pad) {
             if (gpac_tf->sync_buffer) {
               guint64 current_pts = GST_BUFFER_PTS(buffer);
               guint64 sync_pts = GST_BUFFER_PTS(gpac_tf->sync_buffer);
@@ -796,22 +1856,124 @@ gst_gpac_tf_aggregate(GstAggregator* agg, gboolean timeout)
     return GST_FLOW_EOS;
   }
 
-  // Merge the queues
+  // Merge the queues, memin pops them from any element running the session
+  gpac_session_lock(GPAC_SESS_CTX(GPAC_CTX));
   while (!g_queue_is_empty(queue)) {
     gpointer pck = g_queue_pop_head(queue);
     g_queue_push_tail(gpac_tf->queue, pck);
   }
   g_queue_free(queue);
 
+  // Track the input queue, memin sends it during the session run
+  gpac_tf->stats.queue_depth = g_queue_get_length(gpac_tf->queue);
+  gpac_memio_mark_queued(GPAC_SESS_CTX(GPAC_CTX), batch_start);
+  gpac_session_unlock(GPAC_SESS_CTX(GPAC_CTX));
+  gpac_tf->stats.queue_depth_max =
+    MAX(gpac_tf->stats.queue_depth_max, gpac_tf->stats.queue_depth);
+
   // Run the filter session
-  if (gpac_session_run(GPAC_SESS_CTX(GPAC_CTX), FALSE) != GF_OK) {
+  if (gst_gpac_tf_run_session(gpac_tf, FALSE) != GF_OK) {
     GST_ELEMENT_ERROR(
       agg, STREAM, FAILED, (NULL), ("Failed to run the GPAC session"));
     return GST_FLOW_ERROR;
   }
 
   // Consume the output
-  return gst_gpac_tf_consume(agg, FALSE);
+  flow_ret = gst_gpac_tf_consume(agg, FALSE);
+  gst_gpac_tf_update_level(gpac_tf, &level);
+  gst_gpac_tf_check_qos(
+    gpac_tf, qos_newest, g_get_monotonic_time() - qos_start, &level);
+  gst_gpac_tf_post_stats(gpac_tf);
+  return flow_ret;
+}
+
+static GstFlowReturn
+gst_gpac_tf_aggregate(GstAggregator* agg, gboolean timeout)
+{
+  GstGpacTransform* gpac_tf = GST_GPAC_TF(GST_ELEMENT(agg));
+
+  GPAC_TRACE_BEGIN(span);
+  GstFlowReturn ret = gst_gpac_tf_aggregate_buffers(agg);
+  GPAC_TRACE_END(span, "gst_gpac_tf_aggregate", GST_OBJECT_NAME(agg));
+
+  // Preroll, hold and sync the data as a sink would
+  if (gpac_tf->is_sink) {
+    if (ret == GST_FLOW_OK)
+      ret = gst_gpac_tf_sink_wait(gpac_tf);
+    else if (ret == GST_FLOW_EOS)
+      gst_gpac_tf_sink_post_eos(gpac_tf);
+  }
+  return ret;
+}
+
+static gboolean
+gst_gpac_tf_src_query(GstAggregator* agg, GstQuery* query)
+{
+  GstGpacTransform* gpac_tf = GST_GPAC_TF(GST_ELEMENT(agg));
+
+  if (gpac_tf->is_sink) {
+    switch (GST_QUERY_TYPE(query)) {
+      case GST_QUERY_POSITION: {
+        GstFormat format;
+        gst_query_parse_position(query, &format, NULL);
+        if (format != GST_FORMAT_TIME)
+          break;
+
+        // Report the position of the newest data taken in
+        GST_OBJECT_LOCK(gpac_tf);
+        GstClockTime position = gpac_tf->sink_position;
+        GST_OBJECT_UNLOCK(gpac_tf);
+        if (!GST_CLOCK_TIME_IS_VALID(position))
+          return FALSE;
+        gst_query_set_position(query, format, position);
+        return TRUE;
+      }
+
+      case GST_QUERY_LATENCY:
+        // Without sync the clock is never waited on, so we are not live
+        if (!GPAC_PROP_CTX(GPAC_CTX)->sync) {
+          gst_query_set_latency(query, FALSE, 0, GST_CLOCK_TIME_NONE);
+          return TRUE;
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  return GST_AGGREGATOR_CLASS(parent_class)->src_query(agg, query);
+}
+
+static gboolean
+gst_gpac_tf_src_event(GstAggregator* agg, GstEvent* event)
+{
+  GstGpacTransform* gpac_tf = GST_GPAC_TF(GST_ELEMENT(agg));
+
+  // The pipeline latency is added to the clock waits of the native sink
+  if (GST_EVENT_TYPE(event) == GST_EVENT_LATENCY) {
+    GstClockTime latency;
+    gst_event_parse_latency(event, &latency);
+    GST_OBJECT_LOCK(gpac_tf);
+    gpac_tf->sink_latency = latency;
+    GST_OBJECT_UNLOCK(gpac_tf);
+  }
+
+  return GST_AGGREGATOR_CLASS(parent_class)->src_event(agg, event);
+}
+
+static gboolean
+gst_gpac_tf_propose_allocation(GstAggregator* agg,
+                               GstAggregatorPad* pad,
+                               GstQuery* decide_query,
+                               GstQuery* query)
+{
+  // Upstream buffers allocated from our memory are shared with GPAC as is
+  g_autoptr(GstAllocator) allocator = gpac_allocator_get();
+  GstAllocationParams params;
+  gst_allocation_params_init(&params);
+  gst_query_add_allocation_param(query, allocator, &params);
+  return TRUE;
 }
 
 // #MARK: Pad Management
@@ -890,6 +2052,17 @@ gst_gpac_tf_reset(GstGpacTransform* tf)
 
         // Reset the PID
         g_object_set(GST_AGGREGATOR_PAD(pad), "pid", NULL, NULL);
+
+        // Identical sticky events are skipped when they are sent again, so
+        // the next PID is configured from what the pad already has
+        if (priv->caps)
+          priv->flags |= GPAC_PAD_CAPS_SET;
+        if (priv->tags)
+          priv->flags |= GPAC_PAD_TAGS_SET;
+        if (priv->segment)
+          priv->flags |= GPAC_PAD_SEGMENT_SET;
+        priv->caps_changed = TRUE;
+        g_value_reset(&item);
         break;
       }
       case GST_ITERATOR_RESYNC:
@@ -911,50 +2084,9 @@ gst_gpac_tf_reset(GstGpacTransform* tf)
   }
 }
 
-static gboolean
-gst_gpac_tf_start(GstAggregator* aggregator)
+static gchar*
+gst_gpac_tf_build_graph(GstGpacTransform* gpac_tf, GstGpacParams* params)
 {
-  GstGpacTransform* gpac_tf = GST_GPAC_TF(aggregator);
-  GstElement* element = GST_ELEMENT(aggregator);
-  GObjectClass* klass = G_OBJECT_CLASS(G_TYPE_INSTANCE_GET_CLASS(
-    G_OBJECT(element), GST_TYPE_GPAC_TF, GstGpacTransformClass));
-  GstGpacParams* params = GST_GPAC_GET_PARAMS(klass);
-  GstSegment segment;
-
-  // Check if we have the graph property set
-  if (!params->is_single && !GPAC_PROP_CTX(GPAC_CTX)->graph) {
-    GST_ELEMENT_ERROR(
-      element, STREAM, FAILED, (NULL), ("Graph property must be set"));
-    return FALSE;
-  }
-
-  // Convert the properties to arguments
-  if (!gpac_apply_properties(GPAC_PROP_CTX(GPAC_CTX))) {
-    GST_ELEMENT_ERROR(
-      element, LIBRARY, INIT, (NULL), ("Failed to apply properties"));
-    return FALSE;
-  }
-  // Initialize the GPAC context
-  if (!gpac_init(GPAC_CTX, element)) {
-    GST_ELEMENT_ERROR(
-      element, LIBRARY, INIT, (NULL), ("Failed to initialize GPAC context"));
-    return FALSE;
-  }
-
-  // Create the session
-  if (!gpac_session_init(GPAC_SESS_CTX(GPAC_CTX), element, params)) {
-    GST_ELEMENT_ERROR(
-      element, LIBRARY, INIT, (NULL), ("Failed to initialize GPAC session"));
-    return FALSE;
-  }
-
-  // Create the memory input
-  gpac_return_val_if_fail(
-    gpac_memio_new(GPAC_SESS_CTX(GPAC_CTX), GPAC_MEMIO_DIR_IN), FALSE);
-  gpac_memio_assign_queue(
-    GPAC_SESS_CTX(GPAC_CTX), GPAC_MEMIO_DIR_IN, gpac_tf->queue);
-
-  // Open the session
   gchar* graph = NULL;
   if (params->is_single) {
     if (params->info->default_options) {
@@ -1000,44 +2132,239 @@ gst_gpac_tf_start(GstAggregator* aggregator)
     graph = g_strdup(GPAC_PROP_CTX(GPAC_CTX)->graph);
   }
 
-  // Set the destination override on session context
-  GPAC_SESS_CTX(GPAC_CTX)->destination = GPAC_PROP_CTX(GPAC_CTX)->destination;
+  return graph;
+}
 
-  gpac_return_val_if_fail(gpac_session_open(GPAC_SESS_CTX(GPAC_CTX), graph),
-                          FALSE);
-  g_free(graph);
+static gboolean
+gst_gpac_tf_open_session(GstGpacTransform* gpac_tf,
+                         GPAC_SessionContext* sess,
+                         gchar* graph)
+{
+  GstElement* element = GST_ELEMENT(gpac_tf);
+  GObjectClass* klass = G_OBJECT_CLASS(G_TYPE_INSTANCE_GET_CLASS(
+    G_OBJECT(element), GST_TYPE_GPAC_TF, GstGpacTransformClass));
+  GstGpacParams* params = GST_GPAC_GET_PARAMS(klass);
+
+  // Create the session
+  if (!gpac_session_init(sess, element, params)) {
+    GST_ELEMENT_ERROR(
+      element, LIBRARY, INIT, (NULL), ("Failed to initialize GPAC session"));
+    return FALSE;
+  }
+
+  // Create the memory input
+  gpac_return_val_if_fail(gpac_memio_new(sess, GPAC_MEMIO_DIR_IN), FALSE);
+
+  // Open the session
+  gpac_return_val_if_fail(gpac_session_open(sess, graph), FALSE);
 
   // Create the memory output
   gboolean is_inside_sink = GST_IS_GPAC_SINK(gst_element_get_parent(element));
   gboolean requires_memout =
     params->info && GPAC_SE_IS_REQUIRES_MEMOUT(params->info->flags);
   requires_memout = !is_inside_sink || (is_inside_sink && requires_memout) ||
-                    GPAC_PROP_CTX(GPAC_CTX)->destination;
+                    sess->destination;
 
   if (requires_memout) {
-    gpac_return_val_if_fail(
-      gpac_memio_new(GPAC_SESS_CTX(GPAC_CTX), GPAC_MEMIO_DIR_OUT), FALSE);
+    gpac_return_val_if_fail(gpac_memio_new(sess, GPAC_MEMIO_DIR_OUT), FALSE);
   }
 
   // Check if the session has an output
-  if (!gpac_session_has_output(GPAC_SESS_CTX(GPAC_CTX))) {
+  if (!gpac_session_has_output(sess)) {
     GST_ELEMENT_ERROR(
       element, STREAM, FAILED, (NULL), ("Session has no output"));
     return FALSE;
   }
 
+  return TRUE;
+}
+
+typedef struct
+{
+  GstGpacTransform* gpac_tf;
+  gchar* graph;
+  gchar* key;
+  gchar* destination;
+} GpacPrepareTask;
+
+static gpointer
+gst_gpac_tf_prepare_session(gpointer data)
+{
+  GpacPrepareTask* task = data;
+
+  GPAC_SessionContext next = { 0 };
+  next.destination = task->destination;
+  if (gst_gpac_tf_open_session(task->gpac_tf, &next, task->graph))
+    gpac_session_pool_put(&next, task->key);
+  else
+    gpac_session_close(&next, FALSE);
+
+  gpac_runtime_release();
+  g_free(task->graph);
+  g_free(task->key);
+  g_free(task->destination);
+  g_free(task);
+  return NULL;
+}
+
+static void
+gst_gpac_tf_join_prepare(GstGpacTransform* gpac_tf)
+{
+  if (gpac_tf->prepare_thread)
+    g_thread_join(g_steal_pointer(&gpac_tf->prepare_thread));
+}
+
+static void
+gst_gpac_tf_prepare_session_async(GstGpacTransform* gpac_tf)
+{
+  // Only one session is prepared at a time
+  gst_gpac_tf_join_prepare(gpac_tf);
+
+  // The runtime must outlive the element context while the session is built
+  if (!gpac_runtime_acquire())
+    return;
+
+  // The element outlives the thread, it is joined before start and finalize
+  GpacPrepareTask* task = g_new0(GpacPrepareTask, 1);
+  task->gpac_tf = gpac_tf;
+  task->graph = g_strdup(gpac_tf->session_graph);
+  task->key = g_strdup(gpac_tf->session_key);
+  task->destination = g_strdup(GPAC_PROP_CTX(GPAC_CTX)->destination);
+  gpac_tf->prepare_thread =
+    g_thread_new("gpac-prepare", gst_gpac_tf_prepare_session, task);
+}
+
+static gboolean
+gst_gpac_tf_start(GstAggregator* aggregator)
+{
+  GstGpacTransform* gpac_tf = GST_GPAC_TF(aggregator);
+  GstElement* element = GST_ELEMENT(aggregator);
+  GObjectClass* klass = G_OBJECT_CLASS(G_TYPE_INSTANCE_GET_CLASS(
+    G_OBJECT(element), GST_TYPE_GPAC_TF, GstGpacTransformClass));
+  GstGpacParams* params = GST_GPAC_GET_PARAMS(klass);
+  GstSegment segment;
+
+  // The session prepared on the last stop may still be under construction
+  gst_gpac_tf_join_prepare(gpac_tf);
+
+  // Check if we have the graph property set
+  if (!params->is_single && !GPAC_PROP_CTX(GPAC_CTX)->graph) {
+    GST_ELEMENT_ERROR(
+      element, STREAM, FAILED, (NULL), ("Graph property must be set"));
+    return FALSE;
+  }
+
+  // Convert the properties to arguments
+  if (!gpac_apply_properties(GPAC_PROP_CTX(GPAC_CTX))) {
+    GST_ELEMENT_ERROR(
+      element, LIBRARY, INIT, (NULL), ("Failed to apply properties"));
+    return FALSE;
+  }
+  // Initialize the GPAC context
+  if (!gpac_init(GPAC_CTX, element)) {
+    GST_ELEMENT_ERROR(
+      element, LIBRARY, INIT, (NULL), ("Failed to initialize GPAC context"));
+    return FALSE;
+  }
+
+  // Build the graph
+  g_free(gpac_tf->session_graph);
+  gpac_tf->session_graph = gst_gpac_tf_build_graph(gpac_tf, params);
+
+  // Set the destination override on session context
+  GPAC_SESS_CTX(GPAC_CTX)->destination = GPAC_PROP_CTX(GPAC_CTX)->destination;
+  GPAC_SESS_CTX(GPAC_CTX)->shared_name =
+    GPAC_PROP_CTX(GPAC_CTX)->shared_session;
+  GPAC_SESS_CTX(GPAC_CTX)->iframe_playlist = gpac_tf->iframe_playlist;
+
+  // Reset the statistics
+  memset(&gpac_tf->stats, 0, sizeof(gpac_tf->stats));
+  GPAC_SESS_CTX(GPAC_CTX)->stats = &gpac_tf->stats;
+  GPAC_SESS_CTX(GPAC_CTX)->released = &gpac_tf->level_cond;
+  gst_gpac_tf_reset_qos(gpac_tf);
+
+  // Publish the output over shared memory if requested
+  const gchar* shm_socket = GPAC_PROP_CTX(GPAC_CTX)->shm_socket;
+  if (shm_socket && !GPAC_SESS_CTX(GPAC_CTX)->shm) {
+    GPAC_SESS_CTX(GPAC_CTX)->shm = gpac_shm_ring_new(
+      element, shm_socket, GPAC_PROP_CTX(GPAC_CTX)->shm_size);
+    if (!GPAC_SESS_CTX(GPAC_CTX)->shm)
+      goto fail;
+  }
+  if (shm_socket && gpac_tf->iframe_playlist)
+    GST_ELEMENT_WARNING(element,
+                        RESOURCE,
+                        SETTINGS,
+                        (NULL),
+                        ("I-frame playlists address byte ranges of the "
+                         "segment files, not of the shared memory output"));
+
+  // Resolve the signals once for the whole session
+  if (!GPAC_SESS_CTX(GPAC_CTX)->signals)
+    GPAC_SESS_CTX(GPAC_CTX)->signals = gpac_signal_emitter_new(
+      element, GPAC_PROP_CTX(GPAC_CTX)->signal_queue_size);
+
+  // Resume the dasher from the state the application persisted
+  gpac_restore_state(element);
+
+  // Reuse a prepared session if there is one, otherwise open a new one
+  g_free(gpac_tf->session_key);
+  gpac_tf->session_key = NULL;
+  if (GPAC_PROP_CTX(GPAC_CTX)->reuse_session &&
+      !GPAC_PROP_CTX(GPAC_CTX)->shared_session) {
+    GPAC_SESS_CTX(GPAC_CTX)->element = element;
+    GPAC_SESS_CTX(GPAC_CTX)->params = params;
+    gpac_tf->session_key =
+      gpac_session_pool_key(GPAC_SESS_CTX(GPAC_CTX),
+                            gpac_tf->session_graph,
+                            GPAC_PROP_CTX(GPAC_CTX)->props_as_argv);
+  }
+
+  gpac_tf->stats.session_reused =
+    gpac_tf->session_key &&
+    gpac_session_pool_take(GPAC_SESS_CTX(GPAC_CTX), gpac_tf->session_key);
+  if (!gpac_tf->stats.session_reused) {
+    if (!gst_gpac_tf_open_session(
+          gpac_tf, GPAC_SESS_CTX(GPAC_CTX), gpac_tf->session_graph))
+      goto fail;
+  }
+  gpac_memio_assign_queue(
+    GPAC_SESS_CTX(GPAC_CTX), GPAC_MEMIO_DIR_IN, gpac_tf->queue);
+
   // Initialize the PIDs for all pads
   if (!gpac_prepare_pids(element)) {
     GST_ELEMENT_ERROR(
       element, LIBRARY, FAILED, (NULL), ("Failed to prepare PIDs"));
-    return FALSE;
+    goto fail;
   }
   GST_DEBUG_OBJECT(element, "GPAC session started");
 
+  // Start tracing if requested by the property or the environment
+  if (!gpac_tf->tracing)
+    gpac_tf->tracing = gpac_trace_ref(GPAC_PROP_CTX(GPAC_CTX)->trace_file);
+
+  // Cache the memory released by upstream while running
+  gpac_allocator_acquire();
+
   // Initialize the segment
   gst_segment_init(&segment, GST_FORMAT_TIME);
   gst_aggregator_update_segment(aggregator, &segment);
+
+  // Options set from now on are sent to the running session
+  GST_OBJECT_LOCK(gpac_tf);
+  gpac_tf->session_running = TRUE;
+  GST_OBJECT_UNLOCK(gpac_tf);
   return TRUE;
+
+fail:
+  // Stop is not called when starting fails, undo everything from gpac_init
+  gpac_session_close(GPAC_SESS_CTX(GPAC_CTX), FALSE);
+  g_clear_pointer(&GPAC_SESS_CTX(GPAC_CTX)->shm, gpac_shm_ring_free);
+  g_clear_pointer(&GPAC_SESS_CTX(GPAC_CTX)->signals, gpac_signal_emitter_free);
+  g_clear_pointer(&GPAC_SESS_CTX(GPAC_CTX)->state_checksum, g_free);
+  g_clear_pointer(&gpac_tf->session_key, g_free);
+  gpac_destroy(GPAC_CTX);
+  return FALSE;
 }
 
 static gboolean
@@ -1049,9 +2376,17 @@ gst_gpac_tf_stop(GstAggregator* aggregator)
     G_OBJECT(element), GST_TYPE_GPAC_TF, GstGpacTransformClass));
   GstGpacParams* params = GST_GPAC_GET_PARAMS(klass);
 
+  // Options set from now on are used as is on the next start
+  GST_OBJECT_LOCK(gpac_tf);
+  gpac_tf->session_running = FALSE;
+  GST_OBJECT_UNLOCK(gpac_tf);
+
   // Abort the session
+  gpac_session_lock(GPAC_SESS_CTX(GPAC_CTX));
   gpac_memio_set_eos(GPAC_SESS_CTX(GPAC_CTX), NULL);
   gpac_session_abort(GPAC_SESS_CTX(GPAC_CTX));
+  gpac_session_unlock(GPAC_SESS_CTX(GPAC_CTX));
+  gpac_allocator_release();
 
   // Close the session
   if (!gpac_session_close(GPAC_SESS_CTX(GPAC_CTX),
@@ -1061,21 +2396,133 @@ gst_gpac_tf_stop(GstAggregator* aggregator)
     return FALSE;
   }
 
+  // Nothing is written to the shared memory past this point
+  g_clear_pointer(&GPAC_SESS_CTX(GPAC_CTX)->shm, gpac_shm_ring_free);
+
+  // Wait for the queued output to reach the application
+  g_clear_pointer(&GPAC_SESS_CTX(GPAC_CTX)->signals, gpac_signal_emitter_free);
+  g_clear_pointer(&GPAC_SESS_CTX(GPAC_CTX)->state_checksum, g_free);
+
+  // Finalize the trace once the session is drained
+  if (gpac_tf->tracing) {
+    gpac_trace_unref();
+    gpac_tf->tracing = FALSE;
+  }
+
   // Reset the element
   gst_gpac_tf_reset(gpac_tf);
 
+  // Prepare a session for the next start, away from the state change
+  if (gpac_tf->session_key) {
+    gst_gpac_tf_prepare_session_async(gpac_tf);
+    g_clear_pointer(&gpac_tf->session_key, g_free);
+  }
+  g_clear_pointer(&gpac_tf->session_graph, g_free);
+  g_clear_pointer(&gpac_tf->pending_graph, g_free);
+  gpac_tf->pending_discont = FALSE;
+
   // Destroy the GPAC context
   gpac_destroy(GPAC_CTX);
   GST_DEBUG_OBJECT(element, "GPAC session stopped");
   return TRUE;
 }
 
+static GstStateChangeReturn
+gst_gpac_tf_change_state(GstElement* element, GstStateChange transition)
+{
+  GstGpacTransform* gpac_tf = GST_GPAC_TF(element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY) {
+    // Inside a sink bin, this element is the sink
+    GstGpacParams* params = GST_GPAC_GET_PARAMS(G_OBJECT_GET_CLASS(element));
+    gpac_tf->is_sink = params && params->is_inside_sink;
+    if (gpac_tf->is_sink)
+      GST_OBJECT_FLAG_SET(element, GST_ELEMENT_FLAG_SINK);
+  }
+
+  // Release a streaming thread waiting for space before the pads are
+  // deactivated
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED ||
+      transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    GST_OBJECT_LOCK(gpac_tf);
+    gpac_tf->level_flushing = transition == GST_STATE_CHANGE_PAUSED_TO_READY;
+    g_cond_broadcast(&gpac_tf->level_cond);
+    GST_OBJECT_UNLOCK(gpac_tf);
+  }
+
+  if (!gpac_tf->is_sink)
+    return GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      GST_OBJECT_LOCK(gpac_tf);
+      gpac_tf->sink_prerolled = FALSE;
+      gpac_tf->sink_async = FALSE;
+      gpac_tf->sink_playing = FALSE;
+      gpac_tf->sink_flushing = FALSE;
+      gpac_tf->sink_latency = 0;
+      gpac_tf->sink_running_time = GST_CLOCK_TIME_NONE;
+      gpac_tf->sink_position = GST_CLOCK_TIME_NONE;
+      gpac_tf->eos_seqnum = GST_SEQNUM_INVALID;
+      GST_OBJECT_UNLOCK(gpac_tf);
+      break;
+
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+      GST_OBJECT_LOCK(gpac_tf);
+      gpac_tf->sink_playing = TRUE;
+      gst_gpac_tf_sink_unblock(gpac_tf);
+      GST_OBJECT_UNLOCK(gpac_tf);
+      break;
+
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      GST_OBJECT_LOCK(gpac_tf);
+      gpac_tf->sink_playing = FALSE;
+      gst_gpac_tf_sink_unblock(gpac_tf);
+      GST_OBJECT_UNLOCK(gpac_tf);
+      break;
+
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      // Release the streaming thread before the pads are deactivated
+      GST_OBJECT_LOCK(gpac_tf);
+      gpac_tf->sink_flushing = TRUE;
+      gst_gpac_tf_sink_unblock(gpac_tf);
+      GST_OBJECT_UNLOCK(gpac_tf);
+      break;
+
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE ||
+      transition != GST_STATE_CHANGE_READY_TO_PAUSED)
+    return ret;
+
+  // Complete the change to PAUSED only once the first data arrived. Like
+  // basesink, an element that already prerolled changes state right away.
+  g_mutex_lock(&gpac_tf->sink_preroll_lock);
+  GST_OBJECT_LOCK(gpac_tf);
+  gboolean prerolled = gpac_tf->sink_prerolled;
+  gpac_tf->sink_async = !prerolled;
+  GST_OBJECT_UNLOCK(gpac_tf);
+  if (!prerolled)
+    gst_element_post_message(element,
+                             gst_message_new_async_start(GST_OBJECT(element)));
+  g_mutex_unlock(&gpac_tf->sink_preroll_lock);
+
+  return prerolled ? ret : GST_STATE_CHANGE_ASYNC;
+}
+
 static void
 gst_gpac_tf_finalize(GObject* object)
 {
   GstGpacTransform* gpac_tf = GST_GPAC_TF(object);
   GPAC_PropertyContext* ctx = GPAC_PROP_CTX(GPAC_CTX);
 
+  // The preparation thread uses the element until it is done
+  gst_gpac_tf_join_prepare(gpac_tf);
+
   // Free the properties
   g_list_free(ctx->properties);
   ctx->properties = NULL;
@@ -1086,6 +2533,11 @@ gst_gpac_tf_finalize(GObject* object)
     g_free((void*)ctx->props_as_argv);
   }
 
+  // Free the session reuse state
+  g_free(gpac_tf->session_graph);
+  g_free(gpac_tf->session_key);
+  g_free(gpac_tf->pending_graph);
+
   // Free the queue
   if (gpac_tf->queue) {
     g_assert(g_queue_is_empty(gpac_tf->queue));
@@ -1093,6 +2545,9 @@ gst_gpac_tf_finalize(GObject* object)
     gpac_tf->queue = NULL;
   }
 
+  g_cond_clear(&gpac_tf->sink_cond);
+  g_mutex_clear(&gpac_tf->sink_preroll_lock);
+  g_cond_clear(&gpac_tf->level_cond);
   G_OBJECT_CLASS(parent_class)->finalize(object);
 }
 
@@ -1102,6 +2557,11 @@ gst_gpac_tf_init(GstGpacTransform* tf)
 {
   gst_gpac_tf_reset(tf);
   tf->queue = g_queue_new();
+  g_cond_init(&tf->sink_cond);
+  g_mutex_init(&tf->sink_preroll_lock);
+  g_cond_init(&tf->level_cond);
+  GPAC_PROP_CTX(&tf->gpac_ctx)->shm_size = GPAC_SHM_DEFAULT_SIZE;
+  tf->qos = TRUE;
 }
 
 static void
@@ -1122,11 +2582,19 @@ gst_gpac_tf_class_init(GstGpacTransformClass* klass)
 
   // Set the aggregator functions
   gstaggregator_class->sink_event = GST_DEBUG_FUNCPTR(gst_gpac_tf_sink_event);
+  gstaggregator_class->flush = GST_DEBUG_FUNCPTR(gst_gpac_tf_flush);
   gstaggregator_class->aggregate = GST_DEBUG_FUNCPTR(gst_gpac_tf_aggregate);
   gstaggregator_class->negotiated_src_caps =
     GST_DEBUG_FUNCPTR(gst_gpac_tf_negotiated_src_caps);
   gstaggregator_class->start = GST_DEBUG_FUNCPTR(gst_gpac_tf_start);
   gstaggregator_class->stop = GST_DEBUG_FUNCPTR(gst_gpac_tf_stop);
+  gstaggregator_class->src_query = GST_DEBUG_FUNCPTR(gst_gpac_tf_src_query);
+  gstaggregator_class->src_event = GST_DEBUG_FUNCPTR(gst_gpac_tf_src_event);
+  gstaggregator_class->propose_allocation =
+    GST_DEBUG_FUNCPTR(gst_gpac_tf_propose_allocation);
+
+  // Set the element functions
+  gstelement_class->change_state = GST_DEBUG_FUNCPTR(gst_gpac_tf_change_state);
 
   gst_type_mark_as_plugin_api(GST_TYPE_GPAC_TF_PAD, 0);
 }
@@ -1146,8 +2614,28 @@ gst_gpac_tf_subclass_init(GstGpacTransformClass* klass)
   gobject_class->set_property = GST_DEBUG_FUNCPTR(gst_gpac_tf_set_property);
   gobject_class->get_property = GST_DEBUG_FUNCPTR(gst_gpac_tf_get_property);
   gpac_install_global_properties(gobject_class);
-  gpac_install_local_properties(
-    gobject_class, GPAC_PROP_PRINT_STATS, GPAC_PROP_0);
+  gpac_install_local_properties(gobject_class,
+                                GPAC_PROP_PRINT_STATS,
+                                GPAC_PROP_REUSE_SESSION,
+                                GPAC_PROP_FRAMED_INPUT,
+                                GPAC_PROP_MAX_SIZE_BYTES,
+                                GPAC_PROP_MAX_SIZE_TIME,
+                                GPAC_PROP_CURRENT_LEVEL_BYTES,
+                                GPAC_PROP_CURRENT_LEVEL_TIME,
+                                GPAC_PROP_TRACE_FILE,
+                                GPAC_PROP_SHM_SOCKET,
+                                GPAC_PROP_SHM_SIZE,
+                                GPAC_PROP_SHARED_SESSION,
+                                GPAC_PROP_SIGNAL_QUEUE_SIZE,
+                                GPAC_PROP_STATS,
+                                GPAC_PROP_STATS_INTERVAL,
+                                GPAC_PROP_QOS,
+                                GPAC_PROP_QOS_DROP,
+                                GPAC_PROP_0);
+
+  // The sink bin relays its sync property to us
+  if (params->is_inside_sink)
+    gpac_install_local_properties(gobject_class, GPAC_PROP_SYNC, GPAC_PROP_0);
 
   // Add the subclass-specific properties and pad templates
   if (params->is_single) {
@@ -0,0 +1,343 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "lib/allocator.h"
+
+#define GPAC_ALLOCATOR_NAME "GpacMemory"
+
+// Room reserved before the data for the owner header
+#define GPAC_MEMORY_HEADER_SIZE 64
+
+// Number and total size of the released blocks kept for reuse
+#define GPAC_MEMORY_CACHE_SIZE 32
+#define GPAC_MEMORY_CACHE_MAX_BYTES (16 * 1024 * 1024)
+
+// Released blocks not reused for this long are freed
+#define GPAC_MEMORY_CACHE_IDLE_US (5 * G_TIME_SPAN_SECOND)
+
+typedef struct
+{
+  // The buffer a shared packet keeps alive, NULL when not attached
+  GstBuffer* owner;
+} GpacMemoryHeader;
+
+typedef struct
+{
+  GstMemory mem;
+
+  gpointer block;
+  gsize block_size;
+  guint8* data;
+  gint64 cached_at; // monotonic time the block was released
+} GpacMemory;
+
+typedef struct
+{
+  GstAllocator parent;
+
+  GMutex lock;
+  GQueue cache; // most recently released first
+  gsize cached_bytes;
+  guint users; // started elements proposing the allocator
+} GpacAllocator;
+
+typedef struct
+{
+  GstAllocatorClass parent_class;
+} GpacAllocatorClass;
+
+G_DEFINE_TYPE(GpacAllocator, gpac_allocator, GST_TYPE_ALLOCATOR);
+
+static GstAllocator* gpac_allocator = NULL;
+
+static inline GpacMemoryHeader*
+gpac_memory_header(const guint8* data)
+{
+  return (GpacMemoryHeader*)(data - sizeof(GpacMemoryHeader));
+}
+
+// #MARK: Memory
+static GstMemory*
+gpac_allocator_alloc(GstAllocator* allocator,
+                     gsize size,
+                     GstAllocationParams* params)
+{
+  GpacAllocator* self = (GpacAllocator*)allocator;
+  gsize maxsize = size + params->prefix + params->padding;
+  gsize align = params->align | gst_memory_alignment;
+  gsize block_size = GPAC_MEMORY_HEADER_SIZE + align + maxsize;
+
+  // Reuse a released block that is large enough, but not wastefully so
+  GpacMemory* mem = NULL;
+  g_mutex_lock(&self->lock);
+  for (GList* l = self->cache.head; l; l = l->next) {
+    GpacMemory* cached = l->data;
+    if (cached->block_size >= block_size &&
+        cached->block_size <= block_size * 2) {
+      g_queue_delete_link(&self->cache, l);
+      self->cached_bytes -= cached->block_size;
+      mem = cached;
+      break;
+    }
+  }
+  g_mutex_unlock(&self->lock);
+
+  if (!mem) {
+    mem = g_new0(GpacMemory, 1);
+    mem->block = g_malloc(block_size);
+    mem->block_size = block_size;
+  }
+
+  // Align the data, the header sits right before it
+  guintptr start = (guintptr)mem->block + GPAC_MEMORY_HEADER_SIZE;
+  mem->data = (guint8*)((start + align) & ~(guintptr)align);
+  gpac_memory_header(mem->data)->owner = NULL;
+
+  gst_memory_init(GST_MEMORY_CAST(mem),
+                  params->flags,
+                  allocator,
+                  NULL,
+                  maxsize,
+                  align,
+                  params->prefix,
+                  size);
+
+  if (params->prefix && (params->flags & GST_MEMORY_FLAG_ZERO_PREFIXED))
+    memset(mem->data, 0, params->prefix);
+  if (params->padding && (params->flags & GST_MEMORY_FLAG_ZERO_PADDED))
+    memset(mem->data + params->prefix + size, 0, params->padding);
+
+  return GST_MEMORY_CAST(mem);
+}
+
+static GList*
+gpac_allocator_trim(GpacAllocator* self, gint64 released_before)
+{
+  // Called with the lock held, returns the blocks to free
+  GList* trimmed = NULL;
+  GpacMemory* oldest;
+  while ((oldest = g_queue_peek_tail(&self->cache)) &&
+         oldest->cached_at < released_before) {
+    self->cached_bytes -= oldest->block_size;
+    trimmed = g_list_prepend(trimmed, g_queue_pop_tail(&self->cache));
+  }
+  return trimmed;
+}
+
+static void
+gpac_memory_free_block(GpacMemory* mem)
+{
+  g_free(mem->block);
+  g_free(mem);
+}
+
+static void
+gpac_allocator_free(GstAllocator* allocator, GstMemory* memory)
+{
+  GpacAllocator* self = (GpacAllocator*)allocator;
+  GpacMemory* mem = (GpacMemory*)memory;
+
+  // Sub-memories do not own their block
+  if (memory->parent) {
+    g_free(mem);
+    return;
+  }
+
+  // Keep the block only while an element may ask for it again
+  gint64 now = g_get_monotonic_time();
+  g_mutex_lock(&self->lock);
+  if (self->users && self->cache.length < GPAC_MEMORY_CACHE_SIZE &&
+      self->cached_bytes + mem->block_size <= GPAC_MEMORY_CACHE_MAX_BYTES) {
+    mem->cached_at = now;
+    self->cached_bytes += mem->block_size;
+    g_queue_push_head(&self->cache, mem);
+    mem = NULL;
+  }
+  GList* trimmed = gpac_allocator_trim(self, now - GPAC_MEMORY_CACHE_IDLE_US);
+  g_mutex_unlock(&self->lock);
+
+  if (mem)
+    gpac_memory_free_block(mem);
+  g_list_free_full(trimmed, (GDestroyNotify)gpac_memory_free_block);
+}
+
+static gpointer
+gpac_memory_map(GstMemory* memory, gsize maxsize, GstMapFlags flags)
+{
+  return ((GpacMemory*)memory)->data;
+}
+
+static void
+gpac_memory_unmap(GstMemory* memory)
+{
+}
+
+static GstMemory*
+gpac_memory_share(GstMemory* memory, gssize offset, gsize size)
+{
+  GpacMemory* mem = (GpacMemory*)memory;
+
+  // Find the real parent
+  GstMemory* parent = memory->parent ? memory->parent : memory;
+  if (size == (gsize)-1)
+    size = memory->size - offset;
+
+  GpacMemory* sub = g_new0(GpacMemory, 1);
+  sub->block = mem->block;
+  sub->block_size = mem->block_size;
+  sub->data = mem->data;
+
+  // The shared memory is always readonly
+  gst_memory_init(GST_MEMORY_CAST(sub),
+                  GST_MINI_OBJECT_FLAGS(parent) |
+                    GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+                  memory->allocator,
+                  parent,
+                  memory->maxsize,
+                  memory->align,
+                  memory->offset + offset,
+                  size);
+
+  return GST_MEMORY_CAST(sub);
+}
+
+// #MARK: Allocator
+static void
+gpac_allocator_finalize(GObject* object)
+{
+  GpacAllocator* self = (GpacAllocator*)object;
+
+  g_list_free_full(gpac_allocator_trim(self, G_MAXINT64),
+                   (GDestroyNotify)gpac_memory_free_block);
+  g_mutex_clear(&self->lock);
+
+  G_OBJECT_CLASS(gpac_allocator_parent_class)->finalize(object);
+}
+
+static void
+gpac_allocator_class_init(GpacAllocatorClass* klass)
+{
+  GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+  GstAllocatorClass* allocator_class = GST_ALLOCATOR_CLASS(klass);
+
+  gobject_class->finalize = gpac_allocator_finalize;
+  allocator_class->alloc = gpac_allocator_alloc;
+  allocator_class->free = gpac_allocator_free;
+}
+
+static void
+gpac_allocator_init(GpacAllocator* self)
+{
+  GstAllocator* allocator = GST_ALLOCATOR_CAST(self);
+
+  allocator->mem_type = GPAC_ALLOCATOR_NAME;
+  allocator->mem_map = gpac_memory_map;
+  allocator->mem_unmap = gpac_memory_unmap;
+  allocator->mem_share = gpac_memory_share;
+
+  g_mutex_init(&self->lock);
+  g_queue_init(&self->cache);
+}
+
+GstAllocator*
+gpac_allocator_get(void)
+{
+  if (g_once_init_enter(&gpac_allocator)) {
+    GstAllocator* created = g_object_new(gpac_allocator_get_type(), NULL);
+    gst_object_ref_sink(created);
+    GST_OBJECT_FLAG_SET(created, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+    g_once_init_leave(&gpac_allocator, created);
+  }
+
+  return gst_object_ref(gpac_allocator);
+}
+
+void
+gpac_allocator_acquire(void)
+{
+  g_autoptr(GstAllocator) allocator = gpac_allocator_get();
+  GpacAllocator* self = (GpacAllocator*)allocator;
+
+  g_mutex_lock(&self->lock);
+  self->users++;
+  g_mutex_unlock(&self->lock);
+}
+
+void
+gpac_allocator_release(void)
+{
+  g_autoptr(GstAllocator) allocator = gpac_allocator_get();
+  GpacAllocator* self = (GpacAllocator*)allocator;
+
+  // Nobody will ask for the cached blocks anymore
+  GList* trimmed = NULL;
+  g_mutex_lock(&self->lock);
+  g_assert(self->users > 0);
+  if (--self->users == 0)
+    trimmed = gpac_allocator_trim(self, G_MAXINT64);
+  g_mutex_unlock(&self->lock);
+
+  g_list_free_full(trimmed, (GDestroyNotify)gpac_memory_free_block);
+}
+
+// #MARK: Packets
+gboolean
+gpac_memory_attach(GstBuffer* buffer, const guint8** data, gsize* size)
+{
+  if (gst_buffer_n_memory(buffer) != 1)
+    return FALSE;
+
+  // Only whole memories are shared, so that the header can be found back
+  GstMemory* memory = gst_buffer_peek_memory(buffer, 0);
+  if (!memory->allocator ||
+      G_OBJECT_TYPE(memory->allocator) != gpac_allocator_get_type() ||
+      memory->parent || memory->offset != 0)
+    return FALSE;
+
+  // The same buffer may be pushed more than once, attach it only once
+  GpacMemory* mem = (GpacMemory*)memory;
+  GpacMemoryHeader* header = gpac_memory_header(mem->data);
+  GstBuffer* ref = gst_buffer_ref(buffer);
+  if (!g_atomic_pointer_compare_and_exchange(&header->owner, NULL, ref)) {
+    gst_buffer_unref(ref);
+    return FALSE;
+  }
+
+  *data = mem->data;
+  *size = memory->size;
+  return TRUE;
+}
+
+void
+gpac_memory_release(const guint8* data)
+{
+  GpacMemoryHeader* header = gpac_memory_header(data);
+
+  // Detach first, releasing the buffer may recycle the memory
+  GstBuffer* owner = g_atomic_pointer_get(&header->owner);
+  g_atomic_pointer_set(&header->owner, NULL);
+  if (owner)
+    gst_buffer_unref(owner);
+}
@@ -25,6 +25,7 @@
 
 #include "common.h"
 #include "gpacmessages.h"
+#include "lib/framing.h"
 #include "lib/pid.h"
 
 #define CAPS_HANDLER_SIGNATURE(prop_nickname)                    \
@@ -36,12 +37,10 @@
     return FALSE;                                                \
   }
 
-#define GET_MEDIA_AND_CODEC                                             \
-  GstStructure* structure = gst_caps_get_structure(priv->caps, 0);      \
-  const gchar* media_type_full = gst_structure_get_name(structure);     \
-  g_auto(GStrv) media_type_parts = g_strsplit(media_type_full, "/", 2); \
-  gchar* media = media_type_parts[0];                                   \
-  gchar* codec = media_type_parts[1];
+#define GET_CAPS_INFO                        \
+  const GpacCapsInfo* info = &priv->caps_info; \
+  const gchar* media = info->media;            \
+  const gchar* codec = info->codec;
 
 void
 gpac_push_capability(GpacPadPrivate* priv, u32 code, GF_PropertyValue* val)
@@ -78,7 +77,7 @@ DEFAULT_HANDLER(duration)
 //
 CAPS_HANDLER_SIGNATURE(stream_type)
 {
-  GET_MEDIA_AND_CODEC
+  GET_CAPS_INFO
 
   // Get the stream type
   u32 stream_type = gf_stream_type_by_name(media);
@@ -89,8 +88,8 @@ CAPS_HANDLER_SIGNATURE(stream_type)
   }
 
   // Check the subtype
-  if (!g_strcmp0(media, "video")) {
-    const gchar* subtype = gst_structure_get_string(structure, "stream-format");
+  if (info->kind == GPAC_MEDIA_KIND_VIDEO) {
+    const gchar* subtype = info->stream_format;
     if (!g_strcmp0(subtype, "avc") || !g_strcmp0(subtype, "hev1"))
       SET_PROP(GF_PROP_PID_ISOM_SUBTYPE, PROP_STRING(subtype));
   }
@@ -105,14 +104,14 @@ CAPS_HANDLER_SIGNATURE(stream_type)
 
 CAPS_HANDLER_SIGNATURE(codec_id)
 {
-  GET_MEDIA_AND_CODEC
+  GET_CAPS_INFO
   GF_CodecID codec_id = GF_CODECID_NONE;
 
   // In most cases the substring after "x-" can be used to query the codec id
   if (g_str_has_prefix(codec, "x-")) {
     size_t offset = 2;
     // Subtitle doesn't have "raw" codec
-    if (!g_strcmp0(media, "text") && !g_strcmp0(codec, "x-raw")) {
+    if (info->kind == GPAC_MEDIA_KIND_TEXT && !g_strcmp0(codec, "x-raw")) {
       codec_id = GF_CODECID_SIMPLE_TEXT;
       goto finish;
     }
@@ -124,7 +123,7 @@ CAPS_HANDLER_SIGNATURE(codec_id)
 
   // See caps.h for the supported formats
   // For the other cases, we will match the codec id manually
-  if (!g_strcmp0(media, "audio")) {
+  if (info->kind == GPAC_MEDIA_KIND_AUDIO) {
     if (!g_strcmp0(codec, "mpeg"))
       codec_id = GF_CODECID_AAC_MPEG4;
   }
@@ -150,22 +149,21 @@ finish:
 
 CAPS_HANDLER_SIGNATURE(unframed)
 {
-  GET_MEDIA_AND_CODEC
+  GET_CAPS_INFO
 
-  const gchar* stream_format =
-    gst_structure_get_string(structure, "stream-format");
+  const gchar* stream_format = info->stream_format;
 
   // Check if the stream is framed
   gboolean framed = TRUE;
-  if (!g_strcmp0(media, "video")) {
+  if (info->kind == GPAC_MEDIA_KIND_VIDEO) {
     if (stream_format) {
       if (!g_strcmp0(stream_format, "byte-stream") ||
           !g_strcmp0(stream_format, "obu-stream"))
         framed = FALSE;
     }
-  } else if (!g_strcmp0(media, "audio")) {
-    gst_structure_get_boolean(structure, "framed", &framed);
-  } else if (!g_strcmp0(media, "text")) {
+  } else if (info->kind == GPAC_MEDIA_KIND_AUDIO) {
+    framed = info->framed;
+  } else if (info->kind == GPAC_MEDIA_KIND_TEXT) {
     // For text media we assume unframed data
     framed = FALSE;
   }
@@ -174,6 +172,13 @@ CAPS_HANDLER_SIGNATURE(unframed)
   //* So we'll always have unframed data. But for maximum compatibility, we may
   //* allow framed data and explicitly load "unframer" in gpac.
 
+  // Streams already aligned to access units may skip the reframers
+  priv->annexb_to_length = FALSE;
+  if (!framed && priv->framed_input && gpac_framing_is_aligned(info)) {
+    priv->annexb_to_length = TRUE;
+    framed = TRUE;
+  }
+
   // Push the caps with the unframed property
   gpac_push_capability(priv, GF_PROP_PID_UNFRAMED, &PROP_BOOL(!framed));
 
@@ -184,14 +189,13 @@ CAPS_HANDLER_SIGNATURE(unframed)
 
 CAPS_HANDLER_SIGNATURE(width)
 {
-  GET_MEDIA_AND_CODEC
+  GET_CAPS_INFO
 
   // Only process video media
-  if (g_strcmp0(media, "video"))
+  if (info->kind != GPAC_MEDIA_KIND_VIDEO)
     return TRUE;
 
-  gint width = -1;
-  gst_structure_get_int(structure, "width", &width);
+  gint width = info->width;
   if (width <= 0) {
     GST_ELEMENT_ERROR(element, LIBRARY, FAILED, (NULL), ("Invalid width"));
     return FALSE;
@@ -204,14 +208,13 @@ CAPS_HANDLER_SIGNATURE(width)
 
 CAPS_HANDLER_SIGNATURE(height)
 {
-  GET_MEDIA_AND_CODEC
+  GET_CAPS_INFO
 
   // Only process video media
-  if (g_strcmp0(media, "video"))
+  if (info->kind != GPAC_MEDIA_KIND_VIDEO)
     return TRUE;
 
-  gint height = -1;
-  gst_structure_get_int(structure, "height", &height);
+  gint height = info->height;
   if (height <= 0) {
     GST_ELEMENT_ERROR(element, LIBRARY, FAILED, (NULL), ("Invalid height"));
     return FALSE;
@@ -224,14 +227,13 @@ CAPS_HANDLER_SIGNATURE(height)
 
 CAPS_HANDLER_SIGNATURE(sample_rate)
 {
-  GET_MEDIA_AND_CODEC
+  GET_CAPS_INFO
 
   // Only process audio media
-  if (g_strcmp0(media, "audio"))
+  if (info->kind != GPAC_MEDIA_KIND_AUDIO)
     return TRUE;
 
-  gint rate = -1;
-  gst_structure_get_int(structure, "rate", &rate);
+  gint rate = info->rate;
   if (rate <= 0) {
     GST_ELEMENT_ERROR(
       element, LIBRARY, FAILED, (NULL), ("Invalid sample rate"));
@@ -245,14 +247,13 @@ CAPS_HANDLER_SIGNATURE(sample_rate)
 
 CAPS_HANDLER_SIGNATURE(fps)
 {
-  GET_MEDIA_AND_CODEC
+  GET_CAPS_INFO
 
   // Only process video media
-  if (g_strcmp0(media, "video"))
+  if (info->kind != GPAC_MEDIA_KIND_VIDEO)
     return TRUE;
 
-  gint num = -1, denom = -1;
-  gst_structure_get_fraction(structure, "framerate", &num, &denom);
+  gint num = info->fps_num, denom = info->fps_den;
   if (num < 0 || denom < 0)
     return FALSE;
 
@@ -263,20 +264,20 @@ CAPS_HANDLER_SIGNATURE(fps)
 
 CAPS_HANDLER_SIGNATURE(timescale)
 {
-  GET_MEDIA_AND_CODEC
+  GET_CAPS_INFO
 
   guint64 timescale = 0;
-  if (!g_strcmp0(media, "video")) {
+  if (info->kind == GPAC_MEDIA_KIND_VIDEO) {
     const GF_PropertyValue* p =
       gf_filter_pid_get_property(pid, GF_PROP_PID_FPS);
     if (p)
       timescale = p->value.frac.num;
-  } else if (!g_strcmp0(media, "audio")) {
+  } else if (info->kind == GPAC_MEDIA_KIND_AUDIO) {
     const GF_PropertyValue* p =
       gf_filter_pid_get_property(pid, GF_PROP_PID_SAMPLE_RATE);
     if (p)
       timescale = p->value.uint;
-  } else if (!g_strcmp0(media, "text")) {
+  } else if (info->kind == GPAC_MEDIA_KIND_TEXT) {
     // For text media we can use a default timescale
     timescale = 1000;
   } else {
@@ -298,14 +299,13 @@ CAPS_HANDLER_SIGNATURE(timescale)
 
 CAPS_HANDLER_SIGNATURE(num_channels)
 {
-  GET_MEDIA_AND_CODEC
+  GET_CAPS_INFO
 
   // Only process audio media
-  if (g_strcmp0(media, "audio"))
+  if (info->kind != GPAC_MEDIA_KIND_AUDIO)
     return TRUE;
 
-  gint channels = -1;
-  gst_structure_get_int(structure, "channels", &channels);
+  gint channels = info->channels;
 
   // Set the number of channels property
   SET_PROP(GF_PROP_PID_NUM_CHANNELS, PROP_UINT(channels));
@@ -316,14 +316,11 @@ CAPS_HANDLER_SIGNATURE(decoder_config)
 {
   SKIP_IF_SET(GF_PROP_PID_DECODER_CONFIG);
 
-  GstStructure* structure = gst_caps_get_structure(priv->caps, 0);
-
   // Get the codec data
-  const GValue* codec_data = gst_structure_get_value(structure, "codec_data");
-  if (!GST_VALUE_HOLDS_BUFFER(codec_data))
+  GstBuffer* buffer = priv->caps_info.codec_data;
+  if (!buffer)
     return TRUE;
 
-  GstBuffer* buffer = gst_value_get_buffer(codec_data);
   g_auto(GstBufferMapInfo) map = GST_MAP_INFO_INIT;
   if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
     GST_ELEMENT_ERROR(
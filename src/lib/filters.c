@@ -0,0 +1,312 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "lib/filters.h"
+#include "lib/main.h"
+
+#define GPAC_REGISTRY_CACHE_ENV "GST_GPAC_REGISTRY_CACHE"
+#define GPAC_REGISTRY_GROUP "registry"
+
+typedef struct
+{
+  gchar sep_list;
+  GHashTable* filters; // name -> GPAC_FilterInfo*
+} GPAC_FilterRegistry;
+
+static GPAC_FilterRegistry* registry = NULL;
+
+// #MARK: Snapshot
+static void
+gpac_filter_info_free(gpointer data)
+{
+  GPAC_FilterInfo* info = (GPAC_FilterInfo*)data;
+  for (guint i = 0; i < info->num_args; i++) {
+    g_free(info->args[i].name);
+    g_free(info->args[i].description);
+    g_free(info->args[i].default_value);
+    g_free(info->args[i].min_max_enum);
+  }
+  g_free(info->args);
+  g_free(info->name);
+  g_free(info);
+}
+
+static GPAC_FilterRegistry*
+gpac_filter_registry_new(void)
+{
+  GPAC_FilterRegistry* reg = g_new0(GPAC_FilterRegistry, 1);
+  reg->filters = g_hash_table_new_full(
+    g_str_hash, g_str_equal, NULL, gpac_filter_info_free);
+  return reg;
+}
+
+static void
+gpac_filter_registry_free(GPAC_FilterRegistry* reg)
+{
+  g_hash_table_destroy(reg->filters);
+  g_free(reg);
+}
+
+static GPAC_FilterRegistry*
+gpac_filter_registry_snapshot(void)
+{
+  if (!gpac_runtime_acquire())
+    return NULL;
+
+  GF_FilterSession* session = gf_fs_new_defaults(0U);
+  if (!session) {
+    gpac_runtime_release();
+    return NULL;
+  }
+
+  GPAC_FilterRegistry* reg = gpac_filter_registry_new();
+
+  // Get the list separator
+  GF_Err e;
+  GF_Filter* dummy = gf_fs_new_filter(session, "dummy", 0, &e);
+  reg->sep_list = (gchar)gf_filter_get_sep(dummy, GF_FS_SEP_LIST);
+
+  // Copy the registers, they may not outlive the session
+  guint num_filters = gf_fs_filters_registers_count(session);
+  for (guint i = 0; i < num_filters; i++) {
+    const GF_FilterRegister* freg = gf_fs_get_filter_register(session, i);
+    if (!freg || !freg->name ||
+        g_hash_table_contains(reg->filters, freg->name))
+      continue;
+
+    GPAC_FilterInfo* info = g_new0(GPAC_FilterInfo, 1);
+    info->name = g_strdup(freg->name);
+    while (freg->args && freg->args[info->num_args].arg_name)
+      info->num_args++;
+
+    info->args = g_new0(GPAC_FilterArg, info->num_args);
+    for (guint j = 0; j < info->num_args; j++) {
+      const GF_FilterArgs* arg = &freg->args[j];
+      info->args[j].name = g_strdup(arg->arg_name);
+      info->args[j].description = g_strdup(arg->arg_desc);
+      info->args[j].type = arg->arg_type;
+      info->args[j].default_value = g_strdup(arg->arg_default_val);
+      info->args[j].min_max_enum = g_strdup(arg->min_max_enum);
+      info->args[j].flags = arg->flags;
+    }
+
+    g_hash_table_insert(reg->filters, info->name, info);
+  }
+
+  gf_fs_del(session);
+  gpac_runtime_release();
+  return reg;
+}
+
+// #MARK: Disk Cache
+static gchar*
+gpac_filter_registry_cache_path(void)
+{
+  const gchar* dir = g_getenv(GPAC_REGISTRY_CACHE_ENV);
+  if (!dir || !*dir)
+    return NULL;
+
+  // Key the cache by the GPAC version, registers change between builds
+  g_autofree gchar* version = g_strdup(gf_gpac_version());
+  g_strcanon(version, G_CSET_A_2_Z G_CSET_a_2_z G_CSET_DIGITS ".-_", '_');
+  g_autofree gchar* name = g_strdup_printf("gpac-filters-%s-abi%u.%u.ini",
+                                           version,
+                                           gf_gpac_abi_major(),
+                                           gf_gpac_abi_minor());
+  return g_build_filename(dir, name, NULL);
+}
+
+static GPAC_FilterRegistry*
+gpac_filter_registry_load(const gchar* path)
+{
+  g_autoptr(GKeyFile) kf = g_key_file_new();
+  if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, NULL))
+    return NULL;
+
+  g_autofree gchar* sep =
+    g_key_file_get_string(kf, GPAC_REGISTRY_GROUP, "sep-list", NULL);
+  if (!sep || strlen(sep) != 1)
+    return NULL;
+
+  GPAC_FilterRegistry* reg = gpac_filter_registry_new();
+  reg->sep_list = sep[0];
+
+  gsize num_groups = 0;
+  g_auto(GStrv) groups = g_key_file_get_groups(kf, &num_groups);
+  for (gsize i = 0; i < num_groups; i++) {
+    if (!g_strcmp0(groups[i], GPAC_REGISTRY_GROUP))
+      continue;
+
+    gsize n_names = 0, n_descs = 0, n_types = 0, n_defs = 0, n_defs_set = 0,
+          n_enums = 0, n_enums_set = 0, n_flags = 0;
+    g_auto(GStrv) names =
+      g_key_file_get_string_list(kf, groups[i], "names", &n_names, NULL);
+    g_auto(GStrv) descs =
+      g_key_file_get_string_list(kf, groups[i], "descriptions", &n_descs, NULL);
+    g_autofree gint* types =
+      g_key_file_get_integer_list(kf, groups[i], "types", &n_types, NULL);
+    g_auto(GStrv) defs =
+      g_key_file_get_string_list(kf, groups[i], "defaults", &n_defs, NULL);
+    g_autofree gboolean* defs_set = g_key_file_get_boolean_list(
+      kf, groups[i], "defaults-set", &n_defs_set, NULL);
+    g_auto(GStrv) enums =
+      g_key_file_get_string_list(kf, groups[i], "enums", &n_enums, NULL);
+    g_autofree gboolean* enums_set = g_key_file_get_boolean_list(
+      kf, groups[i], "enums-set", &n_enums_set, NULL);
+    g_autofree gint* flags =
+      g_key_file_get_integer_list(kf, groups[i], "flags", &n_flags, NULL);
+
+    // Discard the cache if it is inconsistent
+    if (n_names != n_descs || n_names != n_types || n_names != n_defs ||
+        n_names != n_defs_set || n_names != n_enums ||
+        n_names != n_enums_set || n_names != n_flags) {
+      gpac_filter_registry_free(reg);
+      return NULL;
+    }
+
+    GPAC_FilterInfo* info = g_new0(GPAC_FilterInfo, 1);
+    info->name = g_strdup(groups[i]);
+    info->num_args = (guint)n_names;
+    info->args = g_new0(GPAC_FilterArg, info->num_args);
+    for (guint j = 0; j < info->num_args; j++) {
+      info->args[j].name = g_strdup(names[j]);
+      info->args[j].description = g_strdup(descs[j]);
+      info->args[j].type = (GF_PropType)types[j];
+      info->args[j].default_value = defs_set[j] ? g_strdup(defs[j]) : NULL;
+      info->args[j].min_max_enum = enums_set[j] ? g_strdup(enums[j]) : NULL;
+      info->args[j].flags = (guint32)flags[j];
+    }
+    g_hash_table_insert(reg->filters, info->name, info);
+  }
+
+  return reg;
+}
+
+static void
+gpac_filter_registry_save(GPAC_FilterRegistry* reg, const gchar* path)
+{
+  g_autoptr(GKeyFile) kf = g_key_file_new();
+  gchar sep[2] = { reg->sep_list, '\0' };
+  g_key_file_set_string(kf, GPAC_REGISTRY_GROUP, "sep-list", sep);
+
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, reg->filters);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    GPAC_FilterInfo* info = (GPAC_FilterInfo*)value;
+    gsize n = info->num_args;
+
+    g_autofree const gchar** names = g_new0(const gchar*, n + 1);
+    g_autofree const gchar** descs = g_new0(const gchar*, n + 1);
+    g_autofree const gchar** defs = g_new0(const gchar*, n + 1);
+    g_autofree const gchar** enums = g_new0(const gchar*, n + 1);
+    g_autofree gint* types = g_new0(gint, n + 1);
+    g_autofree gint* flags = g_new0(gint, n + 1);
+    g_autofree gboolean* defs_set = g_new0(gboolean, n + 1);
+    g_autofree gboolean* enums_set = g_new0(gboolean, n + 1);
+
+    for (gsize j = 0; j < n; j++) {
+      GPAC_FilterArg* arg = &info->args[j];
+      names[j] = arg->name;
+      descs[j] = arg->description ? arg->description : "";
+      defs[j] = arg->default_value ? arg->default_value : "";
+      enums[j] = arg->min_max_enum ? arg->min_max_enum : "";
+      types[j] = (gint)arg->type;
+      flags[j] = (gint)arg->flags;
+      defs_set[j] = arg->default_value != NULL;
+      enums_set[j] = arg->min_max_enum != NULL;
+    }
+
+    g_key_file_set_string_list(
+      kf, info->name, "names", (const gchar* const*)names, n);
+    g_key_file_set_string_list(
+      kf, info->name, "descriptions", (const gchar* const*)descs, n);
+    g_key_file_set_integer_list(kf, info->name, "types", types, n);
+    g_key_file_set_string_list(
+      kf, info->name, "defaults", (const gchar* const*)defs, n);
+    g_key_file_set_boolean_list(kf, info->name, "defaults-set", defs_set, n);
+    g_key_file_set_string_list(
+      kf, info->name, "enums", (const gchar* const*)enums, n);
+    g_key_file_set_boolean_list(kf, info->name, "enums-set", enums_set, n);
+    g_key_file_set_integer_list(kf, info->name, "flags", flags, n);
+  }
+
+  // Failing to persist the cache is not fatal
+  g_autofree gchar* dir = g_path_get_dirname(path);
+  g_mkdir_with_parents(dir, 0755);
+  g_autoptr(GError) error = NULL;
+  if (!g_key_file_save_to_file(kf, path, &error))
+    GST_WARNING("Failed to save GPAC filter registry cache to %s: %s",
+                path,
+                error->message);
+}
+
+// #MARK: Public API
+static gpointer
+gpac_filter_registry_build(gpointer data)
+{
+  g_autofree gchar* path = gpac_filter_registry_cache_path();
+
+  // Try the on-disk cache first
+  if (path) {
+    registry = gpac_filter_registry_load(path);
+    if (registry) {
+      GST_DEBUG("Loaded GPAC filter registry from %s", path);
+      return GINT_TO_POINTER(TRUE);
+    }
+  }
+
+  registry = gpac_filter_registry_snapshot();
+  if (!registry)
+    return GINT_TO_POINTER(FALSE);
+
+  if (path)
+    gpac_filter_registry_save(registry, path);
+  return GINT_TO_POINTER(TRUE);
+}
+
+gboolean
+gpac_filter_registry_init(void)
+{
+  static GOnce once = G_ONCE_INIT;
+  return GPOINTER_TO_INT(g_once(&once, gpac_filter_registry_build, NULL));
+}
+
+const GPAC_FilterInfo*
+gpac_filter_registry_lookup(const gchar* filter_name)
+{
+  if (!gpac_filter_registry_init())
+    return NULL;
+  return (const GPAC_FilterInfo*)g_hash_table_lookup(registry->filters,
+                                                     filter_name);
+}
+
+gchar
+gpac_filter_registry_get_list_sep(void)
+{
+  if (!gpac_filter_registry_init())
+    return GF_FS_DEFAULT_SEPS[GF_FS_SEP_LIST];
+  return registry->sep_list;
+}
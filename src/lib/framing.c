@@ -0,0 +1,416 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "lib/framing.h"
+#include "gpacmessages.h"
+#include "lib/memio.h"
+#include <gpac/bitstream.h>
+#include <gpac/mpeg4_odf.h>
+
+typedef struct
+{
+  const guint8* data;
+  u32 size;
+  u8 type;
+} GpacNalu;
+
+// #MARK: Annex B parsing
+static void
+gpac_framing_push(GArray* nalus,
+                  const guint8* start,
+                  const guint8* end,
+                  gboolean is_hevc)
+{
+  // Trailing zero bytes belong to the next start code
+  while (end > start && end[-1] == 0)
+    end--;
+  if (end == start)
+    return;
+
+  GpacNalu nalu = { start, (u32)(end - start), 0 };
+  nalu.type = is_hevc ? (start[0] >> 1) & 0x3F : start[0] & 0x1F;
+  g_array_append_val(nalus, nalu);
+}
+
+static void
+gpac_framing_split(const guint8* data,
+                   gsize size,
+                   gboolean is_hevc,
+                   GArray* nalus)
+{
+  const guint8* end = data + size;
+  const guint8* nal = NULL;
+  const guint8* p = data;
+
+  // Look for 00 00 01, skipping ahead when the third byte rules it out
+  while (p + 3 <= end) {
+    if (p[2] > 1) {
+      p += 3;
+    } else if (p[2] == 0) {
+      p++;
+    } else if (p[0] != 0 || p[1] != 0) {
+      p += 3;
+    } else {
+      if (nal)
+        gpac_framing_push(nalus, nal, p, is_hevc);
+      p += 3;
+      nal = p;
+    }
+  }
+
+  if (nal)
+    gpac_framing_push(nalus, nal, end, is_hevc);
+}
+
+static gboolean
+gpac_framing_is_param_set(const GpacNalu* nalu, gboolean is_hevc)
+{
+  if (is_hevc)
+    return nalu->type == GF_HEVC_NALU_VID_PARAM ||
+           nalu->type == GF_HEVC_NALU_SEQ_PARAM ||
+           nalu->type == GF_HEVC_NALU_PIC_PARAM;
+  return nalu->type == GF_AVC_NALU_SEQ_PARAM ||
+         nalu->type == GF_AVC_NALU_PIC_PARAM ||
+         nalu->type == GF_AVC_NALU_SEQ_PARAM_EXT;
+}
+
+static gboolean
+gpac_framing_is_delimiter(const GpacNalu* nalu, gboolean is_hevc)
+{
+  if (is_hevc)
+    return nalu->type == GF_HEVC_NALU_ACCESS_UNIT;
+  return nalu->type == GF_AVC_NALU_ACCESS_UNIT;
+}
+
+// #MARK: Decoder configuration
+static u32
+gpac_framing_read_ue(GF_BitStream* bs)
+{
+  u32 zeros = 0;
+  while (gf_bs_available(bs) && !gf_bs_read_int(bs, 1) && zeros < 31)
+    zeros++;
+  if (!zeros)
+    return 0;
+  return (1u << zeros) - 1 + gf_bs_read_int(bs, zeros);
+}
+
+static void
+gpac_framing_add_param(GF_List* list, const GpacNalu* nalu)
+{
+  GF_NALUFFParam* param;
+  GF_SAFEALLOC(param, GF_NALUFFParam);
+  if (!param)
+    return;
+  param->size = nalu->size;
+  param->data = gf_malloc(nalu->size);
+  memcpy(param->data, nalu->data, nalu->size);
+  gf_list_add(list, param);
+}
+
+static void
+gpac_framing_parse_avc_sps(const GpacNalu* sps, GF_AVCConfig* cfg)
+{
+  if (sps->size < 4)
+    return;
+
+  cfg->AVCProfileIndication = sps->data[1];
+  cfg->profile_compatibility = sps->data[2];
+  cfg->AVCLevelIndication = sps->data[3];
+
+  // Only the high profiles signal the chroma format and bit depths
+  switch (cfg->AVCProfileIndication) {
+    case 44:
+    case 83:
+    case 86:
+    case 100:
+    case 110:
+    case 118:
+    case 122:
+    case 128:
+    case 134:
+    case 135:
+    case 138:
+    case 139:
+    case 244:
+      break;
+    default:
+      return;
+  }
+
+  GF_BitStream* bs =
+    gf_bs_new(sps->data + 4, sps->size - 4, GF_BITSTREAM_READ);
+  gf_bs_enable_emulation_byte_removal(bs, GF_TRUE);
+  gpac_framing_read_ue(bs); // seq_parameter_set_id
+  cfg->chroma_format = gpac_framing_read_ue(bs);
+  if (cfg->chroma_format == 3)
+    gf_bs_read_int(bs, 1); // separate_colour_plane_flag
+  cfg->luma_bit_depth = 8 + gpac_framing_read_ue(bs);
+  cfg->chroma_bit_depth = 8 + gpac_framing_read_ue(bs);
+  gf_bs_del(bs);
+}
+
+static void
+gpac_framing_parse_hevc_sps(const GpacNalu* sps, GF_HEVCConfig* cfg)
+{
+  if (sps->size < 15)
+    return;
+
+  GF_BitStream* bs =
+    gf_bs_new(sps->data + 2, sps->size - 2, GF_BITSTREAM_READ);
+  gf_bs_enable_emulation_byte_removal(bs, GF_TRUE);
+
+  gf_bs_read_int(bs, 4); // sps_video_parameter_set_id
+  u32 max_sub_layers_minus1 = gf_bs_read_int(bs, 3);
+  cfg->numTemporalLayers = max_sub_layers_minus1 + 1;
+  cfg->temporalIdNested = gf_bs_read_int(bs, 1);
+
+  // General profile, tier and level
+  cfg->profile_space = gf_bs_read_int(bs, 2);
+  cfg->tier_flag = gf_bs_read_int(bs, 1);
+  cfg->profile_idc = gf_bs_read_int(bs, 5);
+  cfg->general_profile_compatibility_flags = gf_bs_read_int(bs, 32);
+  cfg->progressive_source_flag = gf_bs_read_int(bs, 1);
+  cfg->interlaced_source_flag = gf_bs_read_int(bs, 1);
+  cfg->non_packed_constraint_flag = gf_bs_read_int(bs, 1);
+  cfg->frame_only_constraint_flag = gf_bs_read_int(bs, 1);
+  cfg->constraint_indicator_flags = gf_bs_read_long_int(bs, 44);
+  cfg->level_idc = gf_bs_read_int(bs, 8);
+
+  // Sub-layer profiles and levels are not carried in the configuration
+  gboolean profile_present[8] = { 0 }, level_present[8] = { 0 };
+  for (u32 i = 0; i < max_sub_layers_minus1; i++) {
+    profile_present[i] = gf_bs_read_int(bs, 1);
+    level_present[i] = gf_bs_read_int(bs, 1);
+  }
+  if (max_sub_layers_minus1 > 0) {
+    for (u32 i = max_sub_layers_minus1; i < 8; i++)
+      gf_bs_read_int(bs, 2);
+  }
+  for (u32 i = 0; i < max_sub_layers_minus1; i++) {
+    if (profile_present[i]) {
+      gf_bs_read_long_int(bs, 56);
+      gf_bs_read_int(bs, 32);
+    }
+    if (level_present[i])
+      gf_bs_read_int(bs, 8);
+  }
+
+  gpac_framing_read_ue(bs); // sps_seq_parameter_set_id
+  cfg->chromaFormat = gpac_framing_read_ue(bs);
+  if (cfg->chromaFormat == 3)
+    gf_bs_read_int(bs, 1); // separate_colour_plane_flag
+  gpac_framing_read_ue(bs); // pic_width_in_luma_samples
+  gpac_framing_read_ue(bs); // pic_height_in_luma_samples
+  if (gf_bs_read_int(bs, 1)) {
+    // Conformance window offsets
+    for (u32 i = 0; i < 4; i++)
+      gpac_framing_read_ue(bs);
+  }
+  cfg->luma_bit_depth = 8 + gpac_framing_read_ue(bs);
+  cfg->chroma_bit_depth = 8 + gpac_framing_read_ue(bs);
+  gf_bs_del(bs);
+}
+
+static void
+gpac_framing_avc_config(GArray* nalus, u8** dsi, u32* dsi_size)
+{
+  GF_AVCConfig* cfg = gf_odf_avc_cfg_new();
+  cfg->configurationVersion = 1;
+  cfg->nal_unit_size = 4;
+  cfg->chroma_format = 1;
+  cfg->luma_bit_depth = 8;
+  cfg->chroma_bit_depth = 8;
+
+  for (guint i = 0; i < nalus->len; i++) {
+    const GpacNalu* nalu = &g_array_index(nalus, GpacNalu, i);
+    switch (nalu->type) {
+      case GF_AVC_NALU_SEQ_PARAM:
+        if (!gf_list_count(cfg->sequenceParameterSets))
+          gpac_framing_parse_avc_sps(nalu, cfg);
+        gpac_framing_add_param(cfg->sequenceParameterSets, nalu);
+        break;
+      case GF_AVC_NALU_PIC_PARAM:
+        gpac_framing_add_param(cfg->pictureParameterSets, nalu);
+        break;
+      case GF_AVC_NALU_SEQ_PARAM_EXT:
+        if (!cfg->sequenceParameterSetExtensions)
+          cfg->sequenceParameterSetExtensions = gf_list_new();
+        gpac_framing_add_param(cfg->sequenceParameterSetExtensions, nalu);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Only write complete configurations
+  if (gf_list_count(cfg->sequenceParameterSets) &&
+      gf_list_count(cfg->pictureParameterSets))
+    gf_odf_avc_cfg_write(cfg, dsi, dsi_size);
+  gf_odf_avc_cfg_del(cfg);
+}
+
+static void
+gpac_framing_hevc_config(GArray* nalus, u8** dsi, u32* dsi_size)
+{
+  static const u8 types[] = { GF_HEVC_NALU_VID_PARAM,
+                              GF_HEVC_NALU_SEQ_PARAM,
+                              GF_HEVC_NALU_PIC_PARAM };
+  GF_HEVCConfig* cfg = gf_odf_hevc_cfg_new();
+  cfg->configurationVersion = 1;
+  cfg->nal_unit_size = 4;
+  cfg->chromaFormat = 1;
+  cfg->luma_bit_depth = 8;
+  cfg->chroma_bit_depth = 8;
+
+  // One array per parameter set type, in the order hvcC expects
+  gboolean complete = TRUE;
+  for (guint t = 0; t < G_N_ELEMENTS(types); t++) {
+    GF_NALUFFParamArray* ar;
+    GF_SAFEALLOC(ar, GF_NALUFFParamArray);
+    if (!ar) {
+      complete = FALSE;
+      break;
+    }
+    ar->array_completeness = 1;
+    ar->type = types[t];
+    ar->nalus = gf_list_new();
+    gf_list_add(cfg->param_array, ar);
+
+    for (guint i = 0; i < nalus->len; i++) {
+      const GpacNalu* nalu = &g_array_index(nalus, GpacNalu, i);
+      if (nalu->type != types[t])
+        continue;
+      if (nalu->type == GF_HEVC_NALU_SEQ_PARAM && !gf_list_count(ar->nalus))
+        gpac_framing_parse_hevc_sps(nalu, cfg);
+      gpac_framing_add_param(ar->nalus, nalu);
+    }
+    complete &= gf_list_count(ar->nalus) > 0;
+  }
+
+  // Only write complete configurations
+  if (complete)
+    gf_odf_hevc_cfg_write(cfg, dsi, dsi_size);
+  gf_odf_hevc_cfg_del(cfg);
+}
+
+static void
+gpac_framing_update_config(GpacPadPrivate* priv,
+                           GF_FilterPid* pid,
+                           GArray* nalus,
+                           gboolean is_hevc)
+{
+  u8* dsi = NULL;
+  u32 dsi_size = 0;
+  if (is_hevc)
+    gpac_framing_hevc_config(nalus, &dsi, &dsi_size);
+  else
+    gpac_framing_avc_config(nalus, &dsi, &dsi_size);
+
+  if (!dsi) {
+    GST_DEBUG_OBJECT(priv->self, "Incomplete parameter sets, keeping config");
+    return;
+  }
+
+  // Unchanged parameter sets leave the pid untouched
+  GF_Err e = gpac_pid_set_property(
+    pid, GF_PROP_PID_DECODER_CONFIG, &PROP_DATA(dsi, dsi_size));
+  if (e != GF_OK)
+    GST_WARNING_OBJECT(priv->self,
+                       "Failed to update the decoder config: %s",
+                       gf_error_to_string(e));
+  gf_free(dsi);
+}
+
+static void
+gpac_framing_destructor(GF_Filter* filter,
+                        GF_FilterPid* pid,
+                        GF_FilterPacket* pck)
+{
+  gpac_memio_untrack_packet(filter, pck);
+}
+
+// #MARK: Public API
+gboolean
+gpac_framing_is_aligned(const GpacCapsInfo* info)
+{
+  if (info->kind != GPAC_MEDIA_KIND_VIDEO)
+    return FALSE;
+
+  // AV1 still needs its temporal delimiters stripped and an av1C built, so
+  // it goes through the reframer
+  if (g_strcmp0(info->stream_format, "byte-stream"))
+    return FALSE;
+
+  gboolean is_nalu =
+    !g_strcmp0(info->codec, "x-h264") || !g_strcmp0(info->codec, "x-h265");
+  return is_nalu && !g_strcmp0(info->alignment, "au");
+}
+
+GF_FilterPacket*
+gpac_framing_new_packet(GpacPadPrivate* priv,
+                        GF_FilterPid* pid,
+                        const guint8* data,
+                        gsize size)
+{
+  gboolean is_hevc = !g_strcmp0(priv->caps_info.codec, "x-h265");
+  GArray* nalus = g_array_new(FALSE, FALSE, sizeof(GpacNalu));
+  gpac_framing_split(data, size, is_hevc, nalus);
+
+  // Size the output, parameter sets and delimiters are left out
+  u32 out_size = 0;
+  gboolean has_param_sets = FALSE;
+  for (guint i = 0; i < nalus->len; i++) {
+    const GpacNalu* nalu = &g_array_index(nalus, GpacNalu, i);
+    if (gpac_framing_is_param_set(nalu, is_hevc))
+      has_param_sets = TRUE;
+    else if (!gpac_framing_is_delimiter(nalu, is_hevc))
+      out_size += 4 + nalu->size;
+  }
+
+  if (has_param_sets)
+    gpac_framing_update_config(priv, pid, nalus, is_hevc);
+
+  u8* output = NULL;
+  GF_FilterPacket* packet = gf_filter_pck_new_alloc_destructor(
+    pid, out_size, &output, gpac_framing_destructor);
+  if (!packet)
+    goto finish;
+
+  // Replace the start codes with 4-byte length prefixes
+  for (guint i = 0; i < nalus->len; i++) {
+    const GpacNalu* nalu = &g_array_index(nalus, GpacNalu, i);
+    if (gpac_framing_is_param_set(nalu, is_hevc) ||
+        gpac_framing_is_delimiter(nalu, is_hevc))
+      continue;
+
+    GST_WRITE_UINT32_BE(output, nalu->size);
+    memcpy(output + 4, nalu->data, nalu->size);
+    output += 4 + nalu->size;
+  }
+
+finish:
+  g_array_unref(nalus);
+  return packet;
+}
@@ -26,6 +26,23 @@
 #include "lib/main.h"
 #include "gpacmessages.h"
 
+// #MARK: Runtime
+/*
+ * The GPAC runtime (gf_sys_init/gf_sys_close) is process-wide. It is shared by
+ * every element in the process and only torn down when the last user releases
+ * it. Since gf_sys_close is expensive and invalidates every live session, it
+ * must not be called while another element is still running.
+ */
+static GMutex gpac_runtime_lock;
+static guint gpac_runtime_refcount = 0;
+
+/*
+ * GPAC has a single global log callback. Sessions are created non-blocking and
+ * only ever run on the thread that drives them, so the element owning the
+ * session being driven is tracked per thread and used as the log target.
+ */
+static GPrivate gpac_log_target = G_PRIVATE_INIT(NULL);
+
 static void
 gpac_log_callback(void* cbck,
                   GF_LOG_Level log_level,
@@ -43,7 +60,7 @@ gpac_log_callback(void* cbck,
     }
   }
 
-  GstElement* element = (GstElement*)cbck;
+  GstElement* element = (GstElement*)g_private_get(&gpac_log_target);
 
   char msg[1024];
   vsnprintf(msg, sizeof(msg), fmt, vlist);
@@ -71,16 +88,49 @@ gpac_log_callback(void* cbck,
 }
 
 gboolean
-gpac_init(GPAC_Context* ctx, GstElement* element)
+gpac_runtime_acquire(void)
 {
-  gpac_return_val_if_fail(gf_sys_init(GF_MemTrackerNone, NULL), FALSE);
-  gf_log_set_callback(element, gpac_log_callback);
-  gf_log_set_tools_levels("all@debug", GF_TRUE);
+  g_mutex_lock(&gpac_runtime_lock);
+  if (gpac_runtime_refcount == 0) {
+    if (gf_sys_init(GF_MemTrackerNone, NULL) != GF_OK) {
+      g_mutex_unlock(&gpac_runtime_lock);
+      return FALSE;
+    }
+    gf_log_set_callback(NULL, gpac_log_callback);
+    gf_log_set_tools_levels("all@debug", GF_TRUE);
+  }
+  gpac_runtime_refcount++;
+  g_mutex_unlock(&gpac_runtime_lock);
   return TRUE;
 }
 
+void
+gpac_runtime_release(void)
+{
+  g_mutex_lock(&gpac_runtime_lock);
+  g_assert(gpac_runtime_refcount > 0);
+  if (--gpac_runtime_refcount == 0)
+    gf_sys_close();
+  g_mutex_unlock(&gpac_runtime_lock);
+}
+
+GstElement*
+gpac_log_set_target(GstElement* element)
+{
+  GstElement* previous = (GstElement*)g_private_get(&gpac_log_target);
+  g_private_set(&gpac_log_target, element);
+  return previous;
+}
+
+// #MARK: Context
+gboolean
+gpac_init(GPAC_Context* ctx, GstElement* element)
+{
+  return gpac_runtime_acquire();
+}
+
 void
 gpac_destroy(GPAC_Context* ctx)
 {
-  gf_sys_close();
+  gpac_runtime_release();
 }
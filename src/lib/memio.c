@@ -26,7 +26,9 @@
 #include "lib/memio.h"
 #include "gpacmessages.h"
 #include "lib/caps.h"
+#include "lib/main.h"
 #include "lib/pid.h"
+#include "lib/trace.h"
 #include "post-process/common.h"
 #include "post-process/registry.h"
 #include <gst/video/video-event.h>
@@ -115,6 +117,10 @@ gpac_memio_new(GPAC_SessionContext* sess, GPAC_MemIoDirection dir)
     gf_filter_set_process_ckb(memio, gpac_default_memin_process_cb);
     gf_filter_set_process_event_ckb(memio, gpac_default_memin_process_event_cb);
   } else {
+    // A chain ending in a filter shared with another element is output there
+    if (sess->reuses_output)
+      return GF_OK;
+
     gf_fs_add_filter_register(sess->session, &MemOutRegister);
     gchar* filter_name = "memout";
     gboolean link_to_last_filter = sess->params && sess->params->is_single;
@@ -145,9 +151,11 @@ gpac_memio_new(GPAC_SessionContext* sess, GPAC_MemIoDirection dir)
     // If we are in single filter mode (explicit destination), we explicitly
     // connect to the last loaded filter to avoid connecting to the memin filter
     // unnecessarily
-    if (link_to_last_filter) {
+    if (link_to_last_filter || sess->shared) {
       u32 count = gf_fs_get_filters_count(sess->session);
-      GF_Filter* filter = gf_fs_get_filter(sess->session, count - 2);
+      GF_Filter* filter = sess->shared
+                            ? sess->last_filter
+                            : gf_fs_get_filter(sess->session, count - 2);
       if (filter) {
         // Connect the memout filter to the last filter
         if (gf_filter_set_source(memio, filter, NULL) != GF_OK) {
@@ -192,11 +200,19 @@ gpac_memio_new(GPAC_SessionContext* sess, GPAC_MemIoDirection dir)
 void
 gpac_memio_free(GPAC_SessionContext* sess)
 {
-  if (sess->memin)
+  // Packets released while the session is torn down must not see the context
+  if (sess->memin) {
     gf_free(gf_filter_get_rt_udta(sess->memin));
+    gf_filter_set_rt_udta(sess->memin, NULL);
+  }
 
-  if (sess->memout)
-    gf_free(gf_filter_get_rt_udta(sess->memout));
+  if (sess->memout) {
+    GPAC_MemIoContext* rt_udta = gf_filter_get_rt_udta(sess->memout);
+    if (rt_udta && rt_udta->iframe_playlists)
+      g_hash_table_unref(rt_udta->iframe_playlists);
+    gf_free(rt_udta);
+    gf_filter_set_rt_udta(sess->memout, NULL);
+  }
 }
 
 void
@@ -235,6 +251,72 @@ gpac_memio_set_eos(GPAC_SessionContext* sess, GF_FilterPid* pid)
   }
 }
 
+static gboolean
+gpac_memio_caps_equal(const GF_FilterCapability* a,
+                      guint nb_a,
+                      const GF_FilterCapability* b,
+                      guint nb_b)
+{
+  if (nb_a != nb_b || !a || !b)
+    return FALSE;
+
+  for (guint i = 0; i < nb_a; i++) {
+    if (a[i].code != b[i].code || a[i].flags != b[i].flags ||
+        a[i].priority != b[i].priority)
+      return FALSE;
+    if (!gf_props_equal(&a[i].val, &b[i].val))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static void
+gpac_memio_caps_free(GF_FilterCapability* caps, guint nb_caps)
+{
+  for (guint i = 0; i < nb_caps; i++) {
+    if (caps[i].val.type == GF_PROP_STRING)
+      g_free(caps[i].val.value.string);
+  }
+  g_free(caps);
+}
+
+static GF_FilterPid*
+gpac_memio_find_opid(GF_Filter* source, GF_FilterPid* ipid)
+{
+  // The input PID shares its name with the output PID it is connected to
+  const char* name = gf_filter_pid_get_name(ipid);
+  for (u32 i = 0; i < gf_filter_get_opid_count(source); i++) {
+    GF_FilterPid* opid = gf_filter_get_opid(source, i);
+    if (!g_strcmp0(gf_filter_pid_get_name(opid), name))
+      return opid;
+  }
+  return NULL;
+}
+
+static GF_Err
+gpac_memio_reconnect_inputs(GF_Filter* memout)
+{
+  // Only the links into the memory output are resolved again, GPAC inserts
+  // whatever is needed between the source and the new caps
+  for (u32 i = 0; i < gf_filter_get_ipid_count(memout); i++) {
+    GF_FilterPid* ipid = gf_filter_get_ipid(memout, i);
+    GF_Filter* source = gf_filter_pid_get_source_filter(ipid);
+    if (!source)
+      continue;
+
+    // A NULL PID would reconnect every output of the source, including the
+    // ones feeding other branches
+    GF_FilterPid* opid = gpac_memio_find_opid(source, ipid);
+    if (!opid)
+      return GF_NOT_FOUND;
+
+    GF_Err e = gf_filter_reconnect_output(source, opid);
+    if (e != GF_OK)
+      return e;
+  }
+  return GF_OK;
+}
+
 gboolean
 gpac_memio_set_gst_caps(GPAC_SessionContext* sess, GstCaps* caps)
 {
@@ -258,6 +340,14 @@ gpac_memio_set_gst_caps(GPAC_SessionContext* sess, GstCaps* caps)
     return FALSE;
   }
 
+  // Nothing to do if the caps did not change
+  if (gpac_memio_caps_equal(current_caps, cur_nb_caps, gf_caps, new_nb_caps)) {
+    GST_DEBUG_OBJECT(sess->element,
+                     "Memory output caps unchanged, skipping reconnection");
+    gpac_memio_caps_free(gf_caps, new_nb_caps);
+    return TRUE;
+  }
+
   // Set the capabilities
   if (gf_filter_override_caps(sess->memout, gf_caps, new_nb_caps) != GF_OK) {
     GST_ELEMENT_ERROR(sess->element,
@@ -266,18 +356,26 @@ gpac_memio_set_gst_caps(GPAC_SessionContext* sess, GstCaps* caps)
                       (NULL),
                       ("Failed to set the caps on the memory output filter, "
                        "reverting to the previous caps"));
-    gf_free(gf_caps);
+    gpac_memio_caps_free(gf_caps, new_nb_caps);
     gf_filter_override_caps(sess->memout, current_caps, cur_nb_caps);
     return FALSE;
   }
 
-  // Reconnect the pipeline
-  u32 count = gf_fs_get_filters_count(sess->session);
-  for (u32 i = 0; i < count; i++) {
-    GF_Filter* filter = gf_fs_get_filter(sess->session, i);
-    gf_filter_reconnect_output(filter, NULL);
-  }
+  // Reconnect only the chain feeding the memory output. If nothing is
+  // connected yet, the new caps will be used when the graph is resolved.
+  GstElement* prev_target = gpac_log_set_target(sess->element);
+  GF_Err e = gpac_memio_reconnect_inputs(sess->memout);
+  gpac_log_set_target(prev_target);
 
+  if (e != GF_OK) {
+    GST_ELEMENT_ERROR(sess->element,
+                      STREAM,
+                      FAILED,
+                      (NULL),
+                      ("Failed to reconnect the memory output: %s",
+                       gf_error_to_string(e)));
+    return FALSE;
+  }
   return TRUE;
 }
 
@@ -370,6 +468,94 @@ gpac_memio_set_global_offset(GPAC_SessionContext* sess,
   }
 }
 
+void
+gpac_memio_track_packet(GPAC_SessionContext* sess, GF_FilterPacket* packet)
+{
+  if (!sess->memin)
+    return;
+
+  GPAC_MemIoContext* ctx = gf_filter_get_rt_udta(sess->memin);
+  u32 size = 0;
+  gf_filter_pck_get_data(packet, &size);
+  if (ctx)
+    g_atomic_pointer_add(&ctx->in_flight_bytes, (gssize)size);
+}
+
+void
+gpac_memio_untrack_packet(GF_Filter* filter, GF_FilterPacket* packet)
+{
+  GPAC_MemIoContext* ctx = gf_filter_get_rt_udta(filter);
+  u32 size = 0;
+  gf_filter_pck_get_data(packet, &size);
+  if (!ctx)
+    return;
+  g_atomic_pointer_add(&ctx->in_flight_bytes, -(gssize)size);
+
+  // Wake up the element waiting for space
+  if (ctx->sess && ctx->sess->released) {
+    GST_OBJECT_LOCK(ctx->sess->element);
+    ctx->sess->released_count++;
+    g_cond_broadcast(ctx->sess->released);
+    GST_OBJECT_UNLOCK(ctx->sess->element);
+  }
+}
+
+void
+gpac_memio_mark_queued(GPAC_SessionContext* sess, gint64 popped_at)
+{
+  if (!sess->memin)
+    return;
+
+  // Keep the oldest input that was not sent yet
+  GPAC_MemIoContext* ctx = gf_filter_get_rt_udta(sess->memin);
+  if (ctx && !ctx->popped_at)
+    ctx->popped_at = popped_at;
+}
+
+void
+gpac_memio_get_level(GPAC_SessionContext* sess, GPAC_MemIoLevel* level)
+{
+  memset(level, 0, sizeof(GPAC_MemIoLevel));
+  if (!sess->session)
+    return;
+
+  // Input packets still alive anywhere in the session
+  if (sess->memin) {
+    GPAC_MemIoContext* ctx = gf_filter_get_rt_udta(sess->memin);
+    if (ctx)
+      level->bytes += (gsize)g_atomic_pointer_get(&ctx->in_flight_bytes);
+
+    for (u32 i = 0; i < gf_filter_get_opid_count(sess->memin); i++) {
+      u32 max_units, nb_pck, max_dur, dur;
+      GF_FilterPid* opid = gf_filter_get_opid(sess->memin, i);
+      gf_filter_pid_get_buffer_occupancy(
+        opid, &max_units, &nb_pck, &max_dur, &dur);
+      level->pending_packets += nb_pck;
+    }
+  }
+
+  // Output waiting in the post-processors
+  if (sess->memout) {
+    for (u32 i = 0; i < gf_filter_get_ipid_count(sess->memout); i++) {
+      GF_FilterPid* ipid = gf_filter_get_ipid(sess->memout, i);
+      GPAC_MemOutPIDContext* pctx = gf_filter_pid_get_udta(ipid);
+      if (pctx && pctx->entry)
+        level->bytes += pctx->entry->queued_bytes(sess->memout, ipid);
+    }
+  }
+
+  // Longest buffer on the inputs of the filters in the session
+  for (u32 i = 0; i < gf_fs_get_filters_count(sess->session); i++) {
+    GF_Filter* filter = gf_fs_get_filter(sess->session, i);
+    for (u32 j = 0; j < gf_filter_get_ipid_count(filter); j++) {
+      u32 max_units, nb_pck, max_dur, dur;
+      gf_filter_pid_get_buffer_occupancy(
+        gf_filter_get_ipid(filter, j), &max_units, &nb_pck, &max_dur, &dur);
+      level->time = MAX(level->time, dur * GST_USECOND);
+    }
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////
 // #MARK: Default Callbacks
 //////////////////////////////////////////////////////////////////////////
@@ -378,11 +564,20 @@ gpac_default_memin_process_cb(GF_Filter* filter)
 {
   GPAC_MemIoContext* ctx = (GPAC_MemIoContext*)gf_filter_get_rt_udta(filter);
 
+  // The element left a shared session, the filter is being removed
+  if (!ctx || !ctx->queue)
+    return GF_OK;
+
   // Flush the queue
   GF_FilterPacket* packet = NULL;
   while ((packet = g_queue_pop_head(ctx->queue)))
     gf_filter_pck_send(packet);
 
+  // Time from the pad to gpac
+  if (ctx->popped_at && ctx->sess && ctx->sess->stats)
+    gpac_stats_histogram_add(&ctx->sess->stats->input,
+                             g_get_monotonic_time() - ctx->popped_at);
+  ctx->popped_at = 0;
   return GF_OK;
 }
 
@@ -470,9 +665,21 @@ gpac_default_memout_process_cb(GF_Filter* filter)
     // Get the packet
     GF_FilterPacket* pck = gf_filter_pid_get_packet(ipid);
 
+    // Runtime option updates take effect at fragment and segment boundaries
+    if (ctx && ctx->sess)
+      gpac_session_check_updates(ctx->sess, pck);
+
     // If we have a post-process context, process the packet
-    if (pctx && pctx->entry)
+    if (ctx && pctx && pctx->entry) {
+      gint64 start = g_get_monotonic_time();
+      GPAC_TRACE_BEGIN(span);
       e = pctx->entry->post_process(filter, ipid, pck);
+      GPAC_TRACE_END(
+        span, pctx->entry->post_process_name, gf_filter_pid_get_name(ipid));
+      if (ctx->sess && ctx->sess->stats)
+        gpac_stats_histogram_add(&ctx->sess->stats->post_process,
+                                 g_get_monotonic_time() - start);
+    }
 
     if (pck)
       gf_filter_pid_drop_packet(ipid);
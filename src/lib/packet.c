@@ -25,11 +25,16 @@
 
 #include "lib/packet.h"
 #include "conversion/packet/registry.h"
+#include "lib/allocator.h"
+#include "lib/framing.h"
+#include "lib/memio.h"
 #include "utils.h"
 
 static void
 gpac_pck_destructor(GF_Filter* filter, GF_FilterPid* PID, GF_FilterPacket* pck)
 {
+  gpac_memio_untrack_packet(filter, pck);
+
   const GF_PropertyValue* prop =
     gf_filter_pck_get_property(pck, GF_PROP_PCK_UDTA);
   if (prop) {
@@ -38,6 +43,17 @@ gpac_pck_destructor(GF_Filter* filter, GF_FilterPid* PID, GF_FilterPacket* pck)
   }
 }
 
+static void
+gpac_pck_memory_destructor(GF_Filter* filter,
+                           GF_FilterPid* PID,
+                           GF_FilterPacket* pck)
+{
+  gpac_memio_untrack_packet(filter, pck);
+
+  u32 size;
+  gpac_memory_release((const guint8*)gf_filter_pck_get_data(pck, &size));
+}
+
 guint64
 gpac_pck_get_stream_time(GstClockTime time,
                          GpacPadPrivate* priv,
@@ -157,31 +173,52 @@ gpac_pck_new_from_buffer(GstBuffer* buffer,
   const GF_PropertyValue* p;
   GstElement* element = gst_pad_get_parent_element(priv->self);
 
-  // Map the buffer
+  GF_FilterPacket* packet = NULL;
   g_auto(GstBufferMapInfo) map = GST_MAP_INFO_INIT;
-  if (G_UNLIKELY(!gst_buffer_map(buffer, &map, GST_MAP_READ))) {
+  const guint8* data;
+  gsize size;
+
+  if (!priv->annexb_to_length && gpac_memory_attach(buffer, &data, &size)) {
+    // Upstream wrote into our memory, share it without mapping the buffer
+    packet = gf_filter_pck_new_shared(
+      pid, data, (u32)size, gpac_pck_memory_destructor);
+    if (G_UNLIKELY(!packet)) {
+      gpac_memory_release(data);
+      GST_ELEMENT_ERROR(
+        element, STREAM, FAILED, (NULL), ("Failed to share the buffer"));
+      return NULL;
+    }
+  } else if (G_UNLIKELY(!gst_buffer_map(buffer, &map, GST_MAP_READ))) {
     GST_ELEMENT_ERROR(
       element, STREAM, FAILED, (NULL), ("Failed to map buffer"));
     return NULL;
-  }
-
-  // Create a new shared packet
-  GF_FilterPacket* packet =
-    gf_filter_pck_new_shared(pid, map.data, map.size, gpac_pck_destructor);
-
-  // Ref the buffer so that we can free it later
-  GstBuffer* ref = gst_buffer_ref(buffer);
-  GF_Err err =
-    gf_filter_pck_set_property(packet, GF_PROP_PCK_UDTA, &PROP_POINTER(ref));
-  if (G_UNLIKELY(err != GF_OK)) {
-    GST_ELEMENT_ERROR(element,
-                      STREAM,
-                      FAILED,
-                      (NULL),
-                      ("Failed to save the buffer ref to the packet"));
-    gst_buffer_unref(ref);
-    gf_filter_pck_unref(packet);
-    return NULL;
+  } else if (priv->annexb_to_length) {
+    // Framed input, the NAL units are copied with length prefixes
+    packet = gpac_framing_new_packet(priv, pid, map.data, map.size);
+    if (G_UNLIKELY(!packet)) {
+      GST_ELEMENT_ERROR(
+        element, STREAM, FAILED, (NULL), ("Failed to reframe the buffer"));
+      return NULL;
+    }
+  } else {
+    // Create a new shared packet
+    packet =
+      gf_filter_pck_new_shared(pid, map.data, map.size, gpac_pck_destructor);
+
+    // Ref the buffer so that we can free it later
+    GstBuffer* ref = gst_buffer_ref(buffer);
+    GF_Err err =
+      gf_filter_pck_set_property(packet, GF_PROP_PCK_UDTA, &PROP_POINTER(ref));
+    if (G_UNLIKELY(err != GF_OK)) {
+      GST_ELEMENT_ERROR(element,
+                        STREAM,
+                        FAILED,
+                        (NULL),
+                        ("Failed to save the buffer ref to the packet"));
+      gst_buffer_unref(ref);
+      gf_filter_pck_unref(packet);
+      return NULL;
+    }
   }
 
   // Get the fps from the PID
@@ -27,12 +27,99 @@
 #include "conversion/pid/registry.h"
 #include "gpacmessages.h"
 
+// Overrides are tracked as a bitset over the property registry
+G_STATIC_ASSERT(G_N_ELEMENTS(prop_registry) <= 64);
+
+static gint
+gpac_pid_registry_index(u32 prop_4cc)
+{
+  for (guint i = 0; i < G_N_ELEMENTS(prop_registry); i++) {
+    if (prop_registry[i].prop_4cc == prop_4cc)
+      return (gint)i;
+  }
+  return -1;
+}
+
+void
+gpac_pid_clear_caps(GpacPadPrivate* priv)
+{
+  g_free(priv->caps_info.media);
+  if (priv->caps_info.structure)
+    gst_structure_free(priv->caps_info.structure);
+  if (priv->caps_info.codec_data)
+    gst_buffer_unref(priv->caps_info.codec_data);
+  memset(&priv->caps_info, 0, sizeof(GpacCapsInfo));
+}
+
+void
+gpac_pid_parse_caps(GpacPadPrivate* priv)
+{
+  GpacCapsInfo* info = &priv->caps_info;
+  gpac_pid_clear_caps(priv);
+
+  info->width = info->height = -1;
+  info->fps_num = info->fps_den = -1;
+  info->rate = info->channels = -1;
+  info->framed = TRUE;
+
+  if (!priv->caps || gst_caps_get_size(priv->caps) == 0)
+    return;
+
+  // Own a copy, the pad caps are replaced on the next caps event
+  GstStructure* structure =
+    gst_structure_copy(gst_caps_get_structure(priv->caps, 0));
+  info->structure = structure;
+
+  // Split the media type, "codec" points into the same allocation
+  info->media = g_strdup(gst_structure_get_name(structure));
+  gchar* slash = strchr(info->media, '/');
+  if (slash) {
+    *slash = '\0';
+    info->codec = slash + 1;
+  }
+
+  if (!g_strcmp0(info->media, "video"))
+    info->kind = GPAC_MEDIA_KIND_VIDEO;
+  else if (!g_strcmp0(info->media, "audio"))
+    info->kind = GPAC_MEDIA_KIND_AUDIO;
+  else if (!g_strcmp0(info->media, "text"))
+    info->kind = GPAC_MEDIA_KIND_TEXT;
+
+  info->stream_format = gst_structure_get_string(structure, "stream-format");
+  info->alignment = gst_structure_get_string(structure, "alignment");
+  gst_structure_get_boolean(structure, "framed", &info->framed);
+  gst_structure_get_int(structure, "width", &info->width);
+  gst_structure_get_int(structure, "height", &info->height);
+  gst_structure_get_fraction(
+    structure, "framerate", &info->fps_num, &info->fps_den);
+  gst_structure_get_int(structure, "rate", &info->rate);
+  gst_structure_get_int(structure, "channels", &info->channels);
+
+  const GValue* codec_data = gst_structure_get_value(structure, "codec_data");
+  if (codec_data && GST_VALUE_HOLDS_BUFFER(codec_data))
+    info->codec_data = gst_buffer_ref(gst_value_get_buffer(codec_data));
+}
+
+GF_Err
+gpac_pid_set_property(GF_FilterPid* pid,
+                      u32 prop_4cc,
+                      const GF_PropertyValue* value)
+{
+  // Setting an equal value would still make GPAC reconfigure the pid
+  const GF_PropertyValue* current = gf_filter_pid_get_property(pid, prop_4cc);
+  if (current && gf_props_equal(current, value))
+    return GF_OK;
+  return gf_filter_pid_set_property(pid, prop_4cc, value);
+}
+
 gboolean
-gpac_pid_apply_overrides(GPAC_PID_PROP_IMPL_ARGS_NO_ELEMENT, GList** to_skip)
+gpac_pid_apply_overrides(GPAC_PID_PROP_IMPL_ARGS_NO_ELEMENT, guint64* to_skip)
 {
-  GstStructure* caps = gst_caps_get_structure(priv->caps, 0);
+  GstStructure* caps = priv->caps_info.structure;
   gchar* prefix = "gpac-";
   gboolean nested = FALSE;
+  if (!caps)
+    return TRUE;
 
 retry:
   // Go through the root structure
@@ -67,11 +154,13 @@ retry:
       // Set the property
       GF_PropertyValue pv = gf_props_parse_value(
         gf_props_4cc_get_type(prop_4cc), prop_name, prop_value, NULL, ',');
-      gpac_return_val_if_fail(gf_filter_pid_set_property(pid, prop_4cc, &pv),
+      gpac_return_val_if_fail(gpac_pid_set_property(pid, prop_4cc, &pv),
                               FALSE);
 
-      // Add the property to the to_skip list
-      *to_skip = g_list_append(*to_skip, GUINT_TO_POINTER(prop_4cc));
+      // Skip the registry handlers for this property
+      gint idx = gpac_pid_registry_index(prop_4cc);
+      if (idx >= 0)
+        *to_skip |= G_GUINT64_CONSTANT(1) << idx;
     }
   }
 
@@ -105,23 +194,41 @@ gpac_pid_reconfigure(GPAC_PID_PROP_IMPL_ARGS)
   // Lock the element
   GST_OBJECT_AUTO_LOCK(element, auto_lock);
 
-  // Go through overrides if caps are set
-  g_autoptr(GList) to_skip = g_list_alloc();
+  // Parse the caps and go through overrides if caps are set
+  guint64 to_skip = 0;
   if (HAS_FLAG(priv->flags, GPAC_PAD_CAPS_SET)) {
+    gpac_pid_parse_caps(priv);
     if (!gpac_pid_apply_overrides(priv, pid, &to_skip)) {
       GST_ERROR_OBJECT(priv->self, "Failed to apply overrides");
       return FALSE;
     }
   }
 
+  // Once the pid is configured, a tags or segment update only needs the
+  // handlers fed by that source. Properties they cannot derive keep their
+  // current value instead of going through the query and default handlers.
+  gboolean partial =
+    !HAS_FLAG(priv->flags, GPAC_PAD_CAPS_SET) &&
+    gf_filter_pid_get_property(pid, GF_PROP_PID_STREAM_TYPE) != NULL;
+
   // Go through the property registry
   for (u32 i = 0; i < gpac_pid_get_num_supported_props(); i++) {
     prop_registry_entry* entry = &prop_registry[i];
 
-    // Skip the property if it is in the to_skip list
-    if (g_list_find(to_skip, GUINT_TO_POINTER(entry->prop_4cc)))
+    // Skip the property if it was overridden
+    if (to_skip & (G_GUINT64_CONSTANT(1) << i))
       continue;
 
+    if (partial) {
+      if (entry->tags_handler != NULL &&
+          HAS_FLAG(priv->flags, GPAC_PAD_TAGS_SET))
+        entry->tags_handler(element, priv, pid);
+      if (entry->segment_handler != NULL &&
+          HAS_FLAG(priv->flags, GPAC_PAD_SEGMENT_SET))
+        entry->segment_handler(element, priv, pid);
+      continue;
+    }
+
     // Try each handler
     if (entry->caps_handler != NULL)
       if (HAS_FLAG(priv->flags, GPAC_PAD_CAPS_SET) &&
@@ -27,21 +27,58 @@
 #include "gpacmessages.h"
 #include "lib/memio.h"
 #include "lib/signals.h"
+#include "lib/trace.h"
 
 #include <gio/gio.h>
 #include <gpac/mpd.h>
 #include <gpac/network.h>
+#include <math.h>
 
 GST_DEBUG_CATEGORY_STATIC(gpac_dasher);
 #define GST_CAT_DEFAULT gpac_dasher
 
+// Enough for the moof of a segment, the key frame itself is not parsed
+#define DASHER_HEAD_MAX_SIZE (256 * 1024)
+
 typedef struct
 {
   gchar* name;        // Name of the file
   GFile* file;        // GFile object for the file (optional)
   GOutputStream* out; // Output stream for the file
+  guint32 shm_flags;  // Flags of the next shared memory write
+
+  // Details of the notification sent once the file is complete
+  gboolean is_init;
+  guint32 sequence;
+  gint32 part;       // -1 for a full segment
+  guint64 size;
+  guint64 first_cts; // In the PID timescale, GF_FILTER_NO_TS if unknown
+  guint64 end_cts;
+
+  GByteArray* head; // Leading bytes, parsed for the I-frame playlist
 } FileAbstract;
 
+typedef struct
+{
+  gchar* name; // Full path of the segment
+  gchar* uri;  // Relative to the playlist
+  gdouble duration;
+  guint64 offset;
+  guint64 length;
+} IFrameEntry;
+
+typedef struct
+{
+  gchar* name;     // Full path of the playlist
+  gchar* uri;      // Relative to the master playlist
+  gchar* init_uri; // Relative to the playlist
+  GQueue entries;
+  guint32 media_sequence;
+  gdouble target_duration;
+  guint64 bandwidth; // Peak bit rate of the key frames
+  gboolean ended;
+} IFramePlaylist;
+
 typedef struct
 {
   // current file being processed
@@ -50,9 +87,18 @@ typedef struct
 
   gchar* llhas_template;
   gboolean is_manifest;
+
+  // Manifests are written once complete, and only if they changed
+  GByteArray* manifest;
+  gchar* manifest_name;
+  GHashTable* manifest_hashes; // name -> content hash of the last write
+
   guint32 dash_state;
   gchar* original_dst;
   const gchar* dst; // destination file path
+
+  // HLS I-frame playlist, for video representations only
+  IFramePlaylist* iframes;
 } DasherCtx;
 
 void
@@ -76,11 +122,34 @@ dasher_free_file(FileAbstract* file)
     if (file->file) {
       g_object_unref(file->file);
     }
+    if (file->head)
+      g_byte_array_unref(file->head);
     g_free(file->name);
     g_free(file);
   }
 }
 
+static void
+dasher_free_iframe_entry(IFrameEntry* entry)
+{
+  g_free(entry->name);
+  g_free(entry->uri);
+  g_free(entry);
+}
+
+static void
+dasher_free_iframes(IFramePlaylist* iframes)
+{
+  if (iframes) {
+    g_queue_clear_full(&iframes->entries,
+                       (GDestroyNotify)dasher_free_iframe_entry);
+    g_free(iframes->name);
+    g_free(iframes->uri);
+    g_free(iframes->init_uri);
+    g_free(iframes);
+  }
+}
+
 void
 dasher_ctx_free(void* process_ctx)
 {
@@ -94,11 +163,410 @@ dasher_ctx_free(void* process_ctx)
   if (ctx->llhas_template)
     g_free(ctx->llhas_template);
 
+  // Free the pending manifest
+  if (ctx->manifest)
+    g_byte_array_unref(ctx->manifest);
+  if (ctx->manifest_hashes)
+    g_hash_table_unref(ctx->manifest_hashes);
+  g_free(ctx->manifest_name);
+  dasher_free_iframes(ctx->iframes);
+
   // Free the context
   g_free(ctx->original_dst);
   g_free(ctx);
 }
 
+// Resolves a file name against the directory of the destination
+static gchar*
+dasher_resolve_name(DasherCtx* dasher_ctx, const gchar* name)
+{
+  if (g_path_is_absolute(name))
+    return g_strdup(name);
+
+  g_assert(dasher_ctx->original_dst);
+  gchar* base_dir = g_path_get_dirname(dasher_ctx->original_dst);
+  gchar* canonical_base_dir = g_path_is_absolute(base_dir)
+                                ? g_strdup(base_dir)
+                                : g_canonicalize_filename(base_dir, NULL);
+  gchar* resolved = g_canonicalize_filename(name, canonical_base_dir);
+  g_free(canonical_base_dir);
+  g_free(base_dir);
+  return resolved;
+}
+
+// URI of a file, relative to the directory of another one
+static gchar*
+dasher_relative_uri(const gchar* from, const gchar* to)
+{
+  gchar* dir = g_path_get_dirname(from);
+  gsize len = strlen(dir);
+  gchar* uri;
+  if (g_str_has_prefix(to, dir) && to[len] == G_DIR_SEPARATOR)
+    uri = g_strdup(to + len + 1);
+  else
+    uri = g_path_get_basename(to);
+  g_free(dir);
+  return uri;
+}
+
+/*! finds a box among the boxes in a buffer
+    \param[in] data the buffer to search
+    \param[in] size the size of the buffer
+    \param[in] type the type of the box, as a fourcc
+    \param[out] payload_size set to the size of the box payload
+    \param[out] box set to the start of the box, can be NULL
+    \return the payload of the box, NULL if not found or truncated
+*/
+static const guint8*
+dasher_find_box(const guint8* data,
+                gsize size,
+                guint32 type,
+                gsize* payload_size,
+                const guint8** box)
+{
+  gsize pos = 0;
+  while (pos + 8 <= size) {
+    guint64 box_size = GST_READ_UINT32_BE(data + pos);
+    guint32 box_type = GST_READ_UINT32_LE(data + pos + 4);
+    gsize header = 8;
+    if (box_size == 1) {
+      if (pos + 16 > size)
+        return NULL;
+      box_size = GST_READ_UINT64_BE(data + pos + 8);
+      header = 16;
+    } else if (box_size == 0) {
+      box_size = size - pos;
+    }
+
+    if (box_size < header || box_size > size - pos)
+      return NULL;
+
+    if (box_type == type) {
+      *payload_size = box_size - header;
+      if (box)
+        *box = data + pos;
+      return data + pos + header;
+    }
+    pos += box_size;
+  }
+  return NULL;
+}
+
+// Whether an init segment holds a single video track
+static gboolean
+dasher_is_video_init(const GByteArray* head)
+{
+  gsize moov_size, trak_size, mdia_size, hdlr_size, size;
+  const guint8* moov = dasher_find_box(head->data,
+                                       head->len,
+                                       GST_MAKE_FOURCC('m', 'o', 'o', 'v'),
+                                       &moov_size,
+                                       NULL);
+  if (!moov)
+    return FALSE;
+
+  const guint8* trak = dasher_find_box(
+    moov, moov_size, GST_MAKE_FOURCC('t', 'r', 'a', 'k'), &trak_size, NULL);
+  if (!trak)
+    return FALSE;
+
+  // Multiplexed representations would need a range per track
+  const guint8* next = trak + trak_size;
+  if (dasher_find_box(next,
+                      moov + moov_size - next,
+                      GST_MAKE_FOURCC('t', 'r', 'a', 'k'),
+                      &size,
+                      NULL))
+    return FALSE;
+
+  const guint8* mdia = dasher_find_box(
+    trak, trak_size, GST_MAKE_FOURCC('m', 'd', 'i', 'a'), &mdia_size, NULL);
+  if (!mdia)
+    return FALSE;
+  const guint8* hdlr = dasher_find_box(
+    mdia, mdia_size, GST_MAKE_FOURCC('h', 'd', 'l', 'r'), &hdlr_size, NULL);
+  if (!hdlr || hdlr_size < 12)
+    return FALSE;
+
+  return GST_READ_UINT32_LE(hdlr + 8) == GST_MAKE_FOURCC('v', 'i', 'd', 'e');
+}
+
+/*! locates the key frame a segment starts with
+    \param[in] head the leading bytes of the segment
+    \param[out] offset set to the offset of the moof
+    \param[out] length set to the length of the moof up to the end of the first
+   sample
+    \return TRUE if the range was found, FALSE otherwise
+*/
+static gboolean
+dasher_get_key_frame_range(const GByteArray* head,
+                           guint64* offset,
+                           guint64* length)
+{
+  gsize moof_size, traf_size, tfhd_size, trun_size;
+  const guint8* box;
+  const guint8* moof = dasher_find_box(head->data,
+                                       head->len,
+                                       GST_MAKE_FOURCC('m', 'o', 'o', 'f'),
+                                       &moof_size,
+                                       &box);
+  if (!moof)
+    return FALSE;
+
+  const guint8* traf = dasher_find_box(
+    moof, moof_size, GST_MAKE_FOURCC('t', 'r', 'a', 'f'), &traf_size, NULL);
+  if (!traf)
+    return FALSE;
+  const guint8* tfhd = dasher_find_box(
+    traf, traf_size, GST_MAKE_FOURCC('t', 'f', 'h', 'd'), &tfhd_size, NULL);
+  const guint8* trun = dasher_find_box(
+    traf, traf_size, GST_MAKE_FOURCC('t', 'r', 'u', 'n'), &trun_size, NULL);
+  if (!tfhd || !trun || tfhd_size < 8 || trun_size < 12)
+    return FALSE;
+
+  // The first track fragment is based on the moof unless told otherwise
+  guint64 base = box - head->data;
+  guint32 default_size = 0;
+  guint32 flags = GST_READ_UINT32_BE(tfhd) & 0xffffff;
+  gsize pos = 8;
+  if (flags & 0x1) {
+    if (tfhd_size < pos + 8)
+      return FALSE;
+    base = GST_READ_UINT64_BE(tfhd + pos);
+    pos += 8;
+  }
+  if (flags & 0x2)
+    pos += 4;
+  if (flags & 0x8)
+    pos += 4;
+  if (flags & 0x10) {
+    if (tfhd_size < pos + 4)
+      return FALSE;
+    default_size = GST_READ_UINT32_BE(tfhd + pos);
+  }
+
+  // Without a data offset, the samples cannot be located
+  flags = GST_READ_UINT32_BE(trun) & 0xffffff;
+  if (!(flags & 0x1) || !GST_READ_UINT32_BE(trun + 4))
+    return FALSE;
+  gint32 data_offset = (gint32)GST_READ_UINT32_BE(trun + 8);
+  guint32 sample_size = default_size;
+  pos = 12;
+  if (flags & 0x4)
+    pos += 4;
+  if (flags & 0x100)
+    pos += 4;
+  if (flags & 0x200) {
+    if (trun_size < pos + 4)
+      return FALSE;
+    sample_size = GST_READ_UINT32_BE(trun + pos);
+  }
+
+  guint64 end = base + data_offset + sample_size;
+  *offset = box - head->data;
+  if (!sample_size || end <= *offset)
+    return FALSE;
+  *length = end - *offset;
+  return TRUE;
+}
+
+static IFramePlaylist*
+dasher_new_iframes(DasherCtx* dasher_ctx, const gchar* init_name)
+{
+  IFramePlaylist* iframes = g_new0(IFramePlaylist, 1);
+  g_queue_init(&iframes->entries);
+
+  // Named after the init segment, "video_init.mp4" gives "video_iframes.m3u8"
+  gchar* dir = g_path_get_dirname(init_name);
+  gchar* base = g_path_get_basename(init_name);
+  gchar* ext = strrchr(base, '.');
+  if (ext)
+    *ext = '\0';
+  if (g_str_has_suffix(base, "init"))
+    base[strlen(base) - 4] = '\0';
+  gchar* file = g_strdup_printf("%s%siframes.m3u8",
+                                base,
+                                *base && !g_str_has_suffix(base, "_") ? "_"
+                                                                      : "");
+  iframes->name = g_build_filename(dir, file, NULL);
+  g_free(file);
+  g_free(base);
+  g_free(dir);
+
+  gchar* root = dasher_resolve_name(dasher_ctx, dasher_ctx->original_dst);
+  iframes->uri = dasher_relative_uri(root, iframes->name);
+  iframes->init_uri = dasher_relative_uri(iframes->name, init_name);
+  g_free(root);
+  return iframes;
+}
+
+static void
+dasher_write_iframes(GF_Filter* filter, IFramePlaylist* iframes)
+{
+  GPAC_MemIoContext* io_ctx = (GPAC_MemIoContext*)gf_filter_get_rt_udta(filter);
+
+  GString* playlist = g_string_new("#EXTM3U\n#EXT-X-VERSION:6\n");
+  g_string_append_printf(playlist,
+                         "#EXT-X-TARGETDURATION:%u\n"
+                         "#EXT-X-MEDIA-SEQUENCE:%u\n"
+                         "#EXT-X-I-FRAMES-ONLY\n"
+                         "#EXT-X-MAP:URI=\"%s\"\n",
+                         (guint)ceil(iframes->target_duration),
+                         iframes->media_sequence,
+                         iframes->init_uri);
+  for (GList* l = iframes->entries.head; l; l = l->next) {
+    IFrameEntry* entry = (IFrameEntry*)l->data;
+    g_string_append_printf(playlist,
+                           "#EXTINF:%.3f,\n"
+                           "#EXT-X-BYTERANGE:%" G_GUINT64_FORMAT
+                           "@%" G_GUINT64_FORMAT "\n%s\n",
+                           entry->duration,
+                           entry->length,
+                           entry->offset,
+                           entry->uri);
+  }
+  if (iframes->ended)
+    g_string_append(playlist, "#EXT-X-ENDLIST\n");
+
+  GFile* file = NULL;
+  GOutputStream* out = NULL;
+  GError* error = NULL;
+  if (!gpac_signal_emitter_get_output(io_ctx->sess->signals,
+                                      GPAC_SIGNAL_DASHER_MANIFEST_VARIANT,
+                                      iframes->name,
+                                      &out)) {
+    file = g_file_new_for_path(iframes->name);
+    out = G_OUTPUT_STREAM(g_file_replace(
+      file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error));
+  }
+
+  if (!out || !g_output_stream_write_all(
+                out, playlist->str, playlist->len, NULL, NULL, &error)) {
+    GST_ELEMENT_WARNING(io_ctx->sess->element,
+                        RESOURCE,
+                        WRITE,
+                        (NULL),
+                        ("Failed to write I-frame playlist %s: %s",
+                         iframes->name,
+                         error ? error->message : "Unknown error"));
+    g_clear_error(&error);
+  }
+
+  if (out)
+    g_output_stream_close(out, NULL, NULL);
+  if (file) {
+    if (out)
+      g_object_unref(out);
+    g_object_unref(file);
+  }
+  g_string_free(playlist, TRUE);
+}
+
+// Adds the key frame of a closed segment, or starts the playlist on video init
+static void
+dasher_add_iframe(GF_Filter* filter, GF_FilterPid* pid, FileAbstract* file)
+{
+  GPAC_MemIoContext* io_ctx = (GPAC_MemIoContext*)gf_filter_get_rt_udta(filter);
+  GPAC_MemOutPIDContext* ctx =
+    (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
+  DasherCtx* dasher_ctx = (DasherCtx*)ctx->private_ctx;
+
+  if (file->is_init) {
+    if (!dasher_ctx->iframes && dasher_is_video_init(file->head))
+      dasher_ctx->iframes = dasher_new_iframes(dasher_ctx, file->name);
+    return;
+  }
+
+  IFramePlaylist* iframes = dasher_ctx->iframes;
+  if (!iframes || file->first_cts == GF_FILTER_NO_TS)
+    return;
+
+  const GF_PropertyValue* p =
+    gf_filter_pid_get_property(pid, GF_PROP_PID_TIMESCALE);
+  if (!p || !p->value.uint)
+    return;
+
+  guint64 offset, length;
+  if (!dasher_get_key_frame_range(file->head, &offset, &length)) {
+    GST_DEBUG_OBJECT(io_ctx->sess->element,
+                     "No key frame range found in %s, skipping",
+                     file->name);
+    return;
+  }
+
+  IFrameEntry* entry = g_new0(IFrameEntry, 1);
+  entry->name = g_strdup(file->name);
+  entry->uri = dasher_relative_uri(iframes->name, file->name);
+  entry->duration =
+    (gdouble)(file->end_cts - file->first_cts) / p->value.uint;
+  entry->offset = offset;
+  entry->length = length;
+  g_queue_push_tail(&iframes->entries, entry);
+  iframes->target_duration = MAX(iframes->target_duration, entry->duration);
+
+  // The master playlist advertises the peak bit rate
+  if (entry->duration > 0) {
+    guint64 bandwidth = (guint64)(length * 8 / entry->duration);
+    if (bandwidth > iframes->bandwidth) {
+      iframes->bandwidth = bandwidth;
+      if (!io_ctx->iframe_playlists)
+        io_ctx->iframe_playlists =
+          g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+      g_hash_table_replace(io_ctx->iframe_playlists,
+                           g_strdup(iframes->uri),
+                           GUINT_TO_POINTER(MIN(bandwidth, G_MAXUINT)));
+    }
+  }
+
+  dasher_write_iframes(filter, iframes);
+}
+
+// Drops a deleted segment, returns TRUE if the playlist changed
+static gboolean
+dasher_remove_iframe(DasherCtx* dasher_ctx, const gchar* url)
+{
+  IFramePlaylist* iframes = dasher_ctx->iframes;
+  gchar* name = dasher_resolve_name(dasher_ctx, url);
+  gboolean removed = FALSE;
+
+  GList* l = iframes->entries.head;
+  while (l) {
+    GList* next = l->next;
+    IFrameEntry* entry = (IFrameEntry*)l->data;
+    if (!g_strcmp0(entry->name, name)) {
+      if (l == iframes->entries.head)
+        iframes->media_sequence++;
+      dasher_free_iframe_entry(entry);
+      g_queue_delete_link(&iframes->entries, l);
+      removed = TRUE;
+    }
+    l = next;
+  }
+
+  g_free(name);
+  return removed;
+}
+
+// Lists the I-frame playlists at the end of the HLS master playlist
+static void
+dasher_advertise_iframes(GPAC_MemIoContext* io_ctx, GByteArray* manifest)
+{
+  if (manifest->len && manifest->data[manifest->len - 1] != '\n')
+    g_byte_array_append(manifest, (const guint8*)"\n", 1);
+
+  GList* uris = g_hash_table_get_keys(io_ctx->iframe_playlists);
+  uris = g_list_sort(uris, (GCompareFunc)g_strcmp0);
+  for (GList* l = uris; l; l = l->next) {
+    gchar* line = g_strdup_printf(
+      "#EXT-X-I-FRAME-STREAM-INF:BANDWIDTH=%u,URI=\"%s\"\n",
+      GPOINTER_TO_UINT(g_hash_table_lookup(io_ctx->iframe_playlists, l->data)),
+      (const gchar*)l->data);
+    g_byte_array_append(manifest, (const guint8*)line, strlen(line));
+    g_free(line);
+  }
+  g_list_free(uris);
+}
+
 GF_Err
 dasher_configure_pid(GF_Filter* filter, GF_FilterPid* pid)
 {
@@ -113,10 +581,16 @@ dasher_configure_pid(GF_Filter* filter, GF_FilterPid* pid)
 
   const GF_PropertyValue* p =
     gf_filter_pid_get_property(pid, GF_PROP_PID_IS_MANIFEST);
-  if (p && p->value.uint)
+  if (p && p->value.uint) {
     dasher_ctx->is_manifest = TRUE;
-  else
+    if (!dasher_ctx->manifest) {
+      dasher_ctx->manifest = g_byte_array_new();
+      dasher_ctx->manifest_hashes =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+  } else {
     dasher_ctx->dash_state = 1;
+  }
 
   // Get the destination path
   GF_PropertyValue dst;
@@ -154,10 +628,8 @@ dasher_process_event(GF_Filter* filter, const GF_FilterEvent* evt)
                      gf_filter_pid_get_name(evt->base.on_pid),
                      evt->file_del.url);
 
-    gboolean sent = gpac_signal_try_emit(io_ctx->sess->element,
-                                         GPAC_SIGNAL_DASHER_DELETE_SEGMENT,
-                                         evt->file_del.url,
-                                         NULL);
+    gboolean sent =
+      gpac_signal_emitter_delete(io_ctx->sess->signals, evt->file_del.url);
 
     if (!sent) {
       GFile* file = g_file_new_for_path(evt->file_del.url);
@@ -176,11 +648,106 @@ dasher_process_event(GF_Filter* filter, const GF_FilterEvent* evt)
       g_object_unref(file);
     }
 
+    if (dasher_ctx->iframes &&
+        dasher_remove_iframe(dasher_ctx, evt->file_del.url))
+      dasher_write_iframes(filter, dasher_ctx->iframes);
+
     return GF_TRUE;
   }
   return GF_FALSE;
 }
 
+static void
+dasher_notify_file(GF_Filter* filter,
+                   GF_FilterPid* pid,
+                   FileAbstract* file,
+                   gboolean is_llhls)
+{
+  GPAC_MemIoContext* io_ctx = (GPAC_MemIoContext*)gf_filter_get_rt_udta(filter);
+  GPAC_MemOutPIDContext* ctx =
+    (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
+  DasherCtx* dasher_ctx = (DasherCtx*)ctx->private_ctx;
+
+  GPAC_SignalId id;
+  if (dasher_ctx->is_manifest)
+    id = GPAC_SIGNAL_DASHER_MANIFEST_UPDATED;
+  else if (is_llhls)
+    id = GPAC_SIGNAL_DASHER_PART_READY;
+  else if (!file->is_init)
+    id = GPAC_SIGNAL_DASHER_SEGMENT_READY;
+  else
+    return;
+
+  // Nothing was written, the file is not complete
+  if (!file->size)
+    return;
+
+  GstClockTime duration = GST_CLOCK_TIME_NONE;
+  const GF_PropertyValue* p =
+    gf_filter_pid_get_property(pid, GF_PROP_PID_TIMESCALE);
+  if (p && p->value.uint && file->first_cts != GF_FILTER_NO_TS)
+    duration = gf_timestamp_rescale(
+      file->end_cts - file->first_cts, p->value.uint, GST_SECOND);
+
+  GstStructure* info = gst_structure_new(gpac_signal_names[id - 1],
+                                         "name",
+                                         G_TYPE_STRING,
+                                         file->name,
+                                         "sequence",
+                                         G_TYPE_UINT,
+                                         file->sequence,
+                                         "part",
+                                         G_TYPE_INT,
+                                         file->part,
+                                         "duration",
+                                         G_TYPE_UINT64,
+                                         duration,
+                                         "size",
+                                         G_TYPE_UINT64,
+                                         file->size,
+                                         NULL);
+  gpac_signal_emitter_notify(io_ctx->sess->signals, id, info);
+}
+
+static void
+dasher_track_packet(GF_FilterPid* pid, FileAbstract* file, GF_FilterPacket* pck)
+{
+  if (!file)
+    return;
+
+  u64 cts = gf_filter_pck_get_cts(pck);
+  if (cts == GF_FILTER_NO_TS)
+    return;
+
+  if (file->first_cts == GF_FILTER_NO_TS)
+    file->first_cts = cts;
+  file->end_cts = MAX(file->end_cts, cts + gf_filter_pck_get_duration(pck));
+}
+
+// The MPD and, in dual mode, the HLS master playlist share the same name
+static gboolean
+dasher_is_main_manifest(DasherCtx* dasher_ctx, const gchar* name)
+{
+  if (g_strcmp0(name, dasher_ctx->dst) == 0)
+    return TRUE;
+  if (!name || !dasher_ctx->dst)
+    return FALSE;
+
+  gchar* name_base = g_path_get_basename(name);
+  gchar* dst_base = g_path_get_basename(dasher_ctx->dst);
+  gchar* ext = strrchr(name_base, '.');
+  gchar* dst_ext = strrchr(dst_base, '.');
+  if (ext)
+    *ext = '\0';
+  if (dst_ext)
+    *dst_ext = '\0';
+
+  gboolean ret = g_strcmp0(name_base, dst_base) == 0;
+  g_free(name_base);
+  g_free(dst_base);
+  return ret;
+}
+
 void
 dasher_open_close_file(GF_Filter* filter,
                        GF_FilterPid* pid,
@@ -206,6 +773,15 @@ dasher_open_close_file(GF_Filter* filter,
                      "Closing file for PID %s: %s",
                      gf_filter_pid_get_name(pid),
                      (*file)->name);
+    if (io_ctx->sess->shm) {
+      // Tell the consumers the file is complete
+      GPAC_ShmDescriptor desc = { 0 };
+      desc.pts = desc.dts = desc.duration = GST_CLOCK_TIME_NONE;
+      desc.flags = ((*file)->shm_flags & ~GPAC_SHM_FLAG_FILE_START) |
+                   GPAC_SHM_FLAG_FILE_END;
+      g_strlcpy(desc.name, (*file)->name, sizeof(desc.name));
+      gpac_shm_ring_write(io_ctx->sess->shm, NULL, 0, &desc);
+    }
     if ((*file)->out)
       g_output_stream_close((*file)->out, NULL, NULL);
     if ((*file)->file) {
@@ -213,6 +789,13 @@ dasher_open_close_file(GF_Filter* filter,
       g_object_unref((*file)->file);
     }
 
+    // Announced after the close, so that it follows any queued output
+    dasher_notify_file(filter, pid, *file, is_llhls);
+    if ((*file)->head && (*file)->size)
+      dasher_add_iframe(filter, pid, *file);
+
+    if ((*file)->head)
+      g_byte_array_unref((*file)->head);
     g_free((*file)->name);
     g_free(*file);
     *file = NULL;
@@ -223,51 +806,45 @@ dasher_open_close_file(GF_Filter* filter,
 
   // Create a new file
   *file = g_new0(FileAbstract, 1);
+  (*file)->part = -1;
+  (*file)->first_cts = GF_FILTER_NO_TS;
+  (*file)->is_init =
+    !dasher_ctx->is_manifest && g_strcmp0(name, dasher_ctx->dst) == 0;
 
-  g_assert(dasher_ctx->original_dst);
-  gchar* base_dir = g_path_get_dirname(dasher_ctx->original_dst);
-  gchar* canonical_base_dir = g_path_is_absolute(base_dir)
-                                ? g_strdup(base_dir)
-                                : g_canonicalize_filename(base_dir, NULL);
-  (*file)->name = g_path_is_absolute(name)
-                    ? g_strdup(name)
-                    : g_canonicalize_filename(name, canonical_base_dir);
-  g_free(canonical_base_dir);
-  g_free(base_dir);
+  (*file)->name = dasher_resolve_name(dasher_ctx, name);
 
   GST_TRACE_OBJECT(io_ctx->sess->element,
                    "Opening new file for PID %s: %s",
                    gf_filter_pid_get_name(pid),
                    (*file)->name);
 
-  // Decide on the file flags
-  gboolean has_os = FALSE;
+  // Files go to the shared memory ring instead of output streams
+  if (io_ctx->sess->shm) {
+    (*file)->shm_flags = GPAC_SHM_FLAG_FILE_START;
+    if (dasher_ctx->is_manifest)
+      (*file)->shm_flags |= GPAC_SHM_FLAG_MANIFEST;
+    else if (g_strcmp0(name, dasher_ctx->dst) == 0)
+      (*file)->shm_flags |= GPAC_SHM_FLAG_HEADER;
+    return;
+  }
+
+  // Decide on the signal to emit
+  GPAC_SignalId id;
   if (dasher_ctx->is_manifest) {
-    if (g_strcmp0(name, dasher_ctx->dst) == 0) {
-      has_os = gpac_signal_try_emit(io_ctx->sess->element,
-                                    GPAC_SIGNAL_DASHER_MANIFEST,
-                                    (*file)->name,
-                                    &(*file)->out);
-    } else {
-      has_os = gpac_signal_try_emit(io_ctx->sess->element,
-                                    GPAC_SIGNAL_DASHER_MANIFEST_VARIANT,
-                                    (*file)->name,
-                                    &(*file)->out);
-    }
+    if (dasher_is_main_manifest(dasher_ctx, name))
+      id = GPAC_SIGNAL_DASHER_MANIFEST;
+    else
+      id = GPAC_SIGNAL_DASHER_MANIFEST_VARIANT;
   } else {
-    if (g_strcmp0(name, dasher_ctx->dst) == 0) {
-      has_os = gpac_signal_try_emit(io_ctx->sess->element,
-                                    GPAC_SIGNAL_DASHER_SEGMENT_INIT,
-                                    (*file)->name,
-                                    &(*file)->out);
-    } else {
-      has_os = gpac_signal_try_emit(io_ctx->sess->element,
-                                    GPAC_SIGNAL_DASHER_SEGMENT,
-                                    (*file)->name,
-                                    &(*file)->out);
-    }
+    if (g_strcmp0(name, dasher_ctx->dst) == 0)
+      id = GPAC_SIGNAL_DASHER_SEGMENT_INIT;
+    else
+      id = GPAC_SIGNAL_DASHER_SEGMENT;
   }
 
+  gboolean has_os = gpac_signal_emitter_get_output(
+    io_ctx->sess->signals, id, (*file)->name, &(*file)->out);
+
   if (!has_os) {
     // Create a GFile and GOutputStream for the file
     (*file)->file = g_file_new_for_path((*file)->name);
@@ -293,10 +870,15 @@ dasher_open_close_file(GF_Filter* filter,
       return;
     }
   }
+
+  // Keep the head of the file, the I-frame playlist points into it
+  if (io_ctx->sess->iframe_playlist && !is_llhls && !dasher_ctx->is_manifest &&
+      ((*file)->is_init || dasher_ctx->iframes))
+    (*file)->head = g_byte_array_new();
 }
 
-void
-dasher_setup_file(GF_Filter* filter, GF_FilterPid* pid)
+const gchar*
+dasher_get_default_name(GF_Filter* filter, GF_FilterPid* pid)
 {
   GPAC_MemOutPIDContext* ctx =
     (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
@@ -304,20 +886,24 @@ dasher_setup_file(GF_Filter* filter, GF_FilterPid* pid)
 
   const GF_PropertyValue* p =
     gf_filter_pid_get_property(pid, GF_PROP_PID_OUTPATH);
-  if (p && p->value.string) {
-    dasher_open_close_file(filter, pid, p->value.string, FALSE);
-    return;
-  }
+  if (p && p->value.string)
+    return p->value.string;
 
-  if (dasher_ctx->dst) {
-    dasher_open_close_file(filter, pid, dasher_ctx->dst, FALSE);
-  } else {
-    p = gf_filter_pid_get_property(pid, GF_PROP_PID_FILEPATH);
-    if (!p)
-      p = gf_filter_pid_get_property(pid, GF_PROP_PID_URL);
-    if (p && p->value.string)
-      dasher_open_close_file(filter, pid, p->value.string, FALSE);
-  }
+  if (dasher_ctx->dst)
+    return dasher_ctx->dst;
+
+  p = gf_filter_pid_get_property(pid, GF_PROP_PID_FILEPATH);
+  if (!p)
+    p = gf_filter_pid_get_property(pid, GF_PROP_PID_URL);
+  return p ? p->value.string : NULL;
+}
+
+void
+dasher_setup_file(GF_Filter* filter, GF_FilterPid* pid)
+{
+  const gchar* name = dasher_get_default_name(filter, pid);
+  if (name)
+    dasher_open_close_file(filter, pid, name, FALSE);
 }
 
 GF_Err
@@ -346,7 +932,7 @@ dasher_ensure_file(GF_Filter* filter, GF_FilterPid* pid, gboolean is_llhls)
     return GF_IO_ERR;
   }
 
-  if (G_UNLIKELY(!(*file)->out)) {
+  if (G_UNLIKELY(!(*file)->out && !io_ctx->sess->shm)) {
     GST_ELEMENT_ERROR(io_ctx->sess->element,
                       STREAM,
                       FAILED,
@@ -372,6 +958,18 @@ dasher_write_data(GF_Filter* filter,
     (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
   DasherCtx* dasher_ctx = (DasherCtx*)ctx->private_ctx;
 
+  if (file && io_ctx->sess->shm) {
+    GPAC_ShmDescriptor desc = { 0 };
+    desc.pts = desc.dts = desc.duration = GST_CLOCK_TIME_NONE;
+    desc.flags = file->shm_flags;
+    g_strlcpy(desc.name, file->name, sizeof(desc.name));
+    if (!gpac_shm_ring_write(io_ctx->sess->shm, data, size, &desc))
+      return GF_IO_ERR;
+    file->shm_flags &= ~GPAC_SHM_FLAG_FILE_START;
+    file->size += size;
+    return GF_OK;
+  }
+
   if (!file || !file->out) {
     GST_ELEMENT_ERROR(io_ctx->sess->element,
                       STREAM,
@@ -382,8 +980,10 @@ dasher_write_data(GF_Filter* filter,
     return GF_IO_ERR;
   }
 
+  GPAC_TRACE_BEGIN(span);
   gssize bytes_written =
     g_output_stream_write(file->out, data, size, NULL, NULL);
+  GPAC_TRACE_END(span, "dasher_write_data", file->name);
   if (bytes_written < 0) {
     GST_ELEMENT_ERROR(io_ctx->sess->element,
                       STREAM,
@@ -407,6 +1007,12 @@ dasher_write_data(GF_Filter* filter,
                          bytes_written));
   }
 
+  file->size += bytes_written;
+  if (file->head && file->head->len < DASHER_HEAD_MAX_SIZE)
+    g_byte_array_append(
+      file->head,
+      data,
+      MIN((guint)bytes_written, DASHER_HEAD_MAX_SIZE - file->head->len));
   GST_TRACE_OBJECT(io_ctx->sess->element,
                    "Wrote %s, size: %" G_GSIZE_FORMAT,
                    file->name ? file->name : "unknown",
@@ -415,6 +1021,125 @@ dasher_write_data(GF_Filter* filter,
   return GF_OK;
 }
 
+static void
+dasher_publish_state(GF_Filter* filter)
+{
+  GPAC_MemIoContext* io_ctx = (GPAC_MemIoContext*)gf_filter_get_rt_udta(filter);
+  GPAC_SessionContext* sess = io_ctx->sess;
+  if (!sess->state_file)
+    return;
+
+  // Only read and hash the state once the dasher saved it again, it may not
+  // have saved it at all yet
+  GFile* file = g_file_new_for_path(sess->state_file);
+  GFileInfo* file_info =
+    g_file_query_info(file,
+                      G_FILE_ATTRIBUTE_TIME_MODIFIED
+                      "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+                      "," G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                      G_FILE_QUERY_INFO_NONE,
+                      NULL,
+                      NULL);
+  g_object_unref(file);
+  if (!file_info)
+    return;
+
+  gint64 mtime = g_file_info_get_attribute_uint64(
+                   file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) *
+                   G_USEC_PER_SEC +
+                 g_file_info_get_attribute_uint32(
+                   file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+  goffset file_size = g_file_info_get_size(file_info);
+  g_object_unref(file_info);
+  if (sess->state_checksum && mtime == sess->state_mtime &&
+      file_size == sess->state_size)
+    return;
+  sess->state_mtime = mtime;
+  sess->state_size = file_size;
+
+  gchar* data;
+  gsize size;
+  if (!g_file_get_contents(sess->state_file, &data, &size, NULL))
+    return;
+
+  gchar* checksum = g_compute_checksum_for_data(
+    G_CHECKSUM_SHA256, (const guchar*)data, size);
+  if (!g_strcmp0(checksum, sess->state_checksum)) {
+    g_free(checksum);
+    g_free(data);
+    return;
+  }
+  g_free(sess->state_checksum);
+  sess->state_checksum = checksum;
+
+  GBytes* bytes = g_bytes_new_take(data, size);
+  GstStructure* info =
+    gst_structure_new(gpac_signal_names[GPAC_SIGNAL_DASHER_STATE_UPDATED - 1],
+                      "name",
+                      G_TYPE_STRING,
+                      sess->state_file,
+                      "data",
+                      G_TYPE_BYTES,
+                      bytes,
+                      NULL);
+  g_bytes_unref(bytes);
+  gpac_signal_emitter_notify(
+    sess->signals, GPAC_SIGNAL_DASHER_STATE_UPDATED, info);
+}
+
+GF_Err
+dasher_flush_manifest(GF_Filter* filter, GF_FilterPid* pid)
+{
+  GPAC_MemIoContext* io_ctx = (GPAC_MemIoContext*)gf_filter_get_rt_udta(filter);
+  GPAC_MemOutPIDContext* ctx =
+    (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
+  DasherCtx* dasher_ctx = (DasherCtx*)ctx->private_ctx;
+
+  if (!dasher_ctx->manifest_name)
+    return GF_OK;
+
+  GF_Err e = GF_OK;
+  gchar* name = g_steal_pointer(&dasher_ctx->manifest_name);
+  GByteArray* manifest = dasher_ctx->manifest;
+  if (io_ctx->iframe_playlists && g_str_has_suffix(name, ".m3u8") &&
+      dasher_is_main_manifest(dasher_ctx, name))
+    dasher_advertise_iframes(io_ctx, manifest);
+  gchar* hash = g_compute_checksum_for_data(
+    G_CHECKSUM_SHA256, manifest->data, manifest->len);
+
+  // Regenerated manifests are often identical, do not touch the file then
+  if (!g_strcmp0(g_hash_table_lookup(dasher_ctx->manifest_hashes, name),
+                 hash)) {
+    GST_TRACE_OBJECT(
+      io_ctx->sess->element, "Manifest %s is unchanged, skipping", name);
+    g_free(hash);
+    g_free(name);
+    goto finish;
+  }
+
+  dasher_open_close_file(filter, pid, name, FALSE);
+  e = dasher_ensure_file(filter, pid, FALSE);
+  if (e == GF_OK)
+    e = dasher_write_data(
+      filter, pid, dasher_ctx->main_file, manifest->data, manifest->len);
+  dasher_open_close_file(filter, pid, NULL, FALSE);
+
+  // Only remember what was actually written
+  if (e == GF_OK) {
+    g_hash_table_replace(dasher_ctx->manifest_hashes, name, hash);
+  } else {
+    g_free(hash);
+    g_free(name);
+  }
+
+finish:
+  g_byte_array_set_size(manifest, 0);
+
+  // The live state is saved along with the manifests
+  dasher_publish_state(filter);
+  return e;
+}
+
 GF_Err
 dasher_post_process(GF_Filter* filter, GF_FilterPid* pid, GF_FilterPacket* pck)
 {
@@ -427,8 +1152,13 @@ dasher_post_process(GF_Filter* filter, GF_FilterPid* pid, GF_FilterPacket* pck)
 
   if (!pck) {
     if (gf_filter_pid_is_eos(pid) && !gf_filter_pid_is_flush_eos(pid)) {
+      dasher_flush_manifest(filter, pid);
       dasher_open_close_file(filter, pid, NULL, FALSE);
       dasher_open_close_file(filter, pid, NULL, TRUE);
+      if (dasher_ctx->iframes && !dasher_ctx->iframes->ended) {
+        dasher_ctx->iframes->ended = TRUE;
+        dasher_write_iframes(filter, dasher_ctx->iframes);
+      }
     }
     return GF_OK; // No packet to process
   }
@@ -452,6 +1182,8 @@ dasher_post_process(GF_Filter* filter, GF_FilterPid* pid, GF_FilterPacket* pck)
 
   if (start) {
     // Previous file has ended, move to the next file
+    if (dasher_ctx->is_manifest)
+      gpac_return_if_fail(dasher_flush_manifest(filter, pid));
     if (dasher_ctx->main_file)
       dasher_open_close_file(filter, pid, NULL, FALSE);
 
@@ -475,12 +1207,21 @@ dasher_post_process(GF_Filter* filter, GF_FilterPid* pid, GF_FilterPacket* pck)
     if (fname)
       name = fname->value.string;
 
-    if (name) {
+    if (dasher_ctx->is_manifest) {
+      // Held back until the manifest is complete
+      if (!name)
+        name = dasher_get_default_name(filter, pid);
+      dasher_ctx->manifest_name = g_strdup(name);
+    } else if (name) {
       dasher_open_close_file(filter, pid, name, FALSE);
     } else if (!dasher_ctx->main_file) {
       dasher_setup_file(filter, pid);
     }
 
+    // Number the segment for the notifications
+    if (fnum && dasher_ctx->main_file)
+      dasher_ctx->main_file->sequence = fnum->value.uint;
+
     fname = gf_filter_pck_get_property(pck, GF_PROP_PCK_LLHAS_TEMPLATE);
     if (fname) {
       if (dasher_ctx->llhas_template)
@@ -502,6 +1243,16 @@ dasher_post_process(GF_Filter* filter, GF_FilterPid* pid, GF_FilterPacket* pck)
     return GF_OK;
   }
 
+  if (dasher_ctx->is_manifest) {
+    if (!dasher_ctx->manifest_name)
+      dasher_ctx->manifest_name =
+        g_strdup(dasher_get_default_name(filter, pid));
+    g_byte_array_append(dasher_ctx->manifest, data, size);
+    if (end)
+      return dasher_flush_manifest(filter, pid);
+    return GF_OK;
+  }
+
   // We must be actively working on a file by now
   gpac_return_if_fail(dasher_ensure_file(filter, pid, FALSE));
 
@@ -516,6 +1267,8 @@ dasher_post_process(GF_Filter* filter, GF_FilterPid* pid, GF_FilterPacket* pck)
 
     // Ensure the file is set up for llhls
     gpac_return_if_fail(dasher_ensure_file(filter, pid, TRUE));
+    dasher_ctx->llhls_file->sequence = dasher_ctx->main_file->sequence;
+    dasher_ctx->llhls_file->part = (gint32)p->value.uint;
   }
 
   // Write the data to the output stream
@@ -526,10 +1279,8 @@ dasher_post_process(GF_Filter* filter, GF_FilterPid* pid, GF_FilterPacket* pck)
     gpac_return_if_fail(
       dasher_write_data(filter, pid, dasher_ctx->llhls_file, data, size));
   }
-
-  // Close the output stream
-  if (end && dasher_ctx->is_manifest)
-    dasher_open_close_file(filter, pid, NULL, FALSE);
+  dasher_track_packet(pid, dasher_ctx->main_file, pck);
+  dasher_track_packet(pid, dasher_ctx->llhls_file, pck);
 
   return GF_OK;
 }
@@ -540,3 +1291,10 @@ dasher_consume(GF_Filter* filter, GF_FilterPid* pid, void** outptr)
   // We don't output any buffers directly
   return GPAC_FILTER_PP_RET_NULL;
 }
+
+gsize
+dasher_queued_bytes(GF_Filter* filter, GF_FilterPid* pid)
+{
+  // Data is written out as soon as it is received
+  return 0;
+}
@@ -114,3 +114,16 @@ generic_consume(GF_Filter* filter, GF_FilterPid* pid, void** outptr)
   }
   return GPAC_FILTER_PP_RET_NULL;
 }
+
+gsize
+generic_queued_bytes(GF_Filter* filter, GF_FilterPid* pid)
+{
+  GPAC_MemOutPIDContext* ctx =
+    (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
+  GenericCtx* generic_ctx = (GenericCtx*)ctx->private_ctx;
+
+  gsize bytes = 0;
+  for (GList* l = generic_ctx->output_queue->head; l; l = l->next)
+    bytes += gst_buffer_get_size((GstBuffer*)l->data);
+  return bytes;
+}
@@ -0,0 +1,284 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "common.h"
+#include "lib/memio.h"
+
+// TS packets per output buffer, 7 * 188 fits a 1500 bytes MTU with RTP/UDP
+#define M2TSMX_PACKET_SIZE 188
+#define M2TSMX_PACKETS_PER_CHUNK 7
+// PCR is a 33-bit base at 90kHz times 300, plus a 9-bit extension
+#define M2TSMX_PCR_WRAP ((G_GUINT64_CONSTANT(1) << 33) * 300)
+#define M2TSMX_PCR_CLOCK 27000000
+
+typedef struct
+{
+  GQueue* output_queue;
+
+  // Timing derived from the PCR
+  guint64 timescale;
+  guint64 last_pcr;
+  GstClockTime pcr_time;
+  gint pcr_pid; // random access is only signalled on this PID
+} M2tsmxCtx;
+
+void
+m2tsmx_ctx_init(void** process_ctx)
+{
+  *process_ctx = g_new0(M2tsmxCtx, 1);
+  M2tsmxCtx* ctx = (M2tsmxCtx*)*process_ctx;
+  ctx->output_queue = g_queue_new();
+  ctx->pcr_time = GST_CLOCK_TIME_NONE;
+  ctx->pcr_pid = -1;
+}
+
+void
+m2tsmx_ctx_free(void* process_ctx)
+{
+  M2tsmxCtx* ctx = (M2tsmxCtx*)process_ctx;
+
+  // Free the output queue
+  while (!g_queue_is_empty(ctx->output_queue))
+    gst_buffer_unref((GstBuffer*)g_queue_pop_head(ctx->output_queue));
+  g_queue_free(ctx->output_queue);
+
+  // Free the context
+  g_free(ctx);
+}
+
+GF_Err
+m2tsmx_configure_pid(GF_Filter* filter, GF_FilterPid* pid)
+{
+  GPAC_MemOutPIDContext* pctx =
+    (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
+  M2tsmxCtx* m2tsmx_ctx = (M2tsmxCtx*)pctx->private_ctx;
+
+  // Get the timescale from the PID
+  m2tsmx_ctx->timescale = 0;
+  const GF_PropertyValue* p =
+    gf_filter_pid_get_property(pid, GF_PROP_PID_TIMESCALE);
+  if (p)
+    m2tsmx_ctx->timescale = p->value.uint;
+
+  return GF_OK;
+}
+
+Bool
+m2tsmx_process_event(GF_Filter* filter, const GF_FilterEvent* evt)
+{
+  return GF_FALSE; // No event processing
+}
+
+// #MARK: TS Parsing
+static gboolean
+m2tsmx_parse_packet(const u8* ts,
+                    guint* pid,
+                    guint64* pcr,
+                    gboolean* random_access)
+{
+  *random_access = FALSE;
+  if (ts[0] != 0x47)
+    return FALSE;
+  *pid = ((ts[1] & 0x1f) << 8) | ts[2];
+
+  // Only the adaptation field is of interest
+  if (!(ts[3] & 0x20) || ts[4] == 0)
+    return FALSE;
+  *random_access = (ts[5] & 0x40) != 0;
+  if (!(ts[5] & 0x10) || ts[4] < 7)
+    return FALSE;
+
+  guint64 base = ((guint64)ts[6] << 25) | ((guint64)ts[7] << 17) |
+                 ((guint64)ts[8] << 9) | ((guint64)ts[9] << 1) | (ts[10] >> 7);
+  guint64 ext = ((guint64)(ts[10] & 1) << 8) | ts[11];
+  *pcr = base * 300 + ext;
+  return TRUE;
+}
+
+static void
+m2tsmx_update_pcr_time(M2tsmxCtx* ctx, guint64 pcr, GstClockTime base)
+{
+  if (!GST_CLOCK_TIME_IS_VALID(ctx->pcr_time)) {
+    // The first PCR is anchored on the stream start
+    ctx->pcr_time = base;
+  } else {
+    guint64 delta = (pcr + M2TSMX_PCR_WRAP - ctx->last_pcr) % M2TSMX_PCR_WRAP;
+    ctx->pcr_time += gf_timestamp_rescale(delta, M2TSMX_PCR_CLOCK, GST_SECOND);
+  }
+  ctx->last_pcr = pcr;
+}
+
+static void
+m2tsmx_push_chunk(M2tsmxCtx* ctx,
+                  GstBuffer* buffer,
+                  gsize offset,
+                  gsize size,
+                  GstClockTime pts,
+                  gboolean random_access)
+{
+  GstBuffer* chunk =
+    gst_buffer_copy_region(buffer, GST_BUFFER_COPY_ALL, offset, size);
+
+  GST_BUFFER_PTS(chunk) = pts;
+  GST_BUFFER_DTS(chunk) = pts;
+  if (!random_access)
+    GST_BUFFER_FLAG_SET(chunk, GST_BUFFER_FLAG_DELTA_UNIT);
+  g_queue_push_tail(ctx->output_queue, chunk);
+}
+
+// #MARK: Post-Processing
+GF_Err
+m2tsmx_post_process(GF_Filter* filter, GF_FilterPid* pid, GF_FilterPacket* pck)
+{
+  GPAC_MemIoContext* io_ctx = (GPAC_MemIoContext*)gf_filter_get_rt_udta(filter);
+  GPAC_MemOutPIDContext* ctx =
+    (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
+  M2tsmxCtx* m2tsmx_ctx = (M2tsmxCtx*)ctx->private_ctx;
+
+  if (!pck)
+    return GF_OK;
+
+  // Get the data
+  u32 size;
+  const u8* data = gf_filter_pck_get_data(pck, &size);
+  gf_filter_pck_ref(&pck);
+  GstBuffer* buffer =
+    gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                                (u8*)data,
+                                size,
+                                0,
+                                size,
+                                pck,
+                                (GDestroyNotify)gf_filter_pck_unref);
+
+  GstClockTime base = 0;
+  if (io_ctx->global_offset != GST_CLOCK_TIME_NONE)
+    base = io_ctx->global_offset;
+
+  // Prefer the packet timing when the muxer provides it
+  GstClockTime pck_time = GST_CLOCK_TIME_NONE;
+  u64 cts = gf_filter_pck_get_cts(pck);
+  if (cts != GF_FILTER_NO_TS && m2tsmx_ctx->timescale)
+    pck_time =
+      gf_timestamp_rescale(cts, m2tsmx_ctx->timescale, GST_SECOND) + base;
+  gboolean pck_sap = gf_filter_pck_get_sap(pck) != GF_FILTER_SAP_NONE;
+
+  if (size % M2TSMX_PACKET_SIZE)
+    GST_WARNING_OBJECT(io_ctx->sess->element,
+                       "Muxer output of %u bytes is not packet aligned",
+                       size);
+
+  // Split into aligned chunks, a random access point always starts a chunk
+  gsize chunk_start = 0;
+  gboolean chunk_ra = pck_sap;
+  GstClockTime chunk_time = pck_time;
+  for (gsize offset = 0; offset + M2TSMX_PACKET_SIZE <= size;
+       offset += M2TSMX_PACKET_SIZE) {
+    guint ts_pid = 0;
+    guint64 pcr;
+    gboolean random_access;
+    gboolean has_pcr =
+      m2tsmx_parse_packet(data + offset, &ts_pid, &pcr, &random_access);
+    if (has_pcr) {
+      if (m2tsmx_ctx->pcr_pid < 0)
+        m2tsmx_ctx->pcr_pid = ts_pid;
+      m2tsmx_update_pcr_time(m2tsmx_ctx, pcr, base);
+    }
+
+    // Audio frames are all random access points, only the PCR PID (the
+    // video one when there is video) tells where decoding can start
+    if (random_access && (gint)ts_pid != m2tsmx_ctx->pcr_pid)
+      random_access = FALSE;
+
+    gsize chunk_size = offset - chunk_start;
+    if (chunk_size &&
+        (random_access ||
+         chunk_size == M2TSMX_PACKETS_PER_CHUNK * M2TSMX_PACKET_SIZE)) {
+      m2tsmx_push_chunk(
+        m2tsmx_ctx, buffer, chunk_start, chunk_size, chunk_time, chunk_ra);
+      chunk_start = offset;
+      chunk_ra = FALSE;
+      chunk_time = GST_CLOCK_TIME_NONE;
+    }
+
+    chunk_ra |= random_access;
+    if (!GST_CLOCK_TIME_IS_VALID(chunk_time))
+      chunk_time = GST_CLOCK_TIME_IS_VALID(pck_time) ? pck_time
+                                                     : m2tsmx_ctx->pcr_time;
+
+    // The tables sent before the first PCR start at the stream start
+    if (!GST_CLOCK_TIME_IS_VALID(chunk_time))
+      chunk_time = base;
+  }
+
+  // Flush the remaining data, including any unaligned tail
+  if (chunk_start < size)
+    m2tsmx_push_chunk(m2tsmx_ctx,
+                      buffer,
+                      chunk_start,
+                      size - chunk_start,
+                      chunk_time,
+                      chunk_ra);
+
+  gst_buffer_unref(buffer);
+  return GF_OK;
+}
+
+GPAC_FilterPPRet
+m2tsmx_consume(GF_Filter* filter, GF_FilterPid* pid, void** outptr)
+{
+  GPAC_MemOutPIDContext* ctx =
+    (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
+  M2tsmxCtx* m2tsmx_ctx = (M2tsmxCtx*)ctx->private_ctx;
+
+  // Check if the queue is empty
+  if (g_queue_is_empty(m2tsmx_ctx->output_queue))
+    return GPAC_FILTER_PP_RET_EMPTY;
+
+  if (!outptr)
+    return GPAC_FILTER_PP_RET_NULL;
+
+  // Everything produced since the last cycle goes out in a single push
+  GstBufferList* buffer_list =
+    gst_buffer_list_new_sized(g_queue_get_length(m2tsmx_ctx->output_queue));
+  while (!g_queue_is_empty(m2tsmx_ctx->output_queue))
+    gst_buffer_list_add(buffer_list,
+                        g_queue_pop_head(m2tsmx_ctx->output_queue));
+
+  *outptr = buffer_list;
+  return GPAC_FILTER_PP_RET_BUFFER_LIST;
+}
+
+gsize
+m2tsmx_queued_bytes(GF_Filter* filter, GF_FilterPid* pid)
+{
+  GPAC_MemOutPIDContext* ctx =
+    (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
+  M2tsmxCtx* m2tsmx_ctx = (M2tsmxCtx*)ctx->private_ctx;
+
+  gsize bytes = 0;
+  for (GList* l = m2tsmx_ctx->output_queue->head; l; l = l->next)
+    bytes += gst_buffer_get_size((GstBuffer*)l->data);
+  return bytes;
+}
@@ -944,7 +944,9 @@ mp4mx_post_process(GF_Filter* filter, GF_FilterPid* pid, GF_FilterPacket* pck)
     return GF_OK;
 
   // Create and enqueue the buffer list
+  GPAC_TRACE_BEGIN(span);
   GstBufferList* buffer_list = mp4mx_create_buffer_list(filter, pid);
+  GPAC_TRACE_END(span, "mp4mx_create_buffer_list", gf_filter_pid_get_name(pid));
   g_queue_push_tail(mp4mx_ctx->output_queue, buffer_list);
 
   // Increment the segment count
@@ -977,3 +979,31 @@ mp4mx_consume(GF_Filter* filter, GF_FilterPid* pid, void** outptr)
   }
   return GPAC_FILTER_PP_RET_NULL;
 }
+
+gsize
+mp4mx_queued_bytes(GF_Filter* filter, GF_FilterPid* pid)
+{
+  GPAC_MemOutPIDContext* ctx =
+    (GPAC_MemOutPIDContext*)gf_filter_pid_get_udta(pid);
+  Mp4mxCtx* mp4mx_ctx = (Mp4mxCtx*)ctx->private_ctx;
+  gsize bytes = 0;
+
+  // Boxes still being parsed
+  for (GList* l = mp4mx_ctx->box_queue->head; l; l = l->next) {
+    BoxInfo* box = l->data;
+    if (box->buffer)
+      bytes += gst_buffer_get_size(box->buffer);
+  }
+
+  // Fragment being assembled
+  for (guint i = 0; i < LAST; i++) {
+    if (GET_TYPE(i)->buffer)
+      bytes += gst_buffer_get_size(GET_TYPE(i)->buffer);
+  }
+
+  // Complete fragments
+  for (GList* l = mp4mx_ctx->output_queue->head; l; l = l->next)
+    bytes += gst_buffer_list_calculate_size((GstBufferList*)l->data);
+
+  return bytes;
+}
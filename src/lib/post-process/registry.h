@@ -39,25 +39,30 @@
   Bool filter_name##_process_event(GF_Filter* filter,                       \
                                    const GF_FilterEvent* evt);              \
   GPAC_FilterPPRet filter_name##_consume(                                   \
-    GF_Filter* filter, GF_FilterPid* pid, void** outptr);
+    GF_Filter* filter, GF_FilterPid* pid, void** outptr);                   \
+  gsize filter_name##_queued_bytes(GF_Filter* filter, GF_FilterPid* pid);
 
 #define GPAC_FILTER_PP_IMPL_DEFINE(filter_name) \
   { #filter_name,                               \
+    #filter_name "_post_process",               \
     filter_name##_ctx_init,                     \
     filter_name##_ctx_free,                     \
     filter_name##_configure_pid,                \
     filter_name##_post_process,                 \
     filter_name##_process_event,                \
-    filter_name##_consume }
+    filter_name##_consume,                      \
+    filter_name##_queued_bytes }
 
 // Forward declarations
 GPAC_FILTER_PP_IMPL_DECL(generic);
 GPAC_FILTER_PP_IMPL_DECL(mp4mx);
 GPAC_FILTER_PP_IMPL_DECL(dasher);
+GPAC_FILTER_PP_IMPL_DECL(m2tsmx);
 
 typedef struct
 {
   const gchar* filter_name;
+  const gchar* post_process_name; // span name when tracing
 
   // Handlers
   void (*ctx_init)(void** process_ctx);
@@ -70,12 +75,16 @@ typedef struct
   GPAC_FilterPPRet (*consume)(GF_Filter* filter,
                               GF_FilterPid* pid,
                               void** outptr);
+
+  // Bytes held by the post-processor, waiting to be consumed
+  gsize (*queued_bytes)(GF_Filter* filter, GF_FilterPid* pid);
 } post_process_registry_entry;
 
 static post_process_registry_entry pp_registry[] = {
   GPAC_FILTER_PP_IMPL_DEFINE(generic),
   GPAC_FILTER_PP_IMPL_DEFINE(mp4mx),
   GPAC_FILTER_PP_IMPL_DEFINE(dasher),
+  GPAC_FILTER_PP_IMPL_DEFINE(m2tsmx),
 };
 
 static inline u32
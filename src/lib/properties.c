@@ -24,6 +24,9 @@
  */
 
 #include "lib/properties.h"
+#include "lib/filters.h"
+#include "lib/shm.h"
+#include "lib/trace.h"
 #include "gpacmessages.h"
 #include <gpac/filters.h>
 
@@ -84,9 +87,12 @@ gpac_install_local_properties(GObjectClass* gobject_class,
           prop,
           g_param_spec_string("graph",
                               "Graph",
-                              "Filter graph to use in gpac session",
+                              "Filter graph to use in gpac session, a new "
+                              "graph set while running is switched to at the "
+                              "next key frame, its output starts with a new "
+                              "header and is marked as a discontinuity",
                               NULL,
-                              G_PARAM_READWRITE));
+                              G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
         break;
 
       case GPAC_PROP_PRINT_STATS:
@@ -107,7 +113,7 @@ gpac_install_local_properties(GObjectClass* gobject_class,
           g_param_spec_boolean(
             "sync",
             "Sync",
-            "Enable synchronization on the internal fakesink",
+            "Synchronize the processing on the clock, as a sink would",
             FALSE,
             G_PARAM_READWRITE));
         break;
@@ -124,6 +130,161 @@ gpac_install_local_properties(GObjectClass* gobject_class,
                               G_PARAM_READWRITE));
         break;
 
+      case GPAC_PROP_REUSE_SESSION:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_boolean(
+            "reuse-session",
+            "Reuse Session",
+            "Prepare a new filter session when stopping, so that the next "
+            "start with the same graph and options does not rebuild it",
+            FALSE,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_FRAMED_INPUT:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_boolean(
+            "framed-input",
+            "Framed Input",
+            "Hand access unit aligned H.264 and H.265 streams to gpac as "
+            "framed packets instead of going through its reframer",
+            FALSE,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_MAX_SIZE_BYTES:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_uint64(
+            "max-size-bytes",
+            "Max Size Bytes",
+            "Maximum amount of data held inside the element before input is "
+            "held back (0 = unlimited)",
+            0,
+            G_MAXUINT64,
+            0,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_MAX_SIZE_TIME:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_uint64(
+            "max-size-time",
+            "Max Size Time",
+            "Maximum duration buffered inside the element, in nanoseconds, "
+            "before input is held back (0 = unlimited)",
+            0,
+            G_MAXUINT64,
+            0,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_CURRENT_LEVEL_BYTES:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_uint64(
+            "current-level-bytes",
+            "Current Level Bytes",
+            "Amount of data currently held inside the element",
+            0,
+            G_MAXUINT64,
+            0,
+            G_PARAM_READABLE));
+        break;
+
+      case GPAC_PROP_CURRENT_LEVEL_TIME:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_uint64(
+            "current-level-time",
+            "Current Level Time",
+            "Duration currently buffered inside the element, in nanoseconds",
+            0,
+            G_MAXUINT64,
+            0,
+            G_PARAM_READABLE));
+        break;
+
+      case GPAC_PROP_TRACE_FILE:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_string(
+            "trace-file",
+            "Trace File",
+            "Write a Trace Event JSON file of the plugin and GPAC scheduling "
+            "hot paths, viewable in Perfetto. Overrides the " GPAC_TRACE_ENV
+            " environment variable",
+            NULL,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_SHM_SOCKET:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_string(
+            "shm-socket",
+            "Shared Memory Socket",
+            "Write the output once into a memfd ring and announce it to "
+            "consumer processes on this Unix socket path (Linux only)",
+            NULL,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_SHM_SIZE:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_uint64(
+            "shm-size",
+            "Shared Memory Size",
+            "Size of the shared memory ring, in bytes",
+            64 * 1024,
+            G_MAXUINT64,
+            GPAC_SHM_DEFAULT_SIZE,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_SHARED_SESSION:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_string(
+            "shared-session",
+            "Shared Session",
+            "Attach to the GPAC filter session of this name, shared with the "
+            "other elements using it, instead of running a private one. "
+            "Filters with the same FID are shared between the elements",
+            NULL,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_SIGNAL_QUEUE_SIZE:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_uint64(
+            "signal-queue-size",
+            "Signal Queue Size",
+            "Emit the output signals from a dispatcher thread, queuing up to "
+            "this many bytes of output for it. 0 emits them on the GPAC "
+            "thread, which waits for the handlers",
+            0,
+            G_MAXUINT64,
+            0,
+            G_PARAM_READWRITE));
+        break;
+
       case GPAC_PROP_SEGDUR:
         g_object_class_install_property(
           gobject_class,
@@ -139,6 +300,74 @@ gpac_install_local_properties(GObjectClass* gobject_class,
             G_PARAM_READWRITE));
         break;
 
+      case GPAC_PROP_STATS:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_boxed("stats",
+                             "Statistics",
+                             "Per-stage counters and latency histograms of "
+                             "the element and its sink pads, and the filters "
+                             "of the running session",
+                             GST_TYPE_STRUCTURE,
+                             G_PARAM_READABLE));
+        break;
+
+      case GPAC_PROP_STATS_INTERVAL:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_uint64(
+            "stats-interval",
+            "Statistics Interval",
+            "Interval in nanoseconds at which the statistics are posted as an "
+            "element message on the bus (0 = disabled)",
+            0,
+            G_MAXUINT64,
+            0,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_IFRAME_PLAYLIST:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_boolean(
+            "iframe-playlist",
+            "I-Frame Playlist",
+            "Write an HLS I-frame only playlist for each video representation, "
+            "using byte ranges into the segments, and list it in the master "
+            "playlist. Not available with the shared memory output",
+            FALSE,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_QOS:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_boolean(
+            "qos",
+            "QoS",
+            "Send QoS events upstream and post QoS messages when the GPAC "
+            "session falls behind the clock",
+            TRUE,
+            G_PARAM_READWRITE));
+        break;
+
+      case GPAC_PROP_QOS_DROP:
+        g_object_class_install_property(
+          gobject_class,
+          prop,
+          g_param_spec_boolean(
+            "qos-drop",
+            "QoS Drop",
+            "Drop the buffers flagged as droppable, such as non-reference "
+            "frames, while the GPAC session is late",
+            FALSE,
+            G_PARAM_READWRITE));
+        break;
+
       default:
         break;
     }
@@ -156,74 +385,60 @@ gpac_install_filter_properties(GObjectClass* gobject_class,
                                GList* blacklist,
                                const gchar* filter_name)
 {
-  gf_sys_init(GF_MemTrackerNone, NULL);
-  GF_FilterSession* session = gf_fs_new_defaults(0U);
-  guint num_filters = gf_fs_filters_registers_count(session);
-
-  // Get the list seperator
-  GF_Err e;
-  GF_Filter* dummy = gf_fs_new_filter(session, "dummy", 0, &e);
-  char sep_list = (char)gf_filter_get_sep(dummy, GF_FS_SEP_LIST);
-
-  const GF_FilterRegister* filter;
-  for (guint i = 0; i < num_filters; i++) {
-    filter = gf_fs_get_filter_register(session, i);
-    if (!g_strcmp0(filter->name, filter_name))
-      break;
-    filter = NULL;
-  }
-  gf_fs_del(session);
-  gf_sys_close();
+  // Look up the filter in the register snapshot
+  const GPAC_FilterInfo* filter = gpac_filter_registry_lookup(filter_name);
+  gchar sep_list = gpac_filter_registry_get_list_sep();
   g_assert(filter);
 
   guint option_idx = 0;
-  while (filter->args && filter->args[option_idx].arg_name) {
+  while (option_idx < filter->num_args) {
+    const GPAC_FilterArg* arg = &filter->args[option_idx];
+
     // Skip hidden options
-    if (filter->args[option_idx].flags & GF_ARG_HINT_HIDE)
+    if (arg->flags & GF_ARG_HINT_HIDE)
       goto skip;
 
     // Check if the option name is valid
-    if (!g_param_spec_is_valid_name(filter->args[option_idx].arg_name))
+    if (!g_param_spec_is_valid_name(arg->name))
       goto skip;
 
     // Check if the option is already registered
-    if (g_object_class_find_property(gobject_class,
-                                     filter->args[option_idx].arg_name))
+    if (g_object_class_find_property(gobject_class, arg->name))
       goto skip;
 
     // Check if the option is blacklisted
     GList* item;
     for (item = blacklist; item; item = item->next)
-      if (!g_strcmp0(filter->args[option_idx].arg_name, item->data))
+      if (!g_strcmp0(arg->name, item->data))
         goto skip;
 
-#define SPEC_INSTALL(type, ...)                            \
-  g_object_class_install_property(                         \
-    gobject_class,                                         \
-    GPAC_PROP_FILTER_OFFSET + option_idx,                  \
-    g_param_spec_##type(filter->args[option_idx].arg_name, \
-                        filter->args[option_idx].arg_name, \
-                        filter->args[option_idx].arg_desc, \
-                        __VA_ARGS__,                       \
-                        G_PARAM_WRITABLE));
+    // Options the filter can update at runtime stay writable while playing
+    GParamFlags flags = G_PARAM_WRITABLE;
+    if (arg->flags & GF_FS_ARG_UPDATE)
+      flags |= GST_PARAM_MUTABLE_PLAYING;
+
+#define SPEC_INSTALL(type, ...)                                         \
+  g_object_class_install_property(                                      \
+    gobject_class,                                                      \
+    GPAC_PROP_FILTER_OFFSET + option_idx,                               \
+    g_param_spec_##type(                                                \
+      arg->name, arg->name, arg->description, __VA_ARGS__, flags));
 
     // Special case for enum values
-    if (filter->args[option_idx].min_max_enum &&
-        strstr(filter->args[option_idx].min_max_enum, "|")) {
+    if (arg->min_max_enum && strstr(arg->min_max_enum, "|")) {
       SPEC_INSTALL(string, NULL);
       goto skip;
     }
 
     // Parse the default value
-    const GF_PropertyValue p =
-      gf_props_parse_value(filter->args[option_idx].arg_type,
-                           filter->args[option_idx].arg_name,
-                           filter->args[option_idx].arg_default_val,
-                           filter->args[option_idx].min_max_enum,
-                           sep_list);
+    const GF_PropertyValue p = gf_props_parse_value(arg->type,
+                                                    arg->name,
+                                                    arg->default_value,
+                                                    arg->min_max_enum,
+                                                    sep_list);
 
     // Register the option
-    switch (filter->args[option_idx].arg_type) {
+    switch (arg->type) {
       case GF_PROP_SINT:
         SPEC_INSTALL(int, G_MININT, G_MAXINT, p.value.sint);
         break;
@@ -300,13 +515,42 @@ gpac_install_global_properties(GObjectClass* gobject_class)
   }
 }
 
+gboolean
+gpac_property_to_option(GParamSpec* pspec,
+                        const GValue* value,
+                        gchar** name,
+                        gchar** value_str)
+{
+  // Get the value as a string
+  if (G_VALUE_HOLDS_STRING(value))
+    *value_str = g_value_dup_string(value);
+  else if (G_VALUE_HOLDS_BOOLEAN(value))
+    *value_str = g_strdup(g_value_get_boolean(value) ? "true" : "false");
+  else
+    *value_str = g_strdup_value_contents(value);
+
+  if (!*value_str)
+    return FALSE;
+
+  // Convert snake case to kebab case
+  // GLib uses kebab case for command line arguments, so we have to convert it
+  // back to snake case
+  *name = g_strdup(g_param_spec_get_name(pspec));
+  for (gchar* c = *name; *c; c++)
+    if (*c == '-')
+      *c = '_';
+  return TRUE;
+}
+
 gboolean
 gpac_set_property(GPAC_PropertyContext* ctx,
                   guint property_id,
                   const GValue* value,
                   GParamSpec* pspec)
 {
-  if (g_param_value_defaults(pspec, value))
+  // Top-level properties are stored as is, even when reset to their defaults
+  if (!IS_TOP_LEVEL_PROPERTY(property_id) &&
+      g_param_value_defaults(pspec, value))
     return TRUE;
 
   if (IS_TOP_LEVEL_PROPERTY(property_id)) {
@@ -325,31 +569,45 @@ gpac_set_property(GPAC_PropertyContext* ctx,
         g_free(ctx->destination);
         ctx->destination = g_value_dup_string(value);
         break;
+      case GPAC_PROP_REUSE_SESSION:
+        ctx->reuse_session = g_value_get_boolean(value);
+        break;
+      case GPAC_PROP_FRAMED_INPUT:
+        ctx->framed_input = g_value_get_boolean(value);
+        break;
+      case GPAC_PROP_MAX_SIZE_BYTES:
+        ctx->max_size_bytes = g_value_get_uint64(value);
+        break;
+      case GPAC_PROP_MAX_SIZE_TIME:
+        ctx->max_size_time = g_value_get_uint64(value);
+        break;
+      case GPAC_PROP_TRACE_FILE:
+        g_free(ctx->trace_file);
+        ctx->trace_file = g_value_dup_string(value);
+        break;
+      case GPAC_PROP_SHM_SOCKET:
+        g_free(ctx->shm_socket);
+        ctx->shm_socket = g_value_dup_string(value);
+        break;
+      case GPAC_PROP_SHM_SIZE:
+        ctx->shm_size = g_value_get_uint64(value);
+        break;
+      case GPAC_PROP_SHARED_SESSION:
+        g_free(ctx->shared_session);
+        ctx->shared_session = g_value_dup_string(value);
+        break;
+      case GPAC_PROP_SIGNAL_QUEUE_SIZE:
+        ctx->signal_queue_size = g_value_get_uint64(value);
+        break;
       default:
         return FALSE;
     }
   } else if (IS_FILTER_PROPERTY(property_id)) {
-    // Get the value as a string
-    gchar* value_str;
-    if (G_VALUE_HOLDS_STRING(value))
-      value_str = g_value_dup_string(value);
-    else if (G_VALUE_HOLDS_BOOLEAN(value))
-      value_str = g_strdup(g_value_get_boolean(value) ? "true" : "false");
-    else
-      value_str = g_strdup_value_contents(value);
-
     // No value, return
-    if (!value_str)
+    gchar *param, *value_str;
+    if (!gpac_property_to_option(pspec, value, &param, &value_str))
       return TRUE;
 
-    // Convert snake case to kebab case
-    // GLib uses kebab case for command line arguments, so we have to convert it
-    // back to snake case
-    gchar* param = g_strdup(g_param_spec_get_name(pspec));
-    for (gchar* c = param; *c; c++)
-      if (*c == '-')
-        *c = '_';
-
     // Add the property to the list
     gchar* property = g_strdup_printf("--%s=%s", param, value_str);
     ctx->properties = g_list_append(ctx->properties, property);
@@ -400,6 +658,39 @@ gpac_get_property(GPAC_PropertyContext* ctx,
       case GPAC_PROP_DESTINATION:
         g_value_set_string(value, ctx->destination);
         break;
+      case GPAC_PROP_REUSE_SESSION:
+        g_value_set_boolean(value, ctx->reuse_session);
+        break;
+      case GPAC_PROP_FRAMED_INPUT:
+        g_value_set_boolean(value, ctx->framed_input);
+        break;
+      case GPAC_PROP_MAX_SIZE_BYTES:
+        g_value_set_uint64(value, ctx->max_size_bytes);
+        break;
+      case GPAC_PROP_MAX_SIZE_TIME:
+        g_value_set_uint64(value, ctx->max_size_time);
+        break;
+      case GPAC_PROP_CURRENT_LEVEL_BYTES:
+        g_value_set_uint64(value, ctx->level_bytes);
+        break;
+      case GPAC_PROP_CURRENT_LEVEL_TIME:
+        g_value_set_uint64(value, ctx->level_time);
+        break;
+      case GPAC_PROP_TRACE_FILE:
+        g_value_set_string(value, ctx->trace_file);
+        break;
+      case GPAC_PROP_SHM_SOCKET:
+        g_value_set_string(value, ctx->shm_socket);
+        break;
+      case GPAC_PROP_SHM_SIZE:
+        g_value_set_uint64(value, ctx->shm_size);
+        break;
+      case GPAC_PROP_SHARED_SESSION:
+        g_value_set_string(value, ctx->shared_session);
+        break;
+      case GPAC_PROP_SIGNAL_QUEUE_SIZE:
+        g_value_set_uint64(value, ctx->signal_queue_size);
+        break;
       default:
         return FALSE;
     }
@@ -424,6 +715,18 @@ gpac_get_property(GPAC_PropertyContext* ctx,
   return TRUE;
 }
 
+const gchar*
+gpac_property_get_option(GPAC_PropertyContext* ctx, const gchar* name)
+{
+  gchar* prefix = g_strdup_printf("--%s=", name);
+  const gchar* value = NULL;
+  for (GList* l = ctx->properties; l; l = l->next)
+    if (g_str_has_prefix(l->data, prefix))
+      value = (const gchar*)l->data + strlen(prefix);
+  g_free(prefix);
+  return value;
+}
+
 gboolean
 gpac_apply_properties(GPAC_PropertyContext* ctx)
 {
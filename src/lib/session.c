@@ -24,12 +24,40 @@
  */
 
 #include "lib/session.h"
+#include "lib/main.h"
 #include "lib/memio.h"
+#include "lib/trace.h"
 #include <gpac/list.h>
 
 #define SEP_LINK 5
 #define SEP_FRAG 2
 
+// Maximum number of prepared sessions kept around per process
+#define GPAC_SESSION_POOL_SIZE 4
+
+typedef struct
+{
+  gchar* key;
+  GF_FilterSession* session;
+  GF_Filter* memin;
+  GF_Filter* memout;
+  GF_Filter* last_filter;
+} GPAC_PreparedSession;
+
+static GMutex session_pool_lock;
+static GQueue session_pool = G_QUEUE_INIT;
+
+struct _GPAC_SharedSession
+{
+  gchar* name;
+  GF_FilterSession* session;
+  GRecMutex lock; // serializes the elements driving the session
+  guint refcount; // protected by shared_sessions_lock
+};
+
+static GMutex shared_sessions_lock;
+static GHashTable* shared_sessions = NULL;
+
 GF_Err
 process_link_directive(char* link,
                        GF_Filter* filter,
@@ -92,21 +120,174 @@ process_link_directive(char* link,
   return GF_OK;
 }
 
+// #MARK: Shared Sessions
+static gboolean
+gpac_session_attach_shared(GPAC_SessionContext* ctx)
+{
+  g_mutex_lock(&shared_sessions_lock);
+  if (!shared_sessions)
+    shared_sessions = g_hash_table_new(g_str_hash, g_str_equal);
+
+  GPAC_SharedSession* shared =
+    g_hash_table_lookup(shared_sessions, ctx->shared_name);
+  if (!shared) {
+    GstElement* prev_target = gpac_log_set_target(ctx->element);
+    GF_FilterSession* session = gf_fs_new_defaults(GF_FS_FLAG_NON_BLOCKING);
+    gpac_log_set_target(prev_target);
+    if (!session) {
+      g_mutex_unlock(&shared_sessions_lock);
+      return FALSE;
+    }
+
+    shared = g_new0(GPAC_SharedSession, 1);
+    shared->name = g_strdup(ctx->shared_name);
+    shared->session = session;
+    g_rec_mutex_init(&shared->lock);
+    g_hash_table_insert(shared_sessions, shared->name, shared);
+    GST_DEBUG_OBJECT(
+      ctx->element, "Created shared gpac filter session %s", shared->name);
+  }
+  shared->refcount++;
+  g_mutex_unlock(&shared_sessions_lock);
+
+  ctx->shared = shared;
+  ctx->session = shared->session;
+  GST_DEBUG_OBJECT(ctx->element,
+                   "Attached to shared gpac filter session %s",
+                   shared->name);
+  return TRUE;
+}
+
+static void
+gpac_session_detach_shared(GPAC_SessionContext* ctx)
+{
+  GPAC_SharedSession* shared = ctx->shared;
+
+  // Remove our chain, the filters only fed by it go away with it
+  g_rec_mutex_lock(&shared->lock);
+  if (ctx->memin)
+    gf_filter_remove(ctx->memin);
+  g_rec_mutex_unlock(&shared->lock);
+
+  ctx->shared = NULL;
+  ctx->session = NULL;
+  ctx->last_filter = NULL;
+  ctx->reuses_output = FALSE;
+
+  g_mutex_lock(&shared_sessions_lock);
+  gboolean is_last = --shared->refcount == 0;
+  if (is_last)
+    g_hash_table_remove(shared_sessions, shared->name);
+  g_mutex_unlock(&shared_sessions_lock);
+  if (!is_last)
+    return;
+
+  // The last element tears the session down
+  GstElement* prev_target = gpac_log_set_target(ctx->element);
+  gf_fs_stop(shared->session);
+  gf_fs_del(shared->session);
+  gpac_log_set_target(prev_target);
+  GST_DEBUG_OBJECT(
+    ctx->element, "Closed shared gpac filter session %s", shared->name);
+
+  g_rec_mutex_clear(&shared->lock);
+  g_free(shared->name);
+  g_free(shared);
+}
+
+static GF_Filter*
+gpac_session_find_shared_filter(GPAC_SessionContext* ctx, const gchar* node)
+{
+  // Filters of a shared session are shared by their ID
+  const gchar* fid = strstr(node, ":FID=");
+  if (!fid)
+    return NULL;
+  fid += strlen(":FID=");
+  gsize len = strcspn(fid, ":");
+
+  u32 count = gf_fs_get_filters_count(ctx->session);
+  for (u32 i = 0; i < count; i++) {
+    GF_Filter* filter = gf_fs_get_filter(ctx->session, i);
+    const char* id = gf_filter_get_id(filter);
+    if (id && strlen(id) == len && !strncmp(id, fid, len))
+      return filter;
+  }
+  return NULL;
+}
+
+void
+gpac_session_lock(GPAC_SessionContext* ctx)
+{
+  if (ctx->shared)
+    g_rec_mutex_lock(&ctx->shared->lock);
+}
+
+void
+gpac_session_unlock(GPAC_SessionContext* ctx)
+{
+  if (ctx->shared)
+    g_rec_mutex_unlock(&ctx->shared->lock);
+}
+
+// #MARK: Session
 gboolean
 gpac_session_init(GPAC_SessionContext* ctx,
                   GstElement* element,
                   GstGpacParams* params)
 {
-  ctx->session = gf_fs_new_defaults(GF_FS_FLAG_NON_BLOCKING);
   ctx->element = element;
   ctx->params = params;
+  ctx->had_data_flow = FALSE;
+  if (ctx->shared_name)
+    return gpac_session_attach_shared(ctx);
+
+  GstElement* prev_target = gpac_log_set_target(element);
+  ctx->session = gf_fs_new_defaults(GF_FS_FLAG_NON_BLOCKING);
+  gpac_log_set_target(prev_target);
   return ctx->session != NULL;
 }
 
+static void
+gpac_session_clear_filters(GPAC_SessionContext* ctx)
+{
+  if (!ctx->filters)
+    return;
+
+  // The list is read by the statistics from the application thread
+  GST_OBJECT_LOCK(ctx->element);
+  GPtrArray* filters = g_steal_pointer(&ctx->filters);
+  GST_OBJECT_UNLOCK(ctx->element);
+  g_ptr_array_unref(filters);
+}
+
 gboolean
 gpac_session_close(GPAC_SessionContext* ctx, gboolean print_stats)
 {
+  // Updates that did not make it are dropped with the session
+  g_list_free_full(g_steal_pointer(&ctx->updates),
+                   (GDestroyNotify)gst_structure_free);
+  g_list_free_full(g_steal_pointer(&ctx->applied),
+                   (GDestroyNotify)gst_structure_free);
+
+  if (ctx->shared) {
+    gpac_session_lock(ctx);
+    if (ctx->had_data_flow)
+      gpac_session_run(ctx, TRUE);
+    gpac_memio_free(ctx);
+    gpac_session_unlock(ctx);
+
+    gpac_session_detach_shared(ctx);
+    g_clear_pointer(&ctx->trace_tasks, g_array_unref);
+    gpac_session_clear_filters(ctx);
+    ctx->memin = NULL;
+    ctx->memout = NULL;
+    ctx->last_filter = NULL;
+    return TRUE;
+  }
+
   if (ctx->session) {
+    GstElement* prev_target = gpac_log_set_target(ctx->element);
+
     if (ctx->had_data_flow) {
       // Run the filter chain until the end
       gpac_session_run(ctx, TRUE);
@@ -128,31 +309,97 @@ gpac_session_close(GPAC_SessionContext* ctx, gboolean print_stats)
     // Reset the session context
     gf_fs_del(ctx->session);
     ctx->session = NULL;
+    g_clear_pointer(&ctx->trace_tasks, g_array_unref);
+    gpac_session_clear_filters(ctx);
     ctx->memin = NULL;
+    ctx->memout = NULL;
+
+    gpac_log_set_target(prev_target);
   }
+  ctx->last_filter = NULL;
   return TRUE;
 }
 
 void
 gpac_session_abort(GPAC_SessionContext* ctx)
 {
-  if (ctx->session)
+  // A shared session keeps running for the other elements
+  if (ctx->session && !ctx->shared)
     gf_fs_abort(ctx->session, GF_FS_FLUSH_FAST);
 }
 
+static const gchar*
+gpac_session_trace_filter(GPAC_SessionContext* ctx)
+{
+  // Name the filter that ran the most tasks since the last run
+  const gchar* name = NULL;
+  guint64 most = 0;
+  u32 count = gf_fs_get_filters_count(ctx->session);
+  if (!ctx->trace_tasks)
+    ctx->trace_tasks = g_array_new(FALSE, TRUE, sizeof(guint64));
+  if (ctx->trace_tasks->len != count)
+    g_array_set_size(ctx->trace_tasks, count);
+
+  for (u32 i = 0; i < count; i++) {
+    GF_FilterStats stats;
+    if (gf_fs_get_filter_stats(ctx->session, i, &stats) != GF_OK)
+      continue;
+    guint64* done = &g_array_index(ctx->trace_tasks, guint64, i);
+    if (stats.nb_tasks_done - *done > most) {
+      most = stats.nb_tasks_done - *done;
+      name = stats.name ? stats.name : stats.reg_name;
+    }
+    *done = stats.nb_tasks_done;
+  }
+
+  // Filter names are few and live as long as the trace
+  return g_intern_string(name);
+}
+
+static void
+gpac_session_update_filters(GPAC_SessionContext* ctx)
+{
+  // Filters are loaded and removed as the graph resolves
+  u32 count = gf_fs_get_filters_count(ctx->session);
+  if (ctx->filters && ctx->filters->len == count)
+    return;
+
+  GPtrArray* filters = g_ptr_array_sized_new(count);
+  for (u32 i = 0; i < count; i++) {
+    GF_FilterStats stats;
+    if (gf_fs_get_filter_stats(ctx->session, i, &stats) == GF_OK)
+      g_ptr_array_add(filters, (gpointer)g_intern_string(stats.reg_name));
+  }
+
+  GST_OBJECT_LOCK(ctx->element);
+  GPtrArray* prev = ctx->filters;
+  ctx->filters = filters;
+  GST_OBJECT_UNLOCK(ctx->element);
+  if (prev)
+    g_ptr_array_unref(prev);
+}
+
 GF_Err
 gpac_session_run(GPAC_SessionContext* ctx, gboolean flush)
 {
   if (!ctx->session)
     return GF_BAD_PARAM;
+  gpac_session_lock(ctx);
+  GstElement* prev_target = gpac_log_set_target(ctx->element);
   gf_filter_post_process_task(ctx->memin);
 
   GF_Err e = GF_OK;
   guint32 steps = 100;
+  GPAC_TRACE_BEGIN(run);
   do {
     e = gf_fs_run(ctx->session);
   } while (!gf_fs_is_last_task(ctx->session) &&
            (flush || (e == GF_OK && steps--)));
+  ctx->run_exhausted = e == GF_OK && !gf_fs_is_last_task(ctx->session);
+  GPAC_TRACE_END_STATIC(run, "gf_fs_run", gpac_session_trace_filter(ctx));
+  gpac_session_update_filters(ctx);
+  gpac_log_set_target(prev_target);
+  gpac_session_unlock(ctx);
 
   // Check errors
   e = gf_fs_get_last_connect_error(ctx->session);
@@ -186,6 +433,7 @@ gpac_session_open(GPAC_SessionContext* ctx, gchar* graph)
 {
   // Initialize the variables
   GF_Err e = GF_OK;
+  ctx->last_filter = NULL;
 
   // Check if the session is initialized
   if (G_UNLIKELY(!ctx->session)) {
@@ -201,6 +449,9 @@ gpac_session_open(GPAC_SessionContext* ctx, gchar* graph)
   if (!graph)
     return GF_OK;
 
+  // Attribute the logs of filter instantiation to this element
+  GstElement* prev_target = gpac_log_set_target(ctx->element);
+
   // Load the graph
   GF_List* links_directives = gf_list_new();
   GF_List* loaded_filters = gf_list_new();
@@ -213,7 +464,8 @@ gpac_session_open(GPAC_SessionContext* ctx, gchar* graph)
                       FAILED,
                       (NULL),
                       ("Memory input filter is missing"));
-    return GF_BAD_PARAM;
+    e = GF_BAD_PARAM;
+    goto finish;
   }
   gf_list_add(loaded_filters, ctx->memin);
 
@@ -221,6 +473,8 @@ gpac_session_open(GPAC_SessionContext* ctx, gchar* graph)
   for (guint i = 0; nodes[i]; i++) {
     GF_Filter* filter = NULL;
     gboolean f_loaded = FALSE;
+    gboolean is_shared = FALSE;
+    gboolean is_linked = FALSE;
     gchar* node = nodes[i];
 
     // Check if this is an input or output node
@@ -271,7 +525,13 @@ gpac_session_open(GPAC_SessionContext* ctx, gchar* graph)
         }
       }
 
-      filter = gf_fs_load_filter(ctx->session, node, &e);
+      // Reuse the filters other elements share by ID
+      if (ctx->shared) {
+        filter = gpac_session_find_shared_filter(ctx, node);
+        is_shared = filter != NULL;
+      }
+      if (!filter)
+        filter = gf_fs_load_filter(ctx->session, node, &e);
     }
 
     if (G_UNLIKELY(!filter)) {
@@ -288,14 +548,24 @@ gpac_session_open(GPAC_SessionContext* ctx, gchar* graph)
         e = GF_BAD_PARAM;
         goto finish;
       }
+      is_linked = TRUE;
+    }
+
+    // In a shared session, only link to our own chain
+    if (ctx->shared && !is_linked && strcmp(node, "-i")) {
+      GF_Filter* prev = gf_list_last(loaded_filters);
+      gf_filter_set_source(filter, prev, NULL);
     }
+    ctx->reuses_output = is_shared;
     gf_list_add(loaded_filters, filter);
   }
+  ctx->last_filter = gf_list_last(loaded_filters);
 
 finish:
   gf_list_del(links_directives);
   gf_list_del(loaded_filters);
   g_strfreev(nodes);
+  gpac_log_set_target(prev_target);
 
   return e;
 }
@@ -304,7 +574,9 @@ GF_Filter*
 gpac_session_load_filter(GPAC_SessionContext* ctx, const gchar* filter_name)
 {
   GF_Err e = GF_OK;
+  GstElement* prev_target = gpac_log_set_target(ctx->element);
   GF_Filter* filter = gf_fs_load_filter(ctx->session, filter_name, &e);
+  gpac_log_set_target(prev_target);
   if (!filter) {
     GST_ELEMENT_ERROR(
       ctx->element,
@@ -327,3 +599,227 @@ gpac_session_has_output(GPAC_SessionContext* ctx)
   }
   return FALSE;
 }
+
+// #MARK: Runtime Updates
+void
+gpac_session_queue_update(GPAC_SessionContext* ctx,
+                          const gchar* filter_name,
+                          const gchar* name,
+                          const gchar* value)
+{
+  GstStructure* update = gst_structure_new("gpac-option-applied",
+                                           "filter",
+                                           G_TYPE_STRING,
+                                           filter_name,
+                                           "name",
+                                           G_TYPE_STRING,
+                                           name,
+                                           "value",
+                                           G_TYPE_STRING,
+                                           value,
+                                           NULL);
+
+  GST_OBJECT_LOCK(ctx->element);
+  ctx->updates = g_list_append(ctx->updates, update);
+  GST_OBJECT_UNLOCK(ctx->element);
+}
+
+static GF_Filter*
+gpac_session_find_filter(GPAC_SessionContext* ctx, const gchar* filter_name)
+{
+  // The filters of other elements may have the same name in a shared session
+  if (ctx->last_filter &&
+      !g_strcmp0(gf_filter_get_name(ctx->last_filter), filter_name))
+    return ctx->last_filter;
+  if (ctx->shared)
+    return NULL;
+
+  u32 count = gf_fs_get_filters_count(ctx->session);
+  for (u32 i = 0; i < count; i++) {
+    GF_Filter* filter = gf_fs_get_filter(ctx->session, i);
+    if (!g_strcmp0(gf_filter_get_name(filter), filter_name))
+      return filter;
+  }
+  return NULL;
+}
+
+void
+gpac_session_send_updates(GPAC_SessionContext* ctx)
+{
+  GST_OBJECT_LOCK(ctx->element);
+  GList* updates = g_steal_pointer(&ctx->updates);
+  GST_OBJECT_UNLOCK(ctx->element);
+  if (G_LIKELY(!updates))
+    return;
+
+  for (GList* l = updates; l; l = l->next) {
+    GstStructure* update = l->data;
+    const gchar* filter_name = gst_structure_get_string(update, "filter");
+    const gchar* name = gst_structure_get_string(update, "name");
+    const gchar* value = gst_structure_get_string(update, "value");
+
+    GF_Filter* filter = gpac_session_find_filter(ctx, filter_name);
+    if (!filter) {
+      GST_WARNING_OBJECT(ctx->element,
+                         "No %s filter to update %s on",
+                         filter_name,
+                         name);
+      gst_structure_free(update);
+      continue;
+    }
+
+    // The filter applies the update before its next process call
+    GST_DEBUG_OBJECT(
+      ctx->element, "Updating %s:%s=%s", filter_name, name, value);
+    gf_fs_send_update(ctx->session, NULL, filter, name, value, 0);
+    ctx->applied = g_list_append(ctx->applied, update);
+  }
+  g_list_free(updates);
+}
+
+void
+gpac_session_check_updates(GPAC_SessionContext* ctx, GF_FilterPacket* pck)
+{
+  if (G_LIKELY(!ctx->applied) || !pck)
+    return;
+
+  // Only notify at the boundary the new value can take effect
+  if (!gf_filter_pck_get_property(pck, GF_PROP_PCK_FILENUM) &&
+      !gf_filter_pck_get_property(pck, GF_PROP_PCK_FRAG_START))
+    return;
+
+  for (GList* l = ctx->applied; l; l = l->next)
+    gst_element_post_message(
+      ctx->element, gst_message_new_element(GST_OBJECT(ctx->element), l->data));
+  g_list_free(g_steal_pointer(&ctx->applied));
+}
+
+// #MARK: Session Pool
+static void
+gpac_session_pool_entry_free(GPAC_PreparedSession* entry)
+{
+  GPAC_SessionContext tmp = { 0 };
+  tmp.session = entry->session;
+  tmp.memin = entry->memin;
+  tmp.memout = entry->memout;
+  gpac_session_close(&tmp, FALSE);
+
+  g_free(entry->key);
+  g_free(entry);
+  gpac_runtime_release();
+}
+
+gchar*
+gpac_session_pool_key(GPAC_SessionContext* ctx,
+                      const gchar* graph,
+                      gchar** args)
+{
+  GString* key = g_string_new(graph);
+
+  // Sessions are only interchangeable between the same element classes
+  g_string_append_printf(key, "\n%p", ctx->params);
+  g_string_append_printf(
+    key, "\n%s", ctx->destination ? ctx->destination : "");
+
+  // Global arguments affect how the filters are instantiated
+  for (guint i = 0; args && args[i]; i++)
+    g_string_append_printf(key, "\n%s", args[i]);
+
+  return g_string_free(key, FALSE);
+}
+
+gboolean
+gpac_session_pool_take(GPAC_SessionContext* ctx, const gchar* key)
+{
+  GPAC_PreparedSession* entry = NULL;
+
+  g_mutex_lock(&session_pool_lock);
+  for (GList* l = session_pool.head; l; l = l->next) {
+    GPAC_PreparedSession* item = (GPAC_PreparedSession*)l->data;
+    if (!g_strcmp0(item->key, key)) {
+      entry = item;
+      g_queue_delete_link(&session_pool, l);
+      break;
+    }
+  }
+  g_mutex_unlock(&session_pool_lock);
+
+  if (!entry)
+    return FALSE;
+
+  // Adopt the prepared session
+  ctx->session = entry->session;
+  ctx->memin = entry->memin;
+  ctx->memout = entry->memout;
+  ctx->last_filter = entry->last_filter;
+  ctx->had_data_flow = FALSE;
+
+  // Point the memory io filters at their new owner
+  GF_Filter* memio[] = { ctx->memin, ctx->memout };
+  for (guint i = 0; i < G_N_ELEMENTS(memio); i++) {
+    if (!memio[i])
+      continue;
+    GPAC_MemIoContext* rt_udta = gf_filter_get_rt_udta(memio[i]);
+    rt_udta->sess = ctx;
+    rt_udta->global_offset = GST_CLOCK_TIME_NONE;
+    rt_udta->is_continuous = FALSE;
+  }
+
+  GST_DEBUG_OBJECT(ctx->element, "Reusing a prepared gpac filter session");
+
+  // The element holds its own reference on the runtime
+  g_free(entry->key);
+  g_free(entry);
+  gpac_runtime_release();
+  return TRUE;
+}
+
+void
+gpac_session_pool_put(GPAC_SessionContext* ctx, const gchar* key)
+{
+  // A session that carried data cannot be handed out again
+  if (!ctx->session || ctx->had_data_flow) {
+    GST_WARNING_OBJECT(ctx->element, "Not parking a session that was used");
+    gpac_session_close(ctx, FALSE);
+    return;
+  }
+
+  // Keep the runtime alive while the session is parked
+  if (!gpac_runtime_acquire()) {
+    gpac_session_close(ctx, FALSE);
+    return;
+  }
+
+  GPAC_PreparedSession* entry = g_new0(GPAC_PreparedSession, 1);
+  entry->key = g_strdup(key);
+  entry->session = ctx->session;
+  entry->memin = ctx->memin;
+  entry->memout = ctx->memout;
+  entry->last_filter = ctx->last_filter;
+
+  // Detach the memory io filters from the element
+  GF_Filter* memio[] = { ctx->memin, ctx->memout };
+  for (guint i = 0; i < G_N_ELEMENTS(memio); i++) {
+    if (!memio[i])
+      continue;
+    GPAC_MemIoContext* rt_udta = gf_filter_get_rt_udta(memio[i]);
+    rt_udta->sess = NULL;
+    rt_udta->queue = NULL;
+  }
+
+  ctx->session = NULL;
+  ctx->memin = NULL;
+  ctx->memout = NULL;
+  ctx->last_filter = NULL;
+
+  // Evict the oldest entry if the pool is full
+  GPAC_PreparedSession* evicted = NULL;
+  g_mutex_lock(&session_pool_lock);
+  g_queue_push_tail(&session_pool, entry);
+  if (g_queue_get_length(&session_pool) > GPAC_SESSION_POOL_SIZE)
+    evicted = g_queue_pop_head(&session_pool);
+  g_mutex_unlock(&session_pool_lock);
+
+  if (evicted)
+    gpac_session_pool_entry_free(evicted);
+}
@@ -0,0 +1,405 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // memfd_create, accept4
+#endif
+
+#include "lib/shm.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC(gpac_shm);
+#define GST_CAT_DEFAULT gpac_shm
+
+// Replaying to a new consumer gives up after this long
+#define GPAC_SHM_REPLAY_TIMEOUT_S 1
+
+// Descriptors kept for the replay, older ones are forgotten
+#define GPAC_SHM_HISTORY_MAX_SIZE 256
+
+struct _GPAC_ShmRing
+{
+  GstElement* element;
+  gchar* socket_path;
+
+  int memfd;
+  int listen_fd;
+  guint8* map;
+  gsize map_size;
+  gsize data_size;
+  GPAC_ShmRingHeader* header;
+
+  GMutex lock;
+  GThread* acceptor;
+  GList* clients;  // Consumer sockets, as GINT_TO_POINTER
+  GQueue history;  // GPAC_ShmDescriptor whose data is still in the ring
+  guint64 sequence;
+  guint64 position;
+};
+
+#ifdef __linux__
+
+// #MARK: Consumers
+static gboolean
+gpac_shm_ring_send(int fd, const GPAC_ShmDescriptor* desc, gboolean wait)
+{
+  int flags = MSG_NOSIGNAL | (wait ? 0 : MSG_DONTWAIT);
+  return send(fd, desc, sizeof(*desc), flags) == sizeof(*desc);
+}
+
+static gboolean
+gpac_shm_ring_hello(GPAC_ShmRing* ring,
+                    int fd,
+                    const GPAC_ShmDescriptor* history,
+                    guint history_size)
+{
+  GPAC_ShmDescriptor hello = { 0 };
+  hello.magic = GPAC_SHM_MAGIC;
+  hello.type = GPAC_SHM_MSG_HELLO;
+  hello.sequence = history_size;
+  hello.size = ring->map_size;
+  hello.pts = hello.dts = hello.duration = GST_CLOCK_TIME_NONE;
+
+  // Attach the memfd to the hello message
+  struct iovec iov = { &hello, sizeof(hello) };
+  union
+  {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control = { 0 };
+  struct msghdr msg = { 0 };
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &ring->memfd, sizeof(int));
+
+  if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(hello))
+    return FALSE;
+
+  // Replay what was still in the ring
+  for (guint i = 0; i < history_size; i++) {
+    if (!gpac_shm_ring_send(fd, &history[i], TRUE))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static GPAC_ShmDescriptor*
+gpac_shm_ring_snapshot(GPAC_ShmRing* ring, guint64 since, guint* size)
+{
+  GPAC_ShmDescriptor* history =
+    g_new(GPAC_ShmDescriptor, g_queue_get_length(&ring->history));
+  *size = 0;
+  for (GList* l = ring->history.head; l; l = l->next) {
+    const GPAC_ShmDescriptor* desc = l->data;
+    if (desc->sequence >= since)
+      history[(*size)++] = *desc;
+  }
+  return history;
+}
+
+static gpointer
+gpac_shm_ring_accept(gpointer user_data)
+{
+  GPAC_ShmRing* ring = user_data;
+
+  // Returns once the listening socket is shut down
+  int fd;
+  while ((fd = accept4(ring->listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+    struct timeval timeout = { GPAC_SHM_REPLAY_TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Replay a copy of the history, writers must not wait for a consumer
+    guint size;
+    g_mutex_lock(&ring->lock);
+    GPAC_ShmDescriptor* history = gpac_shm_ring_snapshot(ring, 0, &size);
+    guint64 next = ring->sequence;
+    g_mutex_unlock(&ring->lock);
+
+    gboolean greeted = gpac_shm_ring_hello(ring, fd, history, size);
+    g_free(history);
+    if (!greeted) {
+      GST_WARNING_OBJECT(ring->element,
+                         "Failed to greet shared memory consumer: %s",
+                         g_strerror(errno));
+      close(fd);
+      continue;
+    }
+
+    // Catch up with what was written meanwhile, then follow the writes
+    g_mutex_lock(&ring->lock);
+    history = gpac_shm_ring_snapshot(ring, next, &size);
+    for (guint i = 0; i < size && greeted; i++)
+      greeted = gpac_shm_ring_send(fd, &history[i], FALSE);
+    g_free(history);
+    if (greeted) {
+      ring->clients = g_list_prepend(ring->clients, GINT_TO_POINTER(fd));
+      GST_DEBUG_OBJECT(ring->element, "Shared memory consumer connected");
+    } else {
+      GST_WARNING_OBJECT(ring->element,
+                         "Shared memory consumer fell behind: %s",
+                         g_strerror(errno));
+      close(fd);
+    }
+    g_mutex_unlock(&ring->lock);
+  }
+
+  return NULL;
+}
+
+// #MARK: Ring
+GPAC_ShmRing*
+gpac_shm_ring_new(GstElement* element, const gchar* socket_path, gsize size)
+{
+  GST_DEBUG_CATEGORY_INIT(gpac_shm, "gpacshm", 0, "GPAC shared memory output");
+
+  struct sockaddr_un addr = { 0 };
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    GST_ELEMENT_ERROR(element,
+                      RESOURCE,
+                      SETTINGS,
+                      (NULL),
+                      ("Socket path is too long: %s", socket_path));
+    return NULL;
+  }
+
+  GPAC_ShmRing* ring = g_new0(GPAC_ShmRing, 1);
+  ring->element = element;
+  ring->socket_path = g_strdup(socket_path);
+  ring->memfd = ring->listen_fd = -1;
+  ring->data_size = size;
+  ring->map_size = GPAC_SHM_HEADER_SIZE + size;
+  g_mutex_init(&ring->lock);
+  g_queue_init(&ring->history);
+
+  // Create the memfd, sealed to its size so consumers can trust it
+  ring->memfd = memfd_create("gpac-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (ring->memfd < 0 || ftruncate(ring->memfd, ring->map_size) < 0)
+    goto error;
+  fcntl(ring->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+  ring->map = mmap(NULL,
+                   ring->map_size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED,
+                   ring->memfd,
+                   0);
+  if (ring->map == MAP_FAILED) {
+    ring->map = NULL;
+    goto error;
+  }
+  ring->header = (GPAC_ShmRingHeader*)ring->map;
+  ring->header->magic = GPAC_SHM_MAGIC;
+  ring->header->version = 1;
+  ring->header->data_size = size;
+
+  // Listen for consumers
+  ring->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (ring->listen_fd < 0)
+    goto error;
+  addr.sun_family = AF_UNIX;
+  g_strlcpy(addr.sun_path, socket_path, sizeof(addr.sun_path));
+  unlink(socket_path);
+  if (bind(ring->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(ring->listen_fd, 8) < 0)
+    goto error;
+
+  ring->acceptor = g_thread_new("gpacshm", gpac_shm_ring_accept, ring);
+  GST_DEBUG_OBJECT(element,
+                   "Shared memory output of %" G_GSIZE_FORMAT
+                   " bytes on %s",
+                   size,
+                   socket_path);
+  return ring;
+
+error:
+  GST_ELEMENT_ERROR(element,
+                    RESOURCE,
+                    OPEN_READ_WRITE,
+                    (NULL),
+                    ("Failed to set up shared memory output on %s: %s",
+                     socket_path,
+                     g_strerror(errno)));
+  gpac_shm_ring_free(ring);
+  return NULL;
+}
+
+void
+gpac_shm_ring_free(GPAC_ShmRing* ring)
+{
+  // Wake up the acceptor
+  if (ring->acceptor) {
+    shutdown(ring->listen_fd, SHUT_RDWR);
+    g_thread_join(ring->acceptor);
+    unlink(ring->socket_path);
+  }
+  if (ring->listen_fd >= 0)
+    close(ring->listen_fd);
+
+  for (GList* l = ring->clients; l; l = l->next)
+    close(GPOINTER_TO_INT(l->data));
+  g_list_free(ring->clients);
+  g_queue_clear_full(&ring->history, g_free);
+
+  if (ring->map)
+    munmap(ring->map, ring->map_size);
+  if (ring->memfd >= 0)
+    close(ring->memfd);
+
+  g_mutex_clear(&ring->lock);
+  g_free(ring->socket_path);
+  g_free(ring);
+}
+
+gboolean
+gpac_shm_ring_write(GPAC_ShmRing* ring,
+                    const guint8* data,
+                    gsize size,
+                    const GPAC_ShmDescriptor* desc)
+{
+  if (G_UNLIKELY(size > ring->data_size)) {
+    GST_ELEMENT_WARNING(ring->element,
+                        RESOURCE,
+                        NO_SPACE_LEFT,
+                        (NULL),
+                        ("%" G_GSIZE_FORMAT
+                         " bytes do not fit in the shared memory ring",
+                         size));
+    return FALSE;
+  }
+
+  g_mutex_lock(&ring->lock);
+
+  // The data is contiguous, skip the end of the ring if it does not fit
+  guint64 offset = ring->position % ring->data_size;
+  if (offset + size > ring->data_size) {
+    ring->position += ring->data_size - offset;
+    offset = 0;
+  }
+  guint64 end = ring->position + size;
+
+  // Forget the descriptors whose data is about to be overwritten
+  GPAC_ShmDescriptor* head;
+  while ((head = g_queue_peek_head(&ring->history)) &&
+         (head->position + ring->data_size < end ||
+          g_queue_get_length(&ring->history) >= GPAC_SHM_HISTORY_MAX_SIZE))
+    g_free(g_queue_pop_head(&ring->history));
+
+  // Announce the overwrite before writing, consumers check it after reading
+  __atomic_store_n(&ring->header->write_position, end, __ATOMIC_RELEASE);
+  if (size)
+    memcpy(ring->map + GPAC_SHM_HEADER_SIZE + offset, data, size);
+
+  GPAC_ShmDescriptor* entry = g_new(GPAC_ShmDescriptor, 1);
+  memcpy(entry, desc, sizeof(*entry));
+  entry->magic = GPAC_SHM_MAGIC;
+  entry->type = GPAC_SHM_MSG_DATA;
+  entry->sequence = ring->sequence++;
+  entry->position = ring->position;
+  entry->offset = GPAC_SHM_HEADER_SIZE + offset;
+  entry->size = size;
+  g_queue_push_tail(&ring->history, entry);
+  ring->position = end;
+
+  // Consumers that cannot keep up are dropped
+  GList* l = ring->clients;
+  while (l) {
+    GList* next = l->next;
+    int fd = GPOINTER_TO_INT(l->data);
+    if (!gpac_shm_ring_send(fd, entry, FALSE)) {
+      GST_WARNING_OBJECT(ring->element,
+                         "Dropping shared memory consumer: %s",
+                         g_strerror(errno));
+      close(fd);
+      ring->clients = g_list_delete_link(ring->clients, l);
+    }
+    l = next;
+  }
+
+  g_mutex_unlock(&ring->lock);
+  return TRUE;
+}
+
+#else
+
+GPAC_ShmRing*
+gpac_shm_ring_new(GstElement* element, const gchar* socket_path, gsize size)
+{
+  GST_ELEMENT_ERROR(element,
+                    RESOURCE,
+                    SETTINGS,
+                    (NULL),
+                    ("Shared memory output is only supported on Linux"));
+  return NULL;
+}
+
+void
+gpac_shm_ring_free(GPAC_ShmRing* ring)
+{
+}
+
+gboolean
+gpac_shm_ring_write(GPAC_ShmRing* ring,
+                    const guint8* data,
+                    gsize size,
+                    const GPAC_ShmDescriptor* desc)
+{
+  return FALSE;
+}
+
+#endif
+
+gboolean
+gpac_shm_ring_write_buffer(GPAC_ShmRing* ring, GstBuffer* buffer)
+{
+  GPAC_ShmDescriptor desc = { 0 };
+  desc.pts = GST_BUFFER_PTS(buffer);
+  desc.dts = GST_BUFFER_DTS(buffer);
+  desc.duration = GST_BUFFER_DURATION(buffer);
+  if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_HEADER))
+    desc.flags |= GPAC_SHM_FLAG_HEADER;
+  if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    desc.flags |= GPAC_SHM_FLAG_DELTA_UNIT;
+
+  g_auto(GstBufferMapInfo) map = GST_MAP_INFO_INIT;
+  if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+    return FALSE;
+  return gpac_shm_ring_write(ring, map.data, map.size, &desc);
+}
@@ -25,6 +25,7 @@
 
 #include "lib/signals.h"
 #include "elements/common.h"
+#include "lib/trace.h"
 
 typedef struct
 {
@@ -49,7 +50,7 @@ typedef struct
 static signal_info signal_presets[] = {
   GPAC_SIGNAL_PRESET_RANGE("dasher_all",
                            GPAC_SIGNAL_DASHER_MANIFEST,
-                           GPAC_SIGNAL_DASHER_DELETE_SEGMENT),
+                           GPAC_SIGNAL_DASHER_STATE_UPDATED),
 };
 
 void
@@ -95,6 +96,37 @@ register_signal(GObjectClass* klass, GPAC_SignalId id)
         G_TYPE_STRING);
       break;
 
+    case GPAC_SIGNAL_DASHER_SEGMENT_READY:
+    case GPAC_SIGNAL_DASHER_PART_READY:
+    case GPAC_SIGNAL_DASHER_MANIFEST_UPDATED:
+    case GPAC_SIGNAL_DASHER_STATE_UPDATED:
+      registered_signals[id] = g_signal_new(
+        gpac_signal_names[id - 1], // Adjusted index for 0-based array
+        G_TYPE_FROM_CLASS(klass),
+        G_SIGNAL_RUN_LAST,
+        0,
+        NULL,
+        NULL,
+        NULL,
+        G_TYPE_NONE,
+        1,
+        GST_TYPE_STRUCTURE); // Details of the file or the state
+      break;
+
+    case GPAC_SIGNAL_DASHER_LOAD_STATE:
+      registered_signals[id] = g_signal_new(
+        gpac_signal_names[id - 1], // Adjusted index for 0-based array
+        G_TYPE_FROM_CLASS(klass),
+        G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE,
+        0,
+        NULL,
+        NULL,
+        NULL,
+        G_TYPE_BYTES, // The persisted state, if any
+        1,
+        G_TYPE_STRING);
+      break;
+
     default:
       break;
   };
@@ -139,43 +171,467 @@ gpac_install_all_signals(GObjectClass* gobject_class)
   }
 }
 
-gboolean
-gpac_signal_try_emit(GstElement* element,
-                     GPAC_SignalId id,
-                     const gchar* location,
-                     GOutputStream** output_stream)
+// #MARK: Emission
+static GstObject*
+gpac_signal_resolve(GstElement* element, GPAC_SignalId id, guint* signal_id)
 {
-  g_assert(element != NULL);
-  g_assert(id < GPAC_SIGNAL_LAST);
+  // The signal is registered on the element or on one of its parents
+  GstObject* object = gst_object_ref(GST_OBJECT(element));
+  while (object) {
+    GstGpacParams* params = GST_GPAC_GET_PARAMS(G_OBJECT_GET_CLASS(object));
+    if (params && params->registered_signals[id]) {
+      *signal_id = params->registered_signals[id];
+      return object;
+    }
+
+    GstObject* parent = gst_object_get_parent(object);
+    gst_object_unref(object);
+    object = parent;
+  }
+  return NULL;
+}
+
+static gboolean
+gpac_signal_emit_on(GstObject* object,
+                    guint signal_id,
+                    GPAC_SignalId id,
+                    const gchar* location,
+                    GOutputStream** output_stream)
+{
+  GPAC_TRACE_BEGIN(span);
+  if (output_stream) {
+    *output_stream = NULL;
+    g_signal_emit(object, signal_id, 0, location, output_stream);
+    GPAC_TRACE_END(span, gpac_signal_names[id - 1], location);
+    return (*output_stream != NULL);
+  }
+
+  gboolean deleted = FALSE;
+  g_signal_emit(object, signal_id, 0, location, &deleted);
+  GPAC_TRACE_END(span, gpac_signal_names[id - 1], location);
+  return deleted;
+}
+
+// #MARK: Emitter
+typedef enum
+{
+  GPAC_SIGNAL_OP_OPEN,
+  GPAC_SIGNAL_OP_WRITE,
+  GPAC_SIGNAL_OP_CLOSE,
+  GPAC_SIGNAL_OP_DELETE,
+  GPAC_SIGNAL_OP_NOTIFY,
+  GPAC_SIGNAL_OP_STOP,
+} GPAC_SignalOpType;
 
-  GstObject* parent = GST_OBJECT(element);
-  do {
-    GObjectClass* klass = G_OBJECT_GET_CLASS(parent);
-    GstGpacParams* params = GST_GPAC_GET_PARAMS(klass);
-    guint* registered_signals = params->registered_signals;
-
-    // We may not have registered this signal
-    if (!registered_signals[id])
-      continue;
-
-    guint signal_id = registered_signals[id];
-    if (signal_id) {
-      if (output_stream) {
-        *output_stream = NULL;
-        g_signal_emit(parent, signal_id, 0, location, output_stream);
-        return (*output_stream != NULL);
+typedef struct
+{
+  GPAC_SignalOpType type;
+  GPAC_SignalId id;
+  GOutputStream* stream; // Deferred output stream of the file operations
+  gchar* location;
+  GBytes* data;
+  GstStructure* info;
+} GPAC_SignalOp;
+
+struct _GPAC_SignalEmitter
+{
+  GstElement* element;
+  GstObject* objects[GPAC_SIGNAL_LAST]; // Object that registered each signal
+  guint signal_ids[GPAC_SIGNAL_LAST];
+
+  // Dispatcher
+  guint64 queue_size; // 0 if the output signals are synchronous
+  guint64 queued_bytes;
+  GQueue ops;
+  GMutex lock;
+  GCond cond;
+  GThread* thread;
+  gboolean detached; // freed from a handler, the dispatcher frees itself
+};
+
+static void
+gpac_signal_emitter_destroy(GPAC_SignalEmitter* emitter);
+
+// Output stream handed to GPAC in asynchronous mode, the writes are queued
+// for the dispatcher thread which forwards them to the application stream
+typedef struct
+{
+  GOutputStream parent;
+  GPAC_SignalEmitter* emitter;
+  gchar* location;
+  GOutputStream* target; // Only used by the dispatcher thread
+  gboolean owns_target;  // The target is a fallback file
+} GpacSignalOutputStream;
+
+typedef struct
+{
+  GOutputStreamClass parent_class;
+} GpacSignalOutputStreamClass;
+
+G_DEFINE_TYPE(GpacSignalOutputStream,
+              gpac_signal_output_stream,
+              G_TYPE_OUTPUT_STREAM);
+
+static void
+gpac_signal_op_free(GPAC_SignalOp* op)
+{
+  if (op->stream)
+    g_object_unref(op->stream);
+  if (op->data)
+    g_bytes_unref(op->data);
+  if (op->info)
+    gst_structure_free(op->info);
+  g_free(op->location);
+  g_free(op);
+}
+
+static void
+gpac_signal_emitter_push(GPAC_SignalEmitter* emitter,
+                         GPAC_SignalOpType type,
+                         GPAC_SignalOp* op)
+{
+  op->type = type;
+  gsize size = op->data ? g_bytes_get_size(op->data) : 0;
+
+  g_mutex_lock(&emitter->lock);
+  // Bound the queued output, a single large write may still go through. A
+  // handler writing from the dispatcher thread would wait on itself.
+  while (size && emitter->queued_bytes && g_thread_self() != emitter->thread &&
+         emitter->queued_bytes + size > emitter->queue_size)
+    g_cond_wait(&emitter->cond, &emitter->lock);
+  emitter->queued_bytes += size;
+  g_queue_push_tail(&emitter->ops, op);
+  g_cond_broadcast(&emitter->cond);
+  g_mutex_unlock(&emitter->lock);
+}
+
+static gboolean
+gpac_signal_emitter_emit(GPAC_SignalEmitter* emitter,
+                         GPAC_SignalId id,
+                         const gchar* location,
+                         GOutputStream** output_stream)
+{
+  if (!emitter->objects[id]) {
+    GST_DEBUG_OBJECT(emitter->element,
+                     "Signal %s not registered for element %s",
+                     gpac_signal_names[id - 1],
+                     GST_OBJECT_NAME(emitter->element));
+    return FALSE;
+  }
+
+  return gpac_signal_emit_on(emitter->objects[id],
+                             emitter->signal_ids[id],
+                             id,
+                             location,
+                             output_stream);
+}
+
+static void
+gpac_signal_dispatch(GPAC_SignalEmitter* emitter, GPAC_SignalOp* op)
+{
+  GpacSignalOutputStream* stream = (GpacSignalOutputStream*)op->stream;
+  GFile* file = NULL;
+  GError* error = NULL;
+
+  switch (op->type) {
+    case GPAC_SIGNAL_OP_OPEN:
+      if (gpac_signal_emitter_emit(
+            emitter, op->id, stream->location, &stream->target))
+        break;
+
+      // No handler provided a stream, write to the file instead
+      file = g_file_new_for_path(stream->location);
+      stream->target = G_OUTPUT_STREAM(
+        g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error));
+      stream->owns_target = TRUE;
+      g_object_unref(file);
+      if (!stream->target) {
+        GST_ELEMENT_ERROR(emitter->element,
+                          RESOURCE,
+                          OPEN_WRITE,
+                          (NULL),
+                          ("Failed to open output stream for file %s: %s",
+                           stream->location,
+                           error ? error->message : "Unknown error"));
+        g_clear_error(&error);
       }
+      break;
+
+    case GPAC_SIGNAL_OP_WRITE: {
+      if (!stream->target)
+        break;
 
-      gboolean deleted = FALSE;
-      g_signal_emit(parent, signal_id, 0, location, &deleted);
-      return deleted;
+      gsize size;
+      gconstpointer data = g_bytes_get_data(op->data, &size);
+      GPAC_TRACE_BEGIN(span);
+      if (!g_output_stream_write_all(
+            stream->target, data, size, NULL, NULL, &error)) {
+        GST_ELEMENT_ERROR(emitter->element,
+                          RESOURCE,
+                          WRITE,
+                          (NULL),
+                          ("Failed to write data to output stream for file "
+                           "%s: %s",
+                           stream->location,
+                           error ? error->message : "Unknown error"));
+        g_clear_error(&error);
+      }
+      GPAC_TRACE_END(span, "gpac_signal_write", stream->location);
+      break;
     }
-  } while ((parent = gst_element_get_parent(parent)));
 
-  GST_DEBUG_OBJECT(element,
-                   "Signal %s not registered for element %s",
-                   gpac_signal_names[id - 1],
-                   GST_OBJECT_NAME(element));
+    case GPAC_SIGNAL_OP_CLOSE:
+      if (stream->target) {
+        g_output_stream_close(stream->target, NULL, NULL);
+        if (stream->owns_target)
+          g_object_unref(stream->target);
+        stream->target = NULL;
+      }
+      // Drop the reference held since the file was opened
+      g_object_unref(stream);
+      break;
+
+    case GPAC_SIGNAL_OP_DELETE:
+      if (gpac_signal_emitter_emit(
+            emitter, GPAC_SIGNAL_DASHER_DELETE_SEGMENT, op->location, NULL))
+        break;
+
+      file = g_file_new_for_path(op->location);
+      if (!g_file_delete(file, NULL, &error)) {
+        GST_ELEMENT_WARNING(emitter->element,
+                            RESOURCE,
+                            FAILED,
+                            (NULL),
+                            ("Failed to delete file %s: %s",
+                             op->location,
+                             error ? error->message : "Unknown error"));
+        g_clear_error(&error);
+      }
+      g_object_unref(file);
+      break;
+
+    case GPAC_SIGNAL_OP_NOTIFY:
+      if (!emitter->objects[op->id])
+        break;
+
+      GPAC_TRACE_BEGIN(span);
+      g_signal_emit(
+        emitter->objects[op->id], emitter->signal_ids[op->id], 0, op->info);
+      GPAC_TRACE_END(span,
+                     gpac_signal_names[op->id - 1],
+                     gst_structure_get_string(op->info, "name"));
+      break;
+
+    default:
+      break;
+  }
+}
+
+static gpointer
+gpac_signal_dispatcher(gpointer user_data)
+{
+  GPAC_SignalEmitter* emitter = user_data;
+
+  while (TRUE) {
+    g_mutex_lock(&emitter->lock);
+    while (g_queue_is_empty(&emitter->ops))
+      g_cond_wait(&emitter->cond, &emitter->lock);
+    GPAC_SignalOp* op = g_queue_pop_head(&emitter->ops);
+    g_mutex_unlock(&emitter->lock);
+
+    if (op->type == GPAC_SIGNAL_OP_STOP) {
+      gpac_signal_op_free(op);
+      break;
+    }
+    gpac_signal_dispatch(emitter, op);
+
+    // Make room for the producer only once the data is written
+    if (op->data) {
+      g_mutex_lock(&emitter->lock);
+      emitter->queued_bytes -= g_bytes_get_size(op->data);
+      g_cond_broadcast(&emitter->cond);
+      g_mutex_unlock(&emitter->lock);
+    }
+    gpac_signal_op_free(op);
+  }
+
+  if (emitter->detached)
+    gpac_signal_emitter_destroy(emitter);
+  return NULL;
+}
+
+static gssize
+gpac_signal_output_stream_write(GOutputStream* stream,
+                                const void* buffer,
+                                gsize count,
+                                GCancellable* cancellable,
+                                GError** error)
+{
+  GpacSignalOutputStream* self = (GpacSignalOutputStream*)stream;
+  GPAC_SignalOp* op = g_new0(GPAC_SignalOp, 1);
+  op->stream = g_object_ref(stream);
+  op->data = g_bytes_new(buffer, count);
+  gpac_signal_emitter_push(self->emitter, GPAC_SIGNAL_OP_WRITE, op);
+  return count;
+}
+
+static gboolean
+gpac_signal_output_stream_close(GOutputStream* stream,
+                                GCancellable* cancellable,
+                                GError** error)
+{
+  GpacSignalOutputStream* self = (GpacSignalOutputStream*)stream;
+  GPAC_SignalOp* op = g_new0(GPAC_SignalOp, 1);
+  op->stream = g_object_ref(stream);
+  gpac_signal_emitter_push(self->emitter, GPAC_SIGNAL_OP_CLOSE, op);
+  return TRUE;
+}
+
+static void
+gpac_signal_output_stream_finalize(GObject* object)
+{
+  GpacSignalOutputStream* self = (GpacSignalOutputStream*)object;
+  g_free(self->location);
+  G_OBJECT_CLASS(gpac_signal_output_stream_parent_class)->finalize(object);
+}
+
+static void
+gpac_signal_output_stream_class_init(GpacSignalOutputStreamClass* klass)
+{
+  GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+  GOutputStreamClass* stream_class = G_OUTPUT_STREAM_CLASS(klass);
+
+  gobject_class->finalize = gpac_signal_output_stream_finalize;
+  stream_class->write_fn = gpac_signal_output_stream_write;
+  stream_class->close_fn = gpac_signal_output_stream_close;
+}
+
+static void
+gpac_signal_output_stream_init(GpacSignalOutputStream* self)
+{
+}
+
+GPAC_SignalEmitter*
+gpac_signal_emitter_new(GstElement* element, guint64 queue_size)
+{
+  g_assert(element != NULL);
+
+  GPAC_SignalEmitter* emitter = g_new0(GPAC_SignalEmitter, 1);
+  emitter->element = element;
+  emitter->queue_size = queue_size;
+  for (guint32 id = GPAC_SIGNAL_START; id < GPAC_SIGNAL_LAST; id++)
+    emitter->objects[id] =
+      gpac_signal_resolve(element, id, &emitter->signal_ids[id]);
+
+  g_queue_init(&emitter->ops);
+  g_mutex_init(&emitter->lock);
+  g_cond_init(&emitter->cond);
+  emitter->thread =
+    g_thread_new("gpac-signals", gpac_signal_dispatcher, emitter);
+  return emitter;
+}
+
+void
+gpac_signal_emitter_free(GPAC_SignalEmitter* emitter)
+{
+  if (!emitter)
+    return;
+
+  // Dispatch what is queued before stopping
+  gpac_signal_emitter_push(
+    emitter, GPAC_SIGNAL_OP_STOP, g_new0(GPAC_SignalOp, 1));
+
+  // A handler that stops the element runs on the dispatcher thread, which
+  // cannot join itself. It frees the emitter once it reaches the stop.
+  if (g_thread_self() == emitter->thread) {
+    emitter->detached = TRUE;
+    g_thread_unref(emitter->thread);
+    return;
+  }
+
+  g_thread_join(emitter->thread);
+  gpac_signal_emitter_destroy(emitter);
+}
+
+static void
+gpac_signal_emitter_destroy(GPAC_SignalEmitter* emitter)
+{
+  g_queue_clear_full(&emitter->ops, (GDestroyNotify)gpac_signal_op_free);
+
+  for (guint32 id = GPAC_SIGNAL_START; id < GPAC_SIGNAL_LAST; id++)
+    if (emitter->objects[id])
+      gst_object_unref(emitter->objects[id]);
+  g_mutex_clear(&emitter->lock);
+  g_cond_clear(&emitter->cond);
+  g_free(emitter);
+}
+
+gboolean
+gpac_signal_emitter_get_output(GPAC_SignalEmitter* emitter,
+                               GPAC_SignalId id,
+                               const gchar* location,
+                               GOutputStream** output_stream)
+{
+  g_assert(id < GPAC_SIGNAL_LAST);
+
+  if (!emitter->queue_size)
+    return gpac_signal_emitter_emit(emitter, id, location, output_stream);
+
+  // The reference is held until the dispatcher closes the file
+  GpacSignalOutputStream* stream =
+    g_object_new(gpac_signal_output_stream_get_type(), NULL);
+  stream->emitter = emitter;
+  stream->location = g_strdup(location);
+
+  GPAC_SignalOp* op = g_new0(GPAC_SignalOp, 1);
+  op->id = id;
+  op->stream = g_object_ref(G_OUTPUT_STREAM(stream));
+  gpac_signal_emitter_push(emitter, GPAC_SIGNAL_OP_OPEN, op);
+
+  *output_stream = G_OUTPUT_STREAM(stream);
+  return TRUE;
+}
+
+GBytes*
+gpac_signal_emitter_load(GPAC_SignalEmitter* emitter,
+                         GPAC_SignalId id,
+                         const gchar* location)
+{
+  g_assert(id < GPAC_SIGNAL_LAST);
+
+  GBytes* data = NULL;
+  if (!emitter->objects[id])
+    return NULL;
+
+  GPAC_TRACE_BEGIN(span);
+  g_signal_emit(
+    emitter->objects[id], emitter->signal_ids[id], 0, location, &data);
+  GPAC_TRACE_END(span, gpac_signal_names[id - 1], location);
+  return data;
+}
+
+gboolean
+gpac_signal_emitter_delete(GPAC_SignalEmitter* emitter, const gchar* location)
+{
+  if (!emitter->queue_size)
+    return gpac_signal_emitter_emit(
+      emitter, GPAC_SIGNAL_DASHER_DELETE_SEGMENT, location, NULL);
+
+  GPAC_SignalOp* op = g_new0(GPAC_SignalOp, 1);
+  op->location = g_strdup(location);
+  gpac_signal_emitter_push(emitter, GPAC_SIGNAL_OP_DELETE, op);
+  return TRUE;
+}
+
+void
+gpac_signal_emitter_notify(GPAC_SignalEmitter* emitter,
+                           GPAC_SignalId id,
+                           GstStructure* info)
+{
+  g_assert(id < GPAC_SIGNAL_LAST);
 
-  return FALSE;
+  GPAC_SignalOp* op = g_new0(GPAC_SignalOp, 1);
+  op->id = id;
+  op->info = info;
+  gpac_signal_emitter_push(emitter, GPAC_SIGNAL_OP_NOTIFY, op);
 }
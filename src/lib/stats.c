@@ -0,0 +1,125 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "lib/stats.h"
+
+void
+gpac_stats_histogram_add(GPAC_StatsHistogram* hist, gint64 usec)
+{
+  guint64 value = usec > 0 ? (guint64)usec : 0;
+  guint bucket = MIN(g_bit_storage(value), GPAC_STATS_BUCKETS - 1);
+
+  hist->count++;
+  hist->sum += value;
+  hist->max = MAX(hist->max, value);
+  hist->buckets[bucket]++;
+}
+
+GstStructure*
+gpac_stats_histogram_to_structure(const GPAC_StatsHistogram* hist)
+{
+  GValue buckets = G_VALUE_INIT;
+  gst_value_array_init(&buckets, GPAC_STATS_BUCKETS);
+  for (guint i = 0; i < GPAC_STATS_BUCKETS; i++) {
+    GValue bucket = G_VALUE_INIT;
+    g_value_init(&bucket, G_TYPE_UINT64);
+    g_value_set_uint64(&bucket, hist->buckets[i]);
+    gst_value_array_append_and_take_value(&buckets, &bucket);
+  }
+
+  GstStructure* structure = gst_structure_new(
+    "histogram",
+    "count",
+    G_TYPE_UINT64,
+    hist->count,
+    "mean-us",
+    G_TYPE_UINT64,
+    hist->count ? hist->sum / hist->count : 0,
+    "max-us",
+    G_TYPE_UINT64,
+    hist->max,
+    NULL);
+  gst_structure_take_value(structure, "buckets", &buckets);
+  return structure;
+}
+
+static void
+gpac_stats_set_histogram(GstStructure* structure,
+                         const gchar* field,
+                         const GPAC_StatsHistogram* hist)
+{
+  GstStructure* value = gpac_stats_histogram_to_structure(hist);
+  gst_structure_set(structure, field, GST_TYPE_STRUCTURE, value, NULL);
+  gst_structure_free(value);
+}
+
+GstStructure*
+gpac_stats_to_structure(const GPAC_Stats* stats)
+{
+  GstStructure* structure = gst_structure_new("gpac-stats",
+                                              "packets-in",
+                                              G_TYPE_UINT64,
+                                              stats->packets_in,
+                                              "bytes-in",
+                                              G_TYPE_UINT64,
+                                              stats->bytes_in,
+                                              "packets-out",
+                                              G_TYPE_UINT64,
+                                              stats->packets_out,
+                                              "bytes-out",
+                                              G_TYPE_UINT64,
+                                              stats->bytes_out,
+                                              "queue-depth",
+                                              G_TYPE_UINT,
+                                              stats->queue_depth,
+                                              "queue-depth-max",
+                                              G_TYPE_UINT,
+                                              stats->queue_depth_max,
+                                              "session-reused",
+                                              G_TYPE_BOOLEAN,
+                                              stats->session_reused,
+                                              NULL);
+
+  gpac_stats_set_histogram(structure, "input", &stats->input);
+  gpac_stats_set_histogram(structure, "session-run", &stats->session_run);
+  gpac_stats_set_histogram(structure, "post-process", &stats->post_process);
+  gpac_stats_set_histogram(structure, "downstream", &stats->downstream);
+  return structure;
+}
+
+GstStructure*
+gpac_stats_pad_to_structure(const GPAC_PadStats* stats)
+{
+  GstStructure* structure = gst_structure_new("gpac-pad-stats",
+                                              "packets-in",
+                                              G_TYPE_UINT64,
+                                              stats->packets_in,
+                                              "bytes-in",
+                                              G_TYPE_UINT64,
+                                              stats->bytes_in,
+                                              NULL);
+  gpac_stats_set_histogram(structure, "idr-lateness", &stats->idr_lateness);
+  return structure;
+}
@@ -0,0 +1,265 @@
+/*
+ *			GPAC - Multimedia Framework C SDK
+ *
+ *			Authors: Deniz Ugur, Romain Bouqueau, Sohaib Larbi
+ *			Copyright (c) Motion Spell
+ *				All rights reserved
+ *
+ *  This file is part of the GPAC/GStreamer wrapper
+ *
+ *  This GPAC/GStreamer wrapper is free software; you can redistribute it
+ *  and/or modify it under the terms of the GNU Affero General Public License
+ *  as published by the Free Software Foundation; either version 3, or (at
+ *  your option) any later version.
+ *
+ *  This GPAC/GStreamer wrapper is distributed in the hope that it will be
+ *  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public
+ *  License along with this library; see the file LICENSE.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "lib/trace.h"
+
+#include <gpac/tools.h>
+#include <stdio.h>
+
+#define GPAC_TRACE_BATCH 1024
+
+typedef struct
+{
+  const gchar* name;
+  const gchar* arg;
+  gboolean owned; // the annotation was copied and is freed once written
+  gint64 ts;
+  gint64 dur;
+} GPAC_TraceEvent;
+
+typedef struct
+{
+  GMutex lock;
+  guint tid;
+  guint count;
+  GPAC_TraceEvent events[GPAC_TRACE_BATCH];
+} GPAC_TraceBuffer;
+
+static void
+gpac_trace_buffer_free(gpointer data);
+
+static GPrivate trace_buffer = G_PRIVATE_INIT(gpac_trace_buffer_free);
+
+// Global tracer state, protected by the lock except for the enabled flag
+static struct
+{
+  gint enabled;
+  GMutex lock;
+  guint refcount;
+  FILE* file;
+  gboolean first;
+  guint next_tid;
+  GSList* buffers;
+} trace;
+
+// #MARK: Writer
+static void
+gpac_trace_write_string(const gchar* str)
+{
+  // Names and PID names are plain ASCII, anything else is replaced
+  for (const gchar* c = str; *c; c++) {
+    if (*c == '"' || *c == '\\' || !g_ascii_isprint(*c))
+      fputc('_', trace.file);
+    else
+      fputc(*c, trace.file);
+  }
+}
+
+static void
+gpac_trace_flush_locked(GPAC_TraceBuffer* buf)
+{
+  for (guint i = 0; i < buf->count; i++) {
+    GPAC_TraceEvent* ev = &buf->events[i];
+    if (trace.file) {
+      fputs(trace.first ? "\n{\"name\":\"" : ",\n{\"name\":\"", trace.file);
+      gpac_trace_write_string(ev->name);
+      fprintf(trace.file,
+              "\",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT
+              ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":%u,\"tid\":%u",
+              ev->ts,
+              ev->dur,
+              gf_sys_get_process_id(),
+              buf->tid);
+      if (ev->arg) {
+        fputs(",\"args\":{\"pid\":\"", trace.file);
+        gpac_trace_write_string(ev->arg);
+        fputs("\"}", trace.file);
+      }
+      fputc('}', trace.file);
+      trace.first = FALSE;
+    }
+    if (ev->owned)
+      g_free((gchar*)ev->arg);
+  }
+  buf->count = 0;
+}
+
+static void
+gpac_trace_buffer_free(gpointer data)
+{
+  GPAC_TraceBuffer* buf = (GPAC_TraceBuffer*)data;
+
+  // Write out what is left before the thread exits
+  g_mutex_lock(&trace.lock);
+  g_mutex_lock(&buf->lock);
+  gpac_trace_flush_locked(buf);
+  trace.buffers = g_slist_remove(trace.buffers, buf);
+  g_mutex_unlock(&buf->lock);
+  g_mutex_unlock(&trace.lock);
+
+  g_mutex_clear(&buf->lock);
+  g_free(buf);
+}
+
+static GPAC_TraceBuffer*
+gpac_trace_get_buffer(void)
+{
+  GPAC_TraceBuffer* buf = g_private_get(&trace_buffer);
+  if (G_LIKELY(buf))
+    return buf;
+
+  // First span on this thread, register a new buffer
+  buf = g_new0(GPAC_TraceBuffer, 1);
+  g_mutex_init(&buf->lock);
+
+  g_mutex_lock(&trace.lock);
+  buf->tid = ++trace.next_tid;
+  trace.buffers = g_slist_prepend(trace.buffers, buf);
+  g_mutex_unlock(&trace.lock);
+
+  g_private_set(&trace_buffer, buf);
+  return buf;
+}
+
+// #MARK: Public API
+gboolean
+gpac_trace_ref(const gchar* path)
+{
+  g_mutex_lock(&trace.lock);
+  if (trace.refcount) {
+    trace.refcount++;
+    g_mutex_unlock(&trace.lock);
+    return TRUE;
+  }
+
+  if (!path)
+    path = g_getenv(GPAC_TRACE_ENV);
+  if (!path || !*path) {
+    g_mutex_unlock(&trace.lock);
+    return FALSE;
+  }
+
+  trace.file = fopen(path, "w");
+  if (!trace.file) {
+    g_mutex_unlock(&trace.lock);
+    GST_WARNING("Failed to open trace file %s", path);
+    return FALSE;
+  }
+
+  fputs("{\"traceEvents\":[", trace.file);
+  trace.first = TRUE;
+  trace.refcount = 1;
+  g_atomic_int_set(&trace.enabled, 1);
+  g_mutex_unlock(&trace.lock);
+  return TRUE;
+}
+
+void
+gpac_trace_unref(void)
+{
+  g_mutex_lock(&trace.lock);
+  if (!trace.refcount || --trace.refcount) {
+    g_mutex_unlock(&trace.lock);
+    return;
+  }
+
+  // Stop recording and write out every buffer
+  g_atomic_int_set(&trace.enabled, 0);
+  for (GSList* l = trace.buffers; l; l = l->next) {
+    GPAC_TraceBuffer* buf = (GPAC_TraceBuffer*)l->data;
+    g_mutex_lock(&buf->lock);
+    gpac_trace_flush_locked(buf);
+    g_mutex_unlock(&buf->lock);
+  }
+
+  fputs("\n],\"displayTimeUnit\":\"ms\"}\n", trace.file);
+  fclose(trace.file);
+  trace.file = NULL;
+  g_mutex_unlock(&trace.lock);
+}
+
+gboolean
+gpac_trace_enabled(void)
+{
+  return g_atomic_int_get(&trace.enabled);
+}
+
+gint64
+gpac_trace_begin(void)
+{
+  if (G_LIKELY(!g_atomic_int_get(&trace.enabled)))
+    return 0;
+  return g_get_monotonic_time();
+}
+
+static void
+gpac_trace_record(gint64 start,
+                  const gchar* name,
+                  const gchar* arg,
+                  gboolean owned)
+{
+  gint64 now = g_get_monotonic_time();
+  if (!g_atomic_int_get(&trace.enabled)) {
+    if (owned)
+      g_free((gchar*)arg);
+    return;
+  }
+
+  GPAC_TraceBuffer* buf = gpac_trace_get_buffer();
+  g_mutex_lock(&buf->lock);
+  GPAC_TraceEvent* ev = &buf->events[buf->count++];
+  ev->name = name;
+  ev->arg = arg;
+  ev->owned = owned;
+  ev->ts = start;
+  ev->dur = now - start;
+  if (buf->count < GPAC_TRACE_BATCH) {
+    g_mutex_unlock(&buf->lock);
+    return;
+  }
+  g_mutex_unlock(&buf->lock);
+
+  // The buffer is full, write it out. Only this thread appends to it, so it
+  // cannot overflow while the locks are taken in the global order.
+  g_mutex_lock(&trace.lock);
+  g_mutex_lock(&buf->lock);
+  gpac_trace_flush_locked(buf);
+  g_mutex_unlock(&buf->lock);
+  g_mutex_unlock(&trace.lock);
+}
+
+void
+gpac_trace_end(gint64 start, const gchar* name, const gchar* arg)
+{
+  if (!g_atomic_int_get(&trace.enabled))
+    return;
+  gpac_trace_record(start, name, g_strdup(arg), TRUE);
+}
+
+void
+gpac_trace_end_static(gint64 start, const gchar* name, const gchar* arg)
+{
+  gpac_trace_record(start, name, arg, FALSE);
+}
@@ -1,4 +1,5 @@
 #include "helper/common.hpp"
+#include <algorithm>
 #include <filesystem>
 #include <gpac/isomedia.h>
 #include <gpac/media_tools.h>
@@ -37,6 +38,23 @@ CheckFile(const std::string& file, u32 track_count, u32 sample_count)
   gf_sys_close();
 }
 
+std::vector<std::string>
+GetFilters(GstElement* element)
+{
+  std::vector<std::string> filters;
+  GstStructure* stats = NULL;
+  g_object_get(element, "stats", &stats, NULL);
+  if (!stats)
+    return filters;
+
+  const GValue* list = gst_structure_get_value(stats, "filters");
+  for (guint i = 0; list && i < gst_value_array_get_size(list); i++)
+    filters.emplace_back(
+      g_value_get_string(gst_value_array_get_value(list, i)));
+  gst_structure_free(stats);
+  return filters;
+}
+
 TEST_F(GstTestFixture, HandlesX264)
 {
   SETUP_PIPELINE("x264enc", "x264.mp4", 5);
@@ -57,3 +75,64 @@ TEST_F(GstTestFixture, HandlesAV1)
   CheckFile(file, 1, 2);
   TEARDOWN_PIPELINE();
 }
+
+TEST_F(GstTestFixture, HandlesFramedByteStream)
+{
+  this->SetUpPipeline({ false, "x264enc", 5 });
+  std::string file = fs::temp_directory_path().string() + "/framed.mp4";
+  std::string graph = "-o " + file;
+  GstElement* element = gst_element_factory_make_full(
+    "gpacsink", "graph", graph.c_str(), "framed-input", TRUE, NULL);
+  if (!gst_bin_add(GST_BIN(pipeline), element)) {
+    g_error("Failed to create elements");
+    return;
+  }
+
+  // Force Annex B so that start codes have to be converted
+  GstCaps* caps = gst_caps_from_string(
+    "video/x-h264, stream-format=byte-stream, alignment=au");
+  if (!gst_element_link_filtered(this->GetLastElement(), element, caps)) {
+    g_error("Failed to link elements");
+    return;
+  }
+  gst_caps_unref(caps);
+
+  this->StartPipeline();
+  this->WaitForEOS();
+
+  // The muxer takes the samples as is, without a reframer in between
+  std::vector<std::string> filters = GetFilters(element);
+  EXPECT_NE(std::find(filters.begin(), filters.end(), "mp4mx"), filters.end());
+  EXPECT_EQ(std::find(filters.begin(), filters.end(), "rfnalu"),
+            filters.end());
+
+  CheckFile(file, 1, 5);
+  fs::remove(file);
+}
+
+TEST_F(GstTestFixture, HandlesFramedAV1)
+{
+  this->SetUpPipeline({ false, "av1enc", 2 });
+  std::string file = fs::temp_directory_path().string() + "/framed-av1.mp4";
+  std::string graph = "-o " + file;
+  GstElement* element = gst_element_factory_make_full(
+    "gpacsink", "graph", graph.c_str(), "framed-input", TRUE, NULL);
+  if (!gst_bin_add(GST_BIN(pipeline), element)) {
+    g_error("Failed to create elements");
+    return;
+  }
+  if (!gst_element_link(this->GetLastElement(), element)) {
+    g_error("Failed to link elements");
+    return;
+  }
+
+  this->StartPipeline();
+  this->WaitForEOS();
+
+  // AV1 is not handled by the fast path and keeps its reframer
+  std::vector<std::string> filters = GetFilters(element);
+  EXPECT_NE(std::find(filters.begin(), filters.end(), "rfav1"), filters.end());
+
+  CheckFile(file, 1, 2);
+  fs::remove(file);
+}
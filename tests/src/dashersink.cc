@@ -1,9 +1,15 @@
 #include "helper/common.hpp"
 #include "helper/smemcapture.hpp"
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <gpac/isomedia.h>
 #include <gpac/media_tools.h>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -248,3 +254,599 @@ TEST_F(GstTestFixture, HLSMultiVariantInSink)
   // Check manifests
   CHECK_MANIFEST_FILE(0);
 }
+
+TEST_F(GstTestFixture, HLSManifestWriteIfChanged)
+{
+  PipelineConfigurationMany cfg;
+  cfg.v_num_buffers = 30 * 10;
+  cfg.a_num_buffers = 48000 / 1024 * 10;
+
+  this->SetUpPipelineMany(cfg);
+  GstElement* gpachlssink =
+    gst_element_factory_make_full("gpachlssink", "segdur", 1.0, NULL);
+
+  // Create signal handlers
+  SignalMemoryCapture capture;
+  capture.connect(gpachlssink, "get-manifest");
+
+  // Add the sink to the pipeline
+  gst_bin_add(GST_BIN(pipeline), gpachlssink);
+  // Link the elements
+  for (auto& encoder : GetEncoders()) {
+    if (!gst_element_link(encoder, gpachlssink)) {
+      g_error("Failed to link elements");
+      return;
+    }
+  }
+
+  this->StartPipeline();
+  this->WaitForEOS();
+  capture.finish(gpachlssink);
+
+  // The master playlist is regenerated on every segment, but only written
+  // when it changes
+  const auto& writes = capture.get_all("get-manifest");
+  ASSERT_GT(writes.size(), 0);
+  EXPECT_LT(writes.size(), 10);
+  for (size_t i = 1; i < writes.size(); i++)
+    EXPECT_NE(writes[i], writes[i - 1]);
+}
+
+TEST_F(GstTestFixture, HLSReadyNotifications)
+{
+  // Stand-in for a server holding blocking playlist reloads
+  struct ReadyServer
+  {
+    GMutex lock;
+    GCond cond;
+    GThread* emit_thread = nullptr;
+    std::vector<std::pair<std::string, guint64>> segments;
+    guint32 msn = 0;
+    guint manifest_updates = 0;
+    gboolean wrong_thread = FALSE;
+
+    ReadyServer()
+    {
+      g_mutex_init(&lock);
+      g_cond_init(&cond);
+    }
+    ~ReadyServer()
+    {
+      g_mutex_clear(&lock);
+      g_cond_clear(&cond);
+    }
+  };
+  auto server = std::make_shared<ReadyServer>();
+
+  PipelineConfigurationMany cfg;
+  cfg.v_num_buffers = 30 * 10;
+  cfg.a_num_buffers = 48000 / 1024 * 10;
+
+  this->SetUpPipelineMany(cfg);
+  GstElement* gpachlssink =
+    gst_element_factory_make_full("gpachlssink", "segdur", 1.0, NULL);
+
+  SignalMemoryCapture capture;
+  capture.connect(gpachlssink, "get-segment");
+
+  // Remember the streaming thread that writes the segments
+  g_signal_connect_data(
+    gpachlssink,
+    "get-segment",
+    G_CALLBACK(+[](GstElement*, const gchar*, gpointer data) -> gpointer {
+      auto* server = static_cast<std::shared_ptr<ReadyServer>*>(data)->get();
+      g_mutex_lock(&server->lock);
+      server->emit_thread = g_thread_self();
+      g_mutex_unlock(&server->lock);
+      return nullptr;
+    }),
+    new std::shared_ptr<ReadyServer>(server),
+    [](gpointer data, GClosure*) {
+      delete static_cast<std::shared_ptr<ReadyServer>*>(data);
+    },
+    (GConnectFlags)0);
+
+  auto on_ready = +[](GstElement*, GstStructure* info, gpointer data) {
+    auto* server = static_cast<std::shared_ptr<ReadyServer>*>(data)->get();
+    g_mutex_lock(&server->lock);
+    if (server->emit_thread == g_thread_self())
+      server->wrong_thread = TRUE;
+    if (gst_structure_has_name(info, "manifest-updated")) {
+      server->manifest_updates++;
+    } else {
+      guint sequence = 0;
+      guint64 size = 0;
+      gst_structure_get_uint(info, "sequence", &sequence);
+      gst_structure_get_uint64(info, "size", &size);
+      gchar* name =
+        g_path_get_basename(gst_structure_get_string(info, "name"));
+      server->segments.emplace_back(name, size);
+      g_free(name);
+      server->msn = MAX(server->msn, sequence);
+    }
+    g_cond_broadcast(&server->cond);
+    g_mutex_unlock(&server->lock);
+  };
+  for (const char* signal : { "segment-ready", "manifest-updated" }) {
+    g_signal_connect_data(
+      gpachlssink,
+      signal,
+      G_CALLBACK(on_ready),
+      new std::shared_ptr<ReadyServer>(server),
+      [](gpointer data, GClosure*) {
+        delete static_cast<std::shared_ptr<ReadyServer>*>(data);
+      },
+      (GConnectFlags)0);
+  }
+
+  // A client blocking on the playlist until the 5th segment is announced
+  std::thread client([server]() {
+    const gint64 deadline = g_get_monotonic_time() + 30 * G_TIME_SPAN_SECOND;
+    g_mutex_lock(&server->lock);
+    while (server->msn < 5)
+      if (!g_cond_wait_until(&server->cond, &server->lock, deadline))
+        break;
+    g_mutex_unlock(&server->lock);
+  });
+
+  gst_bin_add(GST_BIN(pipeline), gpachlssink);
+  for (auto& encoder : GetEncoders()) {
+    if (!gst_element_link(encoder, gpachlssink)) {
+      g_error("Failed to link elements");
+      return;
+    }
+  }
+
+  this->StartPipeline();
+  client.join();
+  this->WaitForEOS();
+  capture.finish(gpachlssink);
+
+  g_mutex_lock(&server->lock);
+  EXPECT_GE(server->msn, 5u);
+  EXPECT_GT(server->manifest_updates, 0u);
+  EXPECT_FALSE(server->wrong_thread);
+
+  // Every announced segment is complete
+  ASSERT_GT(server->segments.size(), 0);
+  for (const auto& [name, size] : server->segments) {
+    const auto* buffer = capture.get_labeled(name);
+    ASSERT_TRUE(buffer != nullptr) << name;
+    EXPECT_EQ(buffer->size(), size) << name;
+  }
+  g_mutex_unlock(&server->lock);
+}
+
+TEST_F(GstTestFixture, HLSAsyncSignals)
+{
+  PipelineConfigurationMany cfg;
+  cfg.v_num_buffers = 30 * 10 * 3;
+  cfg.a_num_buffers = 48000 / 1024 * 10 * 3;
+
+  this->SetUpPipelineMany(cfg);
+  GstElement* gpachlssink = gst_element_factory_make_full("gpachlssink",
+                                                          "segdur",
+                                                          10.0,
+                                                          "signal-queue-size",
+                                                          (guint64)256 * 1024,
+                                                          NULL);
+
+  // A slow handler, which must not stall the packaging
+  static GThread* output_thread = nullptr;
+  static GThread* notify_thread = nullptr;
+  g_signal_connect(
+    gpachlssink,
+    "get-segment",
+    G_CALLBACK(+[](GstElement*, const gchar*, gpointer) -> gpointer {
+      output_thread = g_thread_self();
+      g_usleep(50 * 1000);
+      return nullptr;
+    }),
+    NULL);
+  g_signal_connect(gpachlssink,
+                   "segment-ready",
+                   G_CALLBACK(+[](GstElement*, GstStructure*, gpointer) {
+                     notify_thread = g_thread_self();
+                   }),
+                   NULL);
+
+  // Create signal handlers
+  SignalMemoryCapture capture;
+  capture.connect(gpachlssink, "get-manifest");
+  capture.connect(gpachlssink, "get-manifest-variant");
+  capture.connect(gpachlssink, "get-segment-init");
+  capture.connect(gpachlssink, "get-segment");
+
+  // Add the sink to the pipeline
+  gst_bin_add(GST_BIN(pipeline), gpachlssink);
+  // Link the elements
+  for (auto& encoder : GetEncoders()) {
+    if (!gst_element_link(encoder, gpachlssink)) {
+      g_error("Failed to link elements");
+      return;
+    }
+  }
+
+  this->StartPipeline();
+  this->WaitForEOS();
+
+  // The queued output is dispatched before the element stops
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  capture.finish(gpachlssink);
+
+  // Output and notifications share the dispatcher thread
+  ASSERT_TRUE(output_thread != nullptr);
+  EXPECT_EQ(output_thread, notify_thread);
+
+  CHECK_MANIFEST_FILE(0);
+  ASSERT_EQ(capture.get_all("get-segment-init").size(), 2);
+  ASSERT_EQ(capture.get_all("get-segment").size(), 4 * 3);
+
+  // The queued writes reach the application streams in order
+  auto audio_streams =
+    merge_init_and_segment_files(capture, "PID4_dash_track4_%s", "m4s");
+  ASSERT_GT(audio_streams.size(), 0);
+
+  gf_sys_init(GF_MemTrackerNone, NULL);
+  GF_ISOFile* audio_isom = gf_isom_open_from_buffer(audio_streams);
+  ASSERT_TRUE(audio_isom != NULL);
+  EXPECT_WITHIN_RANGE(gf_isom_get_sample_count(audio_isom, 1),
+                      cfg.a_num_buffers - 1,
+                      cfg.a_num_buffers + 1);
+  gf_isom_close(audio_isom);
+  gf_sys_close();
+}
+
+TEST_F(GstTestFixture, HLSPersistedState)
+{
+  gchar* tmp_dir = g_dir_make_tmp("gpac-state-XXXXXX", NULL);
+  ASSERT_TRUE(tmp_dir != nullptr);
+  gchar* state_file = g_build_filename(tmp_dir, "state.mpd", NULL);
+
+  PipelineConfigurationMany cfg;
+  cfg.v_num_buffers = 30 * 5;
+  cfg.a_num_buffers = 48000 / 1024 * 5;
+
+  this->SetUpPipelineMany(cfg);
+  GstElement* gpachlssink = gst_element_factory_make_full(
+    "gpachlssink", "segdur", 1.0, "state", state_file, NULL);
+
+  struct StateRun
+  {
+    std::string loaded;
+    GBytes* restore = nullptr; // what the application persisted
+    std::vector<std::string> states;
+    std::vector<guint> sequences;
+  } run;
+
+  // The application returns the state saved by the previous instance
+  g_signal_connect(
+    gpachlssink,
+    "load-state",
+    G_CALLBACK(+[](GstElement*, const gchar* location, gpointer user_data)
+                 -> GBytes* {
+      auto* run = static_cast<StateRun*>(user_data);
+      run->loaded = location;
+      return run->restore ? g_bytes_ref(run->restore) : nullptr;
+    }),
+    &run);
+
+  g_signal_connect(gpachlssink,
+                   "state-updated",
+                   G_CALLBACK(+[](GstElement*,
+                                  GstStructure* info,
+                                  gpointer user_data) {
+                     GBytes* data = nullptr;
+                     gst_structure_get(info, "data", G_TYPE_BYTES, &data, NULL);
+                     gsize size;
+                     const gchar* str =
+                       (const gchar*)g_bytes_get_data(data, &size);
+                     static_cast<StateRun*>(user_data)->states.emplace_back(
+                       str, size);
+                     g_bytes_unref(data);
+                   }),
+                   &run);
+
+  g_signal_connect(gpachlssink,
+                   "segment-ready",
+                   G_CALLBACK(+[](GstElement*,
+                                  GstStructure* info,
+                                  gpointer user_data) {
+                     guint sequence = 0;
+                     gst_structure_get_uint(info, "sequence", &sequence);
+                     static_cast<StateRun*>(user_data)->sequences.push_back(
+                       sequence);
+                   }),
+                   &run);
+
+  gst_bin_add(GST_BIN(pipeline), gpachlssink);
+  for (auto& encoder : GetEncoders()) {
+    if (!gst_element_link(encoder, gpachlssink)) {
+      g_error("Failed to link elements");
+      return;
+    }
+  }
+
+  auto run_once = [&]() {
+    SignalMemoryCapture capture;
+    capture.connect(gpachlssink, "get-manifest");
+    capture.connect(gpachlssink, "get-manifest-variant");
+    capture.connect(gpachlssink, "get-segment-init");
+    capture.connect(gpachlssink, "get-segment");
+
+    this->StartPipeline();
+    this->WaitForEOS();
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    capture.finish(gpachlssink);
+  };
+
+  // First instance, nothing persisted yet
+  run_once();
+
+  // The state was requested once, before the session started
+  EXPECT_EQ(run.loaded, state_file);
+
+  // Every published state is new, and is the MPD the dasher reloads
+  ASSERT_GT(run.states.size(), 0);
+  for (size_t i = 1; i < run.states.size(); i++)
+    EXPECT_NE(run.states[i], run.states[i - 1]);
+  EXPECT_NE(run.states.back().find("<MPD"), std::string::npos);
+  EXPECT_TRUE(g_file_test(state_file, G_FILE_TEST_EXISTS));
+
+  ASSERT_GT(run.sequences.size(), 0);
+  guint last_sequence =
+    *std::max_element(run.sequences.begin(), run.sequences.end());
+
+  // Second instance, the local file is gone and only the application has the
+  // state. The segment numbering picks up where the first instance stopped.
+  g_unlink(state_file);
+  run.restore = g_bytes_new(run.states.back().data(), run.states.back().size());
+  run.loaded.clear();
+  run.states.clear();
+  run.sequences.clear();
+  run_once();
+
+  EXPECT_EQ(run.loaded, state_file);
+  ASSERT_GT(run.sequences.size(), 0);
+  EXPECT_GT(*std::min_element(run.sequences.begin(), run.sequences.end()),
+            last_sequence);
+
+  // The handlers do not outlive the test
+  g_signal_handlers_disconnect_by_data(gpachlssink, &run);
+  g_bytes_unref(run.restore);
+  g_unlink(state_file);
+  g_rmdir(tmp_dir);
+  g_free(state_file);
+  g_free(tmp_dir);
+}
+
+TEST_F(GstTestFixture, DASHDualManifest)
+{
+  PipelineConfigurationMany cfg;
+  cfg.v_num_buffers = 30 * 10 * 3;
+  cfg.a_num_buffers = 48000 / 1024 * 10 * 3;
+
+  this->SetUpPipelineMany(cfg);
+  GstElement* gpacdashsink = gst_element_factory_make_full(
+    "gpacdashsink", "segdur", 10.0, "dual", TRUE, NULL);
+
+  // Create signal handlers
+  SignalMemoryCapture capture;
+  capture.connect(gpacdashsink, "get-manifest");
+  capture.connect(gpacdashsink, "get-manifest-variant");
+  capture.connect(gpacdashsink, "get-segment-init");
+  capture.connect(gpacdashsink, "get-segment");
+
+  // Add the sink to the pipeline
+  gst_bin_add(GST_BIN(pipeline), gpacdashsink);
+  // Link the elements
+  for (auto& encoder : GetEncoders()) {
+    if (!gst_element_link(encoder, gpacdashsink)) {
+      g_error("Failed to link elements");
+      return;
+    }
+  }
+
+  this->StartPipeline();
+  this->WaitForEOS();
+  capture.finish(gpacdashsink);
+
+  // Both main manifests are published
+  const auto* mpd = capture.get_labeled("manifest.mpd");
+  ASSERT_TRUE(mpd != nullptr);
+  std::string mpd_str(mpd->begin(), mpd->end());
+  EXPECT_NE(mpd_str.find("<MPD"), std::string::npos);
+
+  const auto* m3u8 = capture.get_labeled("manifest.m3u8");
+  ASSERT_TRUE(m3u8 != nullptr);
+  std::string m3u8_str(m3u8->begin(), m3u8->end());
+  EXPECT_EQ(m3u8_str.rfind("#EXTM3U", 0), 0);
+  EXPECT_GT(capture.get_all("get-manifest-variant").size(), 0);
+
+  // The segments are written once, for both manifests
+  ASSERT_EQ(capture.get_all("get-segment-init").size(), 2);
+  ASSERT_EQ(capture.get_all("get-segment").size(), 4 * 3);
+}
+
+TEST_F(GstTestFixture, HLSRuntimeOptionUpdate)
+{
+  PipelineConfigurationMany cfg;
+  cfg.v_num_buffers = 30 * 8;
+  cfg.a_num_buffers = 48000 / 1024 * 8;
+
+  this->SetUpPipelineMany(cfg);
+  this->SetLive(true);
+  GstElement* gpachlssink =
+    gst_element_factory_make_full("gpachlssink", "segdur", 1.0, NULL);
+
+  // The dasher segment duration can be updated while running
+  GParamSpec* pspec =
+    g_object_class_find_property(G_OBJECT_GET_CLASS(gpachlssink), "segdur");
+  ASSERT_TRUE(pspec != nullptr);
+  EXPECT_TRUE(pspec->flags & GST_PARAM_MUTABLE_PLAYING);
+
+  SignalMemoryCapture capture;
+  capture.connect(gpachlssink, "get-segment");
+
+  struct UpdateRun
+  {
+    std::atomic<int> segments = 0;
+    std::mutex lock;
+    std::vector<GstClockTime> durations;
+    std::vector<std::string> applied;
+  } run;
+
+  g_signal_connect(gpachlssink,
+                   "segment-ready",
+                   G_CALLBACK(+[](GstElement*,
+                                  GstStructure* info,
+                                  gpointer user_data) {
+                     auto* run = static_cast<UpdateRun*>(user_data);
+                     guint64 duration = GST_CLOCK_TIME_NONE;
+                     gst_structure_get_uint64(info, "duration", &duration);
+                     std::lock_guard<std::mutex> guard(run->lock);
+                     run->durations.push_back(duration);
+                     run->segments++;
+                   }),
+                   &run);
+
+  // Collect the notifications posted when an update takes effect
+  GstBus* bus = gst_element_get_bus(pipeline);
+  gst_bus_enable_sync_message_emission(bus);
+  gulong handler = g_signal_connect(
+    bus,
+    "sync-message::element",
+    G_CALLBACK(+[](GstBus*, GstMessage* msg, gpointer user_data) {
+      auto* run = static_cast<UpdateRun*>(user_data);
+      const GstStructure* s = gst_message_get_structure(msg);
+      if (gst_structure_has_name(s, "gpac-option-applied")) {
+        std::lock_guard<std::mutex> guard(run->lock);
+        run->applied.emplace_back(gst_structure_get_string(s, "name"));
+      }
+    }),
+    &run);
+
+  gst_bin_add(GST_BIN(pipeline), gpachlssink);
+  for (auto& encoder : GetEncoders()) {
+    if (!gst_element_link(encoder, gpachlssink)) {
+      g_error("Failed to link elements");
+      return;
+    }
+  }
+
+  this->StartPipeline();
+
+  // Switch to longer segments once the first ones are out
+  const gint64 deadline = g_get_monotonic_time() + 10 * G_TIME_SPAN_SECOND;
+  while (run.segments == 0 && g_get_monotonic_time() < deadline)
+    g_usleep(10 * 1000);
+  ASSERT_GT(run.segments, 0);
+  g_object_set(gpachlssink, "segdur", 3.0, NULL);
+
+  this->WaitForEOS();
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  capture.finish(gpachlssink);
+  g_signal_handler_disconnect(bus, handler);
+  g_signal_handlers_disconnect_by_data(gpachlssink, &run);
+  gst_bus_disable_sync_message_emission(bus);
+  gst_object_unref(bus);
+
+  // The update was applied at a boundary without restarting the session
+  ASSERT_EQ(run.applied.size(), 1);
+  EXPECT_EQ(run.applied[0], "segdur");
+
+  // Segments were cut at the old duration first, then at the new one
+  ASSERT_GT(run.durations.size(), 1);
+  EXPECT_LT(run.durations.front(), 3 * GST_SECOND / 2);
+  GstClockTime longest =
+    *std::max_element(run.durations.begin(), run.durations.end());
+  EXPECT_GE(longest, 2 * GST_SECOND);
+}
+
+TEST_F(GstTestFixture, HLSIFramePlaylist)
+{
+  PipelineConfigurationMany cfg;
+  cfg.v_num_buffers = 30 * 10;
+  cfg.a_num_buffers = 48000 / 1024 * 10;
+
+  this->SetUpPipelineMany(cfg);
+  GstElement* gpachlssink = gst_element_factory_make_full(
+    "gpachlssink", "segdur", 1.0, "iframe-playlist", TRUE, NULL);
+
+  // Create signal handlers
+  SignalMemoryCapture capture;
+  capture.connect(gpachlssink, "get-manifest");
+  capture.connect(gpachlssink, "get-manifest-variant");
+  capture.connect(gpachlssink, "get-segment");
+
+  // Add the sink to the pipeline
+  gst_bin_add(GST_BIN(pipeline), gpachlssink);
+  // Link the elements
+  for (auto& encoder : GetEncoders()) {
+    if (!gst_element_link(encoder, gpachlssink)) {
+      g_error("Failed to link elements");
+      return;
+    }
+  }
+
+  this->StartPipeline();
+  this->WaitForEOS();
+  capture.finish(gpachlssink);
+
+  // Only the video representation gets an I-frame playlist
+  std::string last;
+  for (const auto& write : capture.get_all("get-manifest-variant")) {
+    std::string str(write.begin(), write.end());
+    if (str.find("#EXT-X-I-FRAMES-ONLY") == std::string::npos)
+      continue;
+    EXPECT_NE(str.find("#EXT-X-BYTERANGE:"), std::string::npos);
+    EXPECT_NE(str.find("#EXT-X-MAP:URI="), std::string::npos);
+    last = str;
+  }
+  ASSERT_FALSE(last.empty());
+
+  // The last write completes the playlist
+  EXPECT_NE(last.find("#EXT-X-ENDLIST"), std::string::npos);
+
+  // The first entry addresses a key frame fragment of its segment
+  size_t entry = last.find("#EXT-X-BYTERANGE:");
+  guint64 length = 0, offset = 0;
+  ASSERT_EQ(sscanf(last.c_str() + entry,
+                   "#EXT-X-BYTERANGE:%" G_GUINT64_FORMAT "@%" G_GUINT64_FORMAT,
+                   &length,
+                   &offset),
+            2);
+  size_t uri_start = last.find('\n', entry) + 1;
+  std::string uri =
+    last.substr(uri_start, last.find('\n', uri_start) - uri_start);
+  gchar* basename = g_path_get_basename(uri.c_str());
+  const auto* segment = capture.get_labeled(basename);
+  g_free(basename);
+  ASSERT_TRUE(segment != nullptr);
+  ASSERT_GE(length, 8);
+  ASSERT_LE(offset + length, segment->size());
+
+  // The range starts on a moof and ends inside the mdat that follows it
+  auto box_type = [&](guint64 pos) {
+    return std::string((const char*)segment->data() + pos + 4, 4);
+  };
+  EXPECT_EQ(box_type(offset), "moof");
+  std::string end_box;
+  guint64 pos = offset;
+  while (pos < offset + length && pos + 8 <= segment->size()) {
+    guint32 size = GST_READ_UINT32_BE(segment->data() + pos);
+    if (size < 8)
+      break;
+    end_box = box_type(pos);
+    pos += size;
+  }
+  EXPECT_EQ(end_box, "mdat");
+  EXPECT_GE(pos, offset + length);
+
+  // And listed in the master playlist
+  const auto& writes = capture.get_all("get-manifest");
+  ASSERT_GT(writes.size(), 0);
+  std::string master(writes.back().begin(), writes.back().end());
+  EXPECT_NE(master.find("#EXT-X-I-FRAME-STREAM-INF:BANDWIDTH="),
+            std::string::npos);
+}
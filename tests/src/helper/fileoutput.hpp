@@ -0,0 +1,61 @@
+#pragma once
+
+#include <filesystem>
+#include <gpac/isomedia.h>
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+#include <string>
+
+// Writes the output of an element under test to a temporary file
+class FileOutput
+{
+private:
+  std::string path;
+
+public:
+  FileOutput(GstElement* pipeline,
+             GstElement* connect_from,
+             GstElement* test_element,
+             const std::string& name)
+  {
+    // Set the destination options
+    path = std::filesystem::temp_directory_path().string() + "/" + name;
+    GstElement* sink =
+      gst_element_factory_make_full("filesink", "location", path.c_str(), NULL);
+
+    // Add the elements to the pipeline
+    gst_bin_add_many(GST_BIN(pipeline), test_element, sink, NULL);
+
+    // Link the elements
+    if (!gst_element_link(connect_from, test_element) ||
+        !gst_element_link(test_element, sink)) {
+      g_error("Failed to link elements");
+      return;
+    }
+  }
+
+  ~FileOutput() { std::filesystem::remove(path); }
+
+  const std::string& GetPath() const { return path; }
+
+  // Checks the track count and the sample count of the first track
+  void Check(guint track_count, guint min_samples, guint max_samples) const
+  {
+    ASSERT_TRUE(std::filesystem::exists(path));
+    gf_sys_init(GF_MemTrackerNone, NULL);
+    GF_ISOFile* isom = gf_isom_open(path.c_str(), GF_ISOM_OPEN_READ, NULL);
+    ASSERT_TRUE(isom != NULL);
+
+    EXPECT_EQ(gf_isom_get_track_count(isom), track_count);
+    EXPECT_GE(gf_isom_get_sample_count(isom, 1), min_samples);
+    EXPECT_LE(gf_isom_get_sample_count(isom, 1), max_samples);
+
+    gf_isom_close(isom);
+    gf_sys_close();
+  }
+
+  void Check(guint track_count, guint sample_count) const
+  {
+    Check(track_count, sample_count, sample_count);
+  }
+};
@@ -0,0 +1,85 @@
+#include "lib/shm.h"
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+// Minimal consumer of the shared memory output
+class ShmReader
+{
+public:
+  using Buffer = std::vector<uint8_t>;
+
+  ~ShmReader()
+  {
+    if (map_)
+      munmap(map_, map_size_);
+    if (memfd_ >= 0)
+      close(memfd_);
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  // Connects and receives the memfd, returns the number of replayed
+  // descriptors that follow, or -1 on failure
+  int connect(const std::string& path)
+  {
+    fd_ = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (::connect(fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+      return -1;
+
+    GPAC_ShmDescriptor hello;
+    struct iovec iov = { &hello, sizeof(hello) };
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(fd_, &msg, 0) != sizeof(hello) ||
+        hello.magic != GPAC_SHM_MAGIC || hello.type != GPAC_SHM_MSG_HELLO)
+      return -1;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+      return -1;
+    memcpy(&memfd_, CMSG_DATA(cmsg), sizeof(int));
+
+    map_size_ = hello.size;
+    void* map = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, memfd_, 0);
+    if (map == MAP_FAILED)
+      return -1;
+    map_ = static_cast<uint8_t*>(map);
+    return (int)hello.sequence;
+  }
+
+  bool next(GPAC_ShmDescriptor& desc)
+  {
+    return recv(fd_, &desc, sizeof(desc), 0) == sizeof(desc) &&
+           desc.magic == GPAC_SHM_MAGIC && desc.type == GPAC_SHM_MSG_DATA;
+  }
+
+  // Copies the data out, empty if it was overwritten in the meantime
+  Buffer read(const GPAC_ShmDescriptor& desc)
+  {
+    Buffer data(map_ + desc.offset, map_ + desc.offset + desc.size);
+    auto* header = reinterpret_cast<GPAC_ShmRingHeader*>(map_);
+    guint64 written =
+      __atomic_load_n(&header->write_position, __ATOMIC_ACQUIRE);
+    if (written - desc.position > header->data_size)
+      return {};
+    return data;
+  }
+
+private:
+  int fd_ = -1;
+  int memfd_ = -1;
+  uint8_t* map_ = nullptr;
+  size_t map_size_ = 0;
+};
@@ -1,4 +1,5 @@
 #include "helper/common.hpp"
+#include <atomic>
 
 TEST_F(GstTestFixture, Live)
 {
@@ -10,6 +11,21 @@ TEST_F(GstTestFixture, Live)
   GstAppSink* sink = new GstAppSink(gpaccmafmux, GetEncoder(), pipeline);
   sink->SetSync(true);
 
+  // A muxer keeping up with the input sends no QoS upstream
+  std::atomic<int> qos_events = 0;
+  GstPad* pad = gst_element_get_static_pad(GetEncoder(), "src");
+  gulong probe = gst_pad_add_probe(
+    pad,
+    GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+    [](GstPad*, GstPadProbeInfo* info, gpointer data) -> GstPadProbeReturn {
+      GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+      if (GST_EVENT_TYPE(event) == GST_EVENT_QOS)
+        (*static_cast<std::atomic<int>*>(data))++;
+      return GST_PAD_PROBE_OK;
+    },
+    &qos_events,
+    NULL);
+
   this->StartPipeline();
 
   // Count the number of buffers
@@ -21,6 +37,10 @@ TEST_F(GstTestFixture, Live)
     buffer_count++;
   }
   EXPECT_EQ(buffer_count, 1);
+  EXPECT_EQ(qos_events, 0);
+
+  gst_pad_remove_probe(pad, probe);
+  gst_object_unref(pad);
 }
 
 TEST_F(GstTestFixture, LiveCanStop)
@@ -41,3 +61,69 @@ TEST_F(GstTestFixture, LiveCanStop)
   // Stop the pipeline deliberately
   gst_element_set_state(pipeline, GST_STATE_NULL);
 }
+
+TEST_F(GstTestFixture, LiveQoS)
+{
+  this->SetUpPipeline({ false, "x264enc", 30 });
+  this->SetLive(true);
+
+  // Hold the encoded frames back, so that they reach the muxer late
+  GstElement* identity =
+    gst_element_factory_make_full("identity", "sleep-time", 200000, NULL);
+  GstElement* gpaccmafmux =
+    gst_element_factory_make_full("gpaccmafmux", "cdur", 1.0, NULL);
+  GstElement* sink = gst_element_factory_make("fakesink", NULL);
+
+  // Add the elements to the pipeline
+  gst_bin_add_many(GST_BIN(pipeline), identity, gpaccmafmux, sink, NULL);
+
+  // Link the elements
+  if (!gst_element_link_many(
+        this->GetLastElement(), identity, gpaccmafmux, sink, NULL)) {
+    g_error("Failed to link elements");
+    return;
+  }
+
+  // Count the QoS events sent upstream
+  std::atomic<int> qos_events = 0;
+  GstPad* pad = gst_element_get_static_pad(identity, "src");
+  gulong probe = gst_pad_add_probe(
+    pad,
+    GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+    [](GstPad*, GstPadProbeInfo* info, gpointer data) -> GstPadProbeReturn {
+      GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+      if (GST_EVENT_TYPE(event) == GST_EVENT_QOS)
+        (*static_cast<std::atomic<int>*>(data))++;
+      return GST_PAD_PROBE_OK;
+    },
+    &qos_events,
+    NULL);
+
+  // And the QoS messages posted by the muxer
+  std::atomic<int> qos_messages = 0;
+  GstBus* bus = gst_element_get_bus(pipeline);
+  gst_bus_enable_sync_message_emission(bus);
+  gulong handler = g_signal_connect(
+    bus,
+    "sync-message::qos",
+    G_CALLBACK(+[](GstBus*, GstMessage* message, gpointer user_data) {
+      if (!g_str_has_prefix(GST_OBJECT_NAME(GST_MESSAGE_SRC(message)),
+                            "gpaccmafmux"))
+        return;
+      (*static_cast<std::atomic<int>*>(user_data))++;
+    }),
+    &qos_messages);
+
+  this->StartPipeline();
+  this->WaitForEOS();
+
+  EXPECT_GT(qos_events, 0);
+  EXPECT_GT(qos_messages, 0);
+
+  // The counters do not outlive the test
+  gst_pad_remove_probe(pad, probe);
+  gst_object_unref(pad);
+  g_signal_handler_disconnect(bus, handler);
+  gst_bus_disable_sync_message_emission(bus);
+  gst_object_unref(bus);
+}
@@ -1,5 +1,9 @@
 #include "helper/common.hpp"
+#include "helper/fileoutput.hpp"
+#include "helper/shmreader.hpp"
 #include <filesystem>
+#include <fstream>
+#include <memory>
 #include <gpac/isomedia.h>
 #include <gpac/media_tools.h>
 
@@ -94,3 +98,299 @@ TEST_F(GstTestFixture, MultipleInputs)
   gf_sys_close();
   fs::remove(file);
 }
+
+TEST_F(GstTestFixture, BoundedQueues)
+{
+  this->SetUpPipeline({ false, "x264enc", 30 });
+
+  // Limits far below a fragment must not stall the muxer
+  GstElement* gpaccmafmux = gst_element_factory_make_full("gpaccmafmux",
+                                                          "max-size-bytes",
+                                                          (guint64)1,
+                                                          "max-size-time",
+                                                          (guint64)GST_MSECOND,
+                                                          NULL);
+  FileOutput output(
+    pipeline, this->GetLastElement(), gpaccmafmux, "bounded.mp4");
+
+  this->StartPipeline();
+  this->WaitForEOS();
+
+  // Everything was drained back under the limits at the end of the stream
+  guint64 level_bytes = G_MAXUINT64, level_time = G_MAXUINT64;
+  g_object_get(gpaccmafmux,
+               "current-level-bytes",
+               &level_bytes,
+               "current-level-time",
+               &level_time,
+               NULL);
+  EXPECT_LE(level_bytes, 1);
+  EXPECT_LE(level_time, GST_MSECOND);
+
+  output.Check(1, 30);
+}
+
+TEST_F(GstTestFixture, Statistics)
+{
+  this->SetUpPipeline({ false, "x264enc", 30 });
+
+  GstElement* gpaccmafmux = gst_element_factory_make("gpaccmafmux", NULL);
+  FileOutput output(pipeline, this->GetLastElement(), gpaccmafmux, "stats.mp4");
+
+  this->StartPipeline();
+  this->WaitForEOS();
+
+  // Every input buffer is accounted for
+  GstStructure* stats = NULL;
+  g_object_get(gpaccmafmux, "stats", &stats, NULL);
+  ASSERT_TRUE(stats != NULL);
+
+  guint64 packets_in = 0;
+  EXPECT_TRUE(gst_structure_get_uint64(stats, "packets-in", &packets_in));
+  EXPECT_EQ(packets_in, 30);
+  EXPECT_TRUE(gst_structure_has_field(stats, "session-run"));
+
+  gst_structure_free(stats);
+}
+
+TEST_F(GstTestFixture, UpstreamAllocator)
+{
+  this->SetUpPipeline({ false, "x264enc", 30 });
+  GstElement* gpacmp4mx = gst_element_factory_make("gpacmp4mx", NULL);
+  FileOutput output(pipeline, this->GetLastElement(), gpacmp4mx, "alloc.mp4");
+
+  // Count the encoded buffers written into our memory
+  guint shared = 0;
+  GstPad* pad = gst_element_get_static_pad(this->GetLastElement(), "src");
+  gst_pad_add_probe(
+    pad,
+    GST_PAD_PROBE_TYPE_BUFFER,
+    [](GstPad*, GstPadProbeInfo* info, gpointer udata) -> GstPadProbeReturn {
+      GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+      GstMemory* mem = gst_buffer_peek_memory(buffer, 0);
+      if (gst_memory_is_type(mem, "GpacMemory"))
+        (*(guint*)udata)++;
+      return GST_PAD_PROBE_OK;
+    },
+    &shared,
+    NULL);
+  gst_object_unref(pad);
+
+  this->StartPipeline();
+  this->WaitForEOS();
+
+  EXPECT_EQ(shared, 30);
+  output.Check(1, 30);
+}
+
+TEST_F(GstTestFixture, TraceFile)
+{
+  this->SetUpPipeline({ false, "x264enc", 30 });
+
+  std::string trace = fs::temp_directory_path().string() + "/" + "trace.json";
+  GstElement* gpaccmafmux = gst_element_factory_make_full(
+    "gpaccmafmux", "trace-file", trace.c_str(), NULL);
+  GstElement* sink = gst_element_factory_make("fakesink", NULL);
+
+  // Add the elements to the pipeline
+  gst_bin_add_many(GST_BIN(pipeline), gpaccmafmux, sink, NULL);
+
+  // Link the elements
+  if (!gst_element_link(this->GetLastElement(), gpaccmafmux) ||
+      !gst_element_link(gpaccmafmux, sink)) {
+    g_error("Failed to link elements");
+    return;
+  }
+
+  this->StartPipeline();
+  this->WaitForEOS();
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+
+  // The trace is finalized when the element stops
+  gchar* contents = NULL;
+  ASSERT_TRUE(g_file_get_contents(trace.c_str(), &contents, NULL, NULL));
+  EXPECT_TRUE(g_str_has_prefix(contents, "{\"traceEvents\":["));
+  EXPECT_TRUE(strstr(contents, "\"gf_fs_run\"") != NULL);
+  EXPECT_TRUE(strstr(contents, "\"gst_gpac_tf_aggregate\"") != NULL);
+  EXPECT_TRUE(g_str_has_suffix(contents, "}\n"));
+
+  g_free(contents);
+  fs::remove(trace);
+}
+
+TEST_F(GstTestFixture, TSPacketAligned)
+{
+  this->SetUpPipeline({ false, "x264enc", 30 });
+
+  GstElement* gpactsmx = gst_element_factory_make("gpactsmx", NULL);
+  GstAppSink* sink = new GstAppSink(gpactsmx, GetLastElement(), pipeline);
+
+  this->StartPipeline();
+
+  // Every buffer is a timestamped run of at most 7 TS packets
+  int keyframes = 0;
+  while (true) {
+    GstBufferList* buffer_list = sink->PopBuffer();
+    if (!buffer_list)
+      break;
+
+    for (guint i = 0; i < gst_buffer_list_length(buffer_list); i++) {
+      GstBuffer* buffer = gst_buffer_list_get(buffer_list, i);
+      gsize size = gst_buffer_get_size(buffer);
+      EXPECT_EQ(size % 188, 0);
+      EXPECT_LE(size, 7 * 188);
+      EXPECT_TRUE(GST_BUFFER_PTS_IS_VALID(buffer));
+      if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+        keyframes++;
+    }
+    gst_buffer_list_unref(buffer_list);
+  }
+  EXPECT_GT(keyframes, 0);
+
+  delete sink;
+}
+
+TEST_F(GstTestFixture, SharedMemoryOutput)
+{
+  this->SetUpPipeline({ false, "x264enc", 30 });
+  GstElement* gpaccmafmux = gst_element_factory_make("gpaccmafmux", NULL);
+
+  // Publish the output on a local socket as well
+  std::string socket = fs::temp_directory_path().string() + "/" + "shm.sock";
+  g_object_set(gpaccmafmux, "shm-socket", socket.c_str(), NULL);
+  FileOutput output(pipeline, this->GetLastElement(), gpaccmafmux, "shm.mp4");
+
+  this->StartPipeline();
+  this->WaitForEOS();
+
+  // A late consumer gets everything still in the ring replayed
+  ShmReader reader;
+  int count = reader.connect(socket);
+  ASSERT_GT(count, 0);
+
+  ShmReader::Buffer received;
+  for (int i = 0; i < count; i++) {
+    GPAC_ShmDescriptor desc;
+    ASSERT_TRUE(reader.next(desc));
+    if (i == 0)
+      EXPECT_TRUE(desc.flags & GPAC_SHM_FLAG_HEADER);
+
+    ShmReader::Buffer data = reader.read(desc);
+    ASSERT_EQ(data.size(), desc.size);
+    received.insert(received.end(), data.begin(), data.end());
+  }
+
+  // The consumer sees the same bytes as downstream
+  std::ifstream stream(output.GetPath(), std::ios::binary);
+  ShmReader::Buffer expected((std::istreambuf_iterator<char>(stream)),
+                             std::istreambuf_iterator<char>());
+  EXPECT_EQ(received, expected);
+}
+
+TEST_F(GstTestFixture, SharedSession)
+{
+  this->SetUpPipeline({ false, "x264enc", 30 });
+  this->SetUpPipeline({ false, "x264enc", 30 });
+
+  // Two renditions muxed by a single gpac session
+  std::vector<std::unique_ptr<FileOutput>> outputs;
+  for (int i = 0; i < 2; i++) {
+    GstElement* gpacmp4mx = gst_element_factory_make("gpacmp4mx", NULL);
+    g_object_set(gpacmp4mx, "shared-session", "ladder", NULL);
+    outputs.push_back(std::make_unique<FileOutput>(
+      pipeline,
+      this->GetLastElement(i),
+      gpacmp4mx,
+      "shared" + std::to_string(i) + ".mp4"));
+  }
+
+  // Both elements preroll, one blocking downstream must not stall the other
+  GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_PAUSED);
+  EXPECT_NE(ret, GST_STATE_CHANGE_FAILURE);
+  ret = gst_element_get_state(pipeline, NULL, NULL, 10 * GST_SECOND);
+  EXPECT_EQ(ret, GST_STATE_CHANGE_SUCCESS);
+
+  // A flushing seek goes through both elements of the session
+  EXPECT_TRUE(gst_element_seek_simple(
+    pipeline,
+    GST_FORMAT_TIME,
+    (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT),
+    GST_SECOND / 2));
+  ret = gst_element_get_state(pipeline, NULL, NULL, 10 * GST_SECOND);
+  EXPECT_EQ(ret, GST_STATE_CHANGE_SUCCESS);
+
+  this->StartPipeline();
+  this->WaitForEOS();
+
+  // Each element only got its own rendition
+  for (const auto& output : outputs)
+    output->Check(1, 1, 30);
+}
+
+TEST_F(GstTestFixture, GraphHotSwap)
+{
+  this->SetUpPipeline({ false, "x264enc", 90 });
+  this->SetLive(true);
+
+  // Start with one output, then switch to another while running
+  std::string files[2];
+  for (int i = 0; i < 2; i++)
+    files[i] = fs::temp_directory_path().string() + "/" + "swap" +
+               std::to_string(i) + ".mp4";
+  std::string graph = "-o " + files[0];
+  GstElement* gpacsink =
+    gst_element_factory_make_full("gpacsink", "graph", graph.c_str(), NULL);
+
+  // Collect the notifications posted when the graph is switched
+  std::vector<std::string> swapped;
+  GstBus* bus = gst_element_get_bus(pipeline);
+  gst_bus_enable_sync_message_emission(bus);
+  gulong handler = g_signal_connect(
+    bus,
+    "sync-message::element",
+    G_CALLBACK(+[](GstBus*, GstMessage* msg, gpointer user_data) {
+      const GstStructure* s = gst_message_get_structure(msg);
+      if (gst_structure_has_name(s, "gpac-graph-swapped"))
+        static_cast<std::vector<std::string>*>(user_data)->emplace_back(
+          gst_structure_get_string(s, "graph"));
+    }),
+    &swapped);
+
+  // Add the elements to the pipeline
+  gst_bin_add(GST_BIN(pipeline), gpacsink);
+  if (!gst_element_link(this->GetLastElement(), gpacsink)) {
+    g_error("Failed to link elements");
+    return;
+  }
+
+  this->StartPipeline();
+
+  // Let the first graph write some samples before the switch
+  g_usleep(G_USEC_PER_SEC);
+  graph = "-o " + files[1];
+  g_object_set(gpacsink, "graph", graph.c_str(), NULL);
+
+  this->WaitForEOS();
+
+  // The counters do not outlive the test
+  g_signal_handler_disconnect(bus, handler);
+  gst_bus_disable_sync_message_emission(bus);
+  gst_object_unref(bus);
+
+  // The graph was switched once, without losing samples
+  ASSERT_EQ(swapped.size(), 1);
+  EXPECT_EQ(swapped[0], graph);
+  u32 sample_count = 0;
+  gf_sys_init(GF_MemTrackerNone, NULL);
+  for (const std::string& file : files) {
+    ASSERT_TRUE(fs::exists(file));
+    GF_ISOFile* isom = gf_isom_open(file.c_str(), GF_ISOM_OPEN_READ, NULL);
+    ASSERT_TRUE(isom != NULL);
+    EXPECT_GT(gf_isom_get_sample_count(isom, 1), 0);
+    sample_count += gf_isom_get_sample_count(isom, 1);
+    gf_isom_close(isom);
+    fs::remove(file);
+  }
+  gf_sys_close();
+  EXPECT_EQ(sample_count, 90);
+}
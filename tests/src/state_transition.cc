@@ -1,4 +1,7 @@
 #include "helper/common.hpp"
+#include "helper/smemcapture.hpp"
+#include <atomic>
+#include <memory>
 
 TEST_F(GstTestFixture, StatePausedToNullToPlaying)
 {
@@ -35,3 +38,201 @@ TEST_F(GstTestFixture, StatePausedToNullToPlaying)
   // Wait for the EOS
   this->WaitForEOS();
 }
+
+TEST_F(GstTestFixture, StatePausedToNullToPlayingReuseSession)
+{
+  this->SetUpPipeline({ false, "x264enc", 5 });
+  GstElement* muxer = gst_element_factory_make_full(
+    "gpaccmafmux", "cdur", 5.0, "reuse-session", TRUE, NULL);
+  GstElement* fake_sink = gst_element_factory_make("fakesink", NULL);
+  gst_bin_add_many(GST_BIN(pipeline), muxer, fake_sink, NULL);
+
+  if (!gst_element_link(this->GetLastElement(), muxer) ||
+      !gst_element_link(muxer, fake_sink)) {
+    g_error("Failed to link elements");
+    return;
+  }
+
+  // Cycle through the states a few times, the session prepared on stop should
+  // be picked up by the next start
+  for (int i = 0; i < 3; i++) {
+    GstStateChangeReturn ret =
+      gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    if (ret == GST_STATE_CHANGE_FAILURE) {
+      g_error("Failed to start pipeline");
+    }
+
+    ret = gst_element_set_state(pipeline, GST_STATE_NULL);
+    if (ret == GST_STATE_CHANGE_FAILURE) {
+      g_error("Failed to set pipeline to NULL state");
+    }
+  }
+
+  // Back to the PLAYING state
+  GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  if (ret == GST_STATE_CHANGE_FAILURE) {
+    g_error("Failed to start pipeline");
+  }
+
+  // Wait for the EOS
+  this->WaitForEOS();
+
+  // The last start picked up the session prepared by the previous stop
+  GstStructure* stats = NULL;
+  g_object_get(muxer, "stats", &stats, NULL);
+  ASSERT_TRUE(stats != NULL);
+  gboolean reused = FALSE;
+  EXPECT_TRUE(gst_structure_get_boolean(stats, "session-reused", &reused));
+  EXPECT_TRUE(reused);
+  gst_structure_free(stats);
+}
+
+TEST_F(GstTestFixture, SinkPrerollAndPosition)
+{
+  this->SetUpPipeline({ false, "x264enc", 30 });
+  GstElement* sink =
+    gst_element_factory_make_full("gpachlssink", "segdur", 1.0, NULL);
+
+  // Keep the output in memory
+  SignalMemoryCapture capture;
+  capture.connect(sink, "get-manifest");
+  capture.connect(sink, "get-manifest-variant");
+  capture.connect(sink, "get-segment-init");
+  capture.connect(sink, "get-segment");
+
+  gst_bin_add(GST_BIN(pipeline), sink);
+  if (!gst_element_link(this->GetLastElement(), sink)) {
+    g_error("Failed to link elements");
+    return;
+  }
+
+  // Count the buffers the sink takes in
+  std::atomic<int> buffers = 0;
+  GstPad* pad = gst_element_get_static_pad(this->GetLastElement(), "src");
+  gulong probe = gst_pad_add_probe(
+    pad,
+    GST_PAD_PROBE_TYPE_BUFFER,
+    [](GstPad*, GstPadProbeInfo*, gpointer data) -> GstPadProbeReturn {
+      (*static_cast<std::atomic<int>*>(data))++;
+      return GST_PAD_PROBE_OK;
+    },
+    &buffers,
+    NULL);
+
+  // The sink goes to PAUSED asynchronously, once the first data prerolled
+  GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_PAUSED);
+  EXPECT_EQ(ret, GST_STATE_CHANGE_ASYNC);
+  ret = gst_element_get_state(pipeline, NULL, NULL, 10 * GST_SECOND);
+  EXPECT_EQ(ret, GST_STATE_CHANGE_SUCCESS);
+
+  // The prerolled sink holds the stream, and knows where it stands
+  int prerolled = buffers;
+  EXPECT_GT(prerolled, 0);
+  g_usleep(G_USEC_PER_SEC / 2);
+  EXPECT_EQ(buffers, prerolled);
+  EXPECT_LT(prerolled, 30);
+  gint64 paused_position = -1;
+  EXPECT_TRUE(
+    gst_element_query_position(pipeline, GST_FORMAT_TIME, &paused_position));
+  EXPECT_GE(paused_position, 0);
+
+  // The pipeline posts EOS through the sink
+  ret = gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  EXPECT_NE(ret, GST_STATE_CHANGE_FAILURE);
+  this->WaitForEOS();
+  EXPECT_EQ(buffers, 30);
+  gst_pad_remove_probe(pad, probe);
+  gst_object_unref(pad);
+
+  // The position is the one of the last data taken in
+  gint64 position = -1;
+  EXPECT_TRUE(
+    gst_element_query_position(pipeline, GST_FORMAT_TIME, &position));
+  EXPECT_GT(position, 0);
+
+  capture.finish(sink);
+}
+
+TEST_F(GstTestFixture, FlushingSeek)
+{
+  this->SetUpPipeline({ false, "x264enc", 300 });
+  GstElement* muxer =
+    gst_element_factory_make_full("gpaccmafmux", "cdur", 1.0, NULL);
+  auto sink = std::make_unique<GstAppSink>(muxer, GetEncoder(), pipeline);
+
+  // Let a first fragment through before seeking
+  this->StartPipeline();
+  GstBufferList* buffer = sink->PopBuffer();
+  ASSERT_TRUE(buffer != NULL);
+  gst_buffer_list_unref(buffer);
+
+  // The queued media is dropped instead of being muxed
+  EXPECT_TRUE(gst_element_seek_simple(
+    pipeline,
+    GST_FORMAT_TIME,
+    (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT),
+    5 * GST_SECOND));
+  GstStateChangeReturn ret =
+    gst_element_get_state(pipeline, NULL, NULL, 10 * GST_SECOND);
+  EXPECT_EQ(ret, GST_STATE_CHANGE_SUCCESS);
+
+  // Output restarts and only covers what is left after the seek point
+  int buffer_count = 0;
+  while ((buffer = sink->PopBuffer())) {
+    gst_buffer_list_unref(buffer);
+    buffer_count++;
+  }
+  EXPECT_GT(buffer_count, 0);
+  EXPECT_LT(buffer_count, 8);
+}
+
+TEST_F(GstTestFixture, StatePlayingToReadyToPlaying)
+{
+  this->SetUpPipeline({ false, "x264enc", 60 });
+  GstElement* muxer =
+    gst_element_factory_make_full("gpaccmafmux", "cdur", 1.0, NULL);
+  auto sink = std::make_unique<GstAppSink>(muxer, GetEncoder(), pipeline);
+
+  // Count the errors posted along the way
+  int errors = 0;
+  GstBus* bus = gst_element_get_bus(pipeline);
+  gst_bus_enable_sync_message_emission(bus);
+  gulong handler = g_signal_connect(
+    bus,
+    "sync-message::error",
+    G_CALLBACK(+[](GstBus*, GstMessage*, gpointer data) {
+      (*static_cast<int*>(data))++;
+    }),
+    &errors);
+
+  // Let a first fragment through
+  this->StartPipeline();
+  GstBufferList* buffer = sink->PopBuffer();
+  EXPECT_TRUE(buffer != NULL);
+  if (buffer)
+    gst_buffer_list_unref(buffer);
+
+  // The same caps and tags come back on restart, the new PIDs need them
+  GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_READY);
+  EXPECT_NE(ret, GST_STATE_CHANGE_FAILURE);
+  ret = gst_element_get_state(pipeline, NULL, NULL, 10 * GST_SECOND);
+  EXPECT_EQ(ret, GST_STATE_CHANGE_SUCCESS);
+  ret = gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  EXPECT_NE(ret, GST_STATE_CHANGE_FAILURE);
+
+  // The whole stream is muxed again
+  int buffer_count = 0;
+  while ((buffer = sink->PopBuffer())) {
+    gst_buffer_list_unref(buffer);
+    buffer_count++;
+  }
+  EXPECT_GT(buffer_count, 1);
+
+  // And ends without errors
+  this->WaitForEOS();
+  EXPECT_EQ(errors, 0);
+
+  g_signal_handler_disconnect(bus, handler);
+  gst_bus_disable_sync_message_emission(bus);
+  gst_object_unref(bus);
+}